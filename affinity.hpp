@@ -0,0 +1,499 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_AFFINITY_HPP
+#define DMITIGR_PRG_AFFINITY_HPP
+
+#include "../base/assert.hpp"
+#include "command.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace dmitigr::prg {
+
+namespace detail {
+
+/// The upper bound of CPU indexes (the maximum `NR_CPUS` of Linux).
+inline constexpr int cpu_limit{8192};
+
+/// The upper bound of NUMA node indexes (the maximum `MAX_NUMNODES` of Linux).
+inline constexpr int numa_node_limit{1024};
+
+/// @returns The non-negative integer less than `limit` parsed from `str`.
+inline int to_index(const std::string_view str, const char* const what,
+  const int limit)
+{
+  int result{};
+  const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(),
+    result);
+  if (ec != std::errc{} || ptr != str.data() + str.size() || result < 0 ||
+    result >= limit)
+    throw std::invalid_argument{std::string{"invalid "}.append(what)
+      .append(" \"").append(str).append("\"")};
+  return result;
+}
+
+/**
+ * @returns The sorted vector of unique indexes parsed from `list`.
+ *
+ * @details The `list` is a comma separated list of indexes or ranges of
+ * indexes, like `0-7,16-23`. Each index must be less than `limit`.
+ */
+inline std::vector<int> to_index_list(std::string_view list,
+  const char* const what, const int limit)
+{
+  std::vector<bool> is_listed(static_cast<std::size_t>(limit));
+  while (!list.empty()) {
+    const auto comma = list.find(',');
+    const auto item = list.substr(0, comma);
+    if (const auto dash = item.find('-'); dash != std::string_view::npos) {
+      const int first{to_index(item.substr(0, dash), what, limit)};
+      const int last{to_index(item.substr(dash + 1), what, limit)};
+      if (first > last)
+        throw std::invalid_argument{std::string{"invalid "}.append(what)
+          .append(" range \"").append(item).append("\"")};
+      for (int i{first}; i <= last; ++i)
+        is_listed[static_cast<std::size_t>(i)] = true;
+    } else
+      is_listed[static_cast<std::size_t>(to_index(item, what, limit))] = true;
+
+    if (comma == std::string_view::npos)
+      break;
+    list.remove_prefix(comma + 1);
+    if (list.empty())
+      throw std::invalid_argument{std::string{"trailing comma in "}
+        .append(what).append(" list")};
+  }
+  std::vector<int> result;
+  for (int i{}; i < limit; ++i) {
+    if (is_listed[static_cast<std::size_t>(i)])
+      result.push_back(i);
+  }
+  return result;
+}
+
+/// @returns The string representation of sorted `list` like `0-7,16-23`.
+inline std::string to_index_list_string(const std::vector<int>& list)
+{
+  std::string result;
+  for (auto i = cbegin(list); i != cend(list);) {
+    auto j = i;
+    while (j + 1 != cend(list) && *(j + 1) == *j + 1)
+      ++j;
+    if (!result.empty())
+      result += ',';
+    result += std::to_string(*i);
+    if (j != i)
+      result.append("-").append(std::to_string(*j));
+    i = j + 1;
+  }
+  return result;
+}
+
+} // namespace detail
+
+// =============================================================================
+
+/// A set of CPUs.
+class Cpu_set final {
+public:
+  /// The default constructor. (Constructs an empty set.)
+  Cpu_set() = default;
+
+  /**
+   * @brief The constructor.
+   *
+   * @par Requires
+   * Each element of `cpus` must be non-negative.
+   */
+  explicit Cpu_set(std::vector<int> cpus)
+    : cpus_{std::move(cpus)}
+  {
+    if (any_of(cbegin(cpus_), cend(cpus_), [](const int c){return c < 0;}))
+      throw std::invalid_argument{"negative CPU index"};
+    std::sort(begin(cpus_), end(cpus_));
+    cpus_.erase(std::unique(begin(cpus_), end(cpus_)), end(cpus_));
+  }
+
+  /**
+   * @returns The instance parsed from CPU list like `0-7,16-23`.
+   *
+   * @par Requires
+   * `!list.empty()`.
+   */
+  static Cpu_set from_string(const std::string_view list)
+  {
+    if (list.empty())
+      throw std::invalid_argument{"empty CPU list"};
+    Cpu_set result;
+    result.cpus_ = detail::to_index_list(list, "CPU",
+      detail::cpu_limit);
+    return result;
+  }
+
+  /// @returns The set of CPUs the calling thread is allowed to run on.
+  static Cpu_set current()
+  {
+#ifdef __linux__
+    for (std::size_t count{CPU_SETSIZE};; count *= 2) {
+      cpu_set_t* const set = CPU_ALLOC(count);
+      if (!set)
+        throw std::bad_alloc{};
+      const auto size = CPU_ALLOC_SIZE(count);
+      CPU_ZERO_S(size, set);
+      if (sched_getaffinity(0, size, set)) {
+        const int err{errno};
+        CPU_FREE(set);
+        if (err == EINVAL && count < 1024*1024)
+          continue;
+        throw std::system_error{err, std::system_category(),
+          "cannot get CPU affinity"};
+      }
+      Cpu_set result;
+      for (std::size_t i{}; i < count; ++i) {
+        if (CPU_ISSET_S(i, size, set))
+          result.cpus_.push_back(static_cast<int>(i));
+      }
+      CPU_FREE(set);
+      return result;
+    }
+#else
+    std::vector<int> cpus(std::max(std::thread::hardware_concurrency(), 1u));
+    for (std::size_t i{}; i < cpus.size(); ++i)
+      cpus[i] = static_cast<int>(i);
+    return Cpu_set{std::move(cpus)};
+#endif
+  }
+
+  /// @returns `true` if this set is empty.
+  bool is_empty() const noexcept
+  {
+    return cpus_.empty();
+  }
+
+  /// @returns The number of CPUs in this set.
+  std::size_t size() const noexcept
+  {
+    return cpus_.size();
+  }
+
+  /// @returns The sorted vector of CPU indexes.
+  const std::vector<int>& cpus() const noexcept
+  {
+    return cpus_;
+  }
+
+  /// @returns `true` if this set contains `cpu`.
+  bool contains(const int cpu) const noexcept
+  {
+    return std::binary_search(cbegin(cpus_), cend(cpus_), cpu);
+  }
+
+  /// @returns The string representation of this set like `0-7,16-23`.
+  std::string to_string() const
+  {
+    return detail::to_index_list_string(cpus_);
+  }
+
+  /**
+   * @brief Binds the calling thread to this set of CPUs.
+   *
+   * @details Threads created after the call inherit the binding.
+   *
+   * @par Requires
+   * `!is_empty()`.
+   */
+  void bind_current_thread() const
+  {
+    if (is_empty())
+      throw std::invalid_argument{"cannot bind thread to empty CPU set"};
+#ifdef __linux__
+    const std::size_t count = cpus_.back() + 1;
+    cpu_set_t* const set = CPU_ALLOC(count);
+    if (!set)
+      throw std::bad_alloc{};
+    const auto size = CPU_ALLOC_SIZE(count);
+    CPU_ZERO_S(size, set);
+    for (const int cpu : cpus_)
+      CPU_SET_S(cpu, size, set);
+    const int err{pthread_setaffinity_np(pthread_self(), size, set)};
+    CPU_FREE(set);
+    if (err)
+      throw std::system_error{err, std::system_category(),
+        std::string{"cannot bind thread to CPUs "}.append(to_string())};
+#else
+    throw std::runtime_error{"CPU affinity is not supported on this platform"};
+#endif
+  }
+
+private:
+  std::vector<int> cpus_;
+};
+
+// =============================================================================
+
+/// A NUMA memory policy mode.
+enum class Numa_mode {
+  /// The system default policy.
+  system,
+  /// Allocate on the node of the CPU that triggered the allocation.
+  local,
+  /// Prefer allocations on the specified node.
+  preferred,
+  /// Restrict allocations to the specified nodes.
+  bind,
+  /// Interleave allocations across the specified nodes.
+  interleave
+};
+
+/// A NUMA memory policy.
+class Numa_policy final {
+public:
+  /// The default constructor. (Constructs the system default policy.)
+  Numa_policy() = default;
+
+  /**
+   * @brief The constructor.
+   *
+   * @par Requires
+   * `nodes.empty()` if `mode` is `system` or `local`, `nodes.size() == 1` if
+   * `mode` is `preferred` and `!nodes.empty()` otherwise.
+   */
+  Numa_policy(const Numa_mode mode, std::vector<int> nodes)
+    : mode_{mode}
+    , nodes_{std::move(nodes)}
+  {
+    if (any_of(cbegin(nodes_), cend(nodes_), [](const int n){return n < 0;}))
+      throw std::invalid_argument{"negative NUMA node index"};
+    std::sort(begin(nodes_), end(nodes_));
+    nodes_.erase(std::unique(begin(nodes_), end(nodes_)), end(nodes_));
+
+    switch (mode_) {
+    case Numa_mode::system: [[fallthrough]];
+    case Numa_mode::local:
+      if (!nodes_.empty())
+        throw std::invalid_argument{"NUMA policy doesn't accept nodes"};
+      break;
+    case Numa_mode::preferred:
+      if (nodes_.size() != 1)
+        throw std::invalid_argument{"NUMA policy requires exactly one node"};
+      break;
+    case Numa_mode::bind: [[fallthrough]];
+    case Numa_mode::interleave:
+      if (nodes_.empty())
+        throw std::invalid_argument{"NUMA policy requires nodes"};
+      break;
+    }
+  }
+
+  /**
+   * @returns The instance parsed from `spec`.
+   *
+   * @details The `spec` syntax is `mode[:nodes]`, where `mode` is one of
+   * `system`, `local`, `preferred`, `bind` or `interleave`, and `nodes` is
+   * a list of NUMA nodes like `0-1,3`.
+   */
+  static Numa_policy from_string(const std::string_view spec)
+  {
+    const auto colon = spec.find(':');
+    const auto mode_str = spec.substr(0, colon);
+    const auto nodes = colon != std::string_view::npos ?
+      detail::to_index_list(spec.substr(colon + 1), "NUMA node",
+        detail::numa_node_limit) :
+      std::vector<int>{};
+    static const std::pair<std::string_view, Numa_mode> modes[] = {
+      {"system", Numa_mode::system},
+      {"local", Numa_mode::local},
+      {"preferred", Numa_mode::preferred},
+      {"bind", Numa_mode::bind},
+      {"interleave", Numa_mode::interleave}
+    };
+    for (const auto& [name, mode] : modes)
+      if (name == mode_str)
+        return Numa_policy{mode, nodes};
+    throw std::invalid_argument{std::string{"invalid NUMA policy \""}
+      .append(spec).append("\"")};
+  }
+
+  /// @returns The mode.
+  Numa_mode mode() const noexcept
+  {
+    return mode_;
+  }
+
+  /// @returns The sorted vector of NUMA nodes.
+  const std::vector<int>& nodes() const noexcept
+  {
+    return nodes_;
+  }
+
+  /**
+   * @brief Sets this policy as the memory policy of the calling thread.
+   *
+   * @details Threads created after the call inherit the policy.
+   */
+  void apply() const
+  {
+#ifdef __linux__
+    // Values of MPOL_* from <linux/mempolicy.h>.
+    int mode{};
+    switch (mode_) {
+    case Numa_mode::system: mode = 0; break;
+    case Numa_mode::preferred: mode = 1; break;
+    case Numa_mode::bind: mode = 2; break;
+    case Numa_mode::interleave: mode = 3; break;
+    case Numa_mode::local: mode = 4; break;
+    }
+    constexpr std::size_t bits{sizeof(unsigned long) * CHAR_BIT};
+    std::vector<unsigned long> mask(nodes_.empty() ? 0 :
+      nodes_.back() / bits + 1);
+    for (const int node : nodes_)
+      mask[node / bits] |= 1ul << (node % bits);
+    const unsigned long max_node = mask.empty() ? 0 : mask.size() * bits + 1;
+    if (syscall(SYS_set_mempolicy, mode, mask.empty() ? nullptr : mask.data(),
+        max_node))
+      throw std::system_error{errno, std::system_category(),
+        "cannot set NUMA memory policy"};
+#else
+    throw std::runtime_error{"NUMA policy is not supported on this platform"};
+#endif
+  }
+
+private:
+  Numa_mode mode_{Numa_mode::system};
+  std::vector<int> nodes_;
+};
+
+// =============================================================================
+
+/**
+ * @brief The process placement settings.
+ *
+ * @details Corresponds to the following standard options:
+ *   - `--cpus=list` - the CPUs to run on, like `0-7,16-23`;
+ *   - `--numa=mode[:nodes]` - the NUMA memory policy (see Numa_policy);
+ *   - `--pin-threads` - bind each worker thread to a single CPU.
+ */
+class Affinity final {
+public:
+  /// The names of the standard options.
+  static constexpr std::string_view option_names[]{"cpus", "numa",
+    "pin-threads"};
+
+  /// @returns The instance from the standard options of `command`.
+  static Affinity make(const Command& command)
+  {
+    Affinity result;
+    const auto [cpus, numa, pin] = command.options("cpus", "numa",
+      "pin-threads");
+    if (cpus.is_valid_throw_if_no_value())
+      result.cpus_ = Cpu_set::from_string(cpus.value_not_empty());
+    if (numa.is_valid_throw_if_no_value())
+      result.numa_ = Numa_policy::from_string(numa.value_not_empty());
+    result.is_thread_pinning_ = pin.is_valid_throw_if_value();
+    return result;
+  }
+
+  /// @returns The CPUs to run on.
+  const std::optional<Cpu_set>& cpus() const noexcept
+  {
+    return cpus_;
+  }
+
+  /// @returns The NUMA memory policy.
+  const std::optional<Numa_policy>& numa() const noexcept
+  {
+    return numa_;
+  }
+
+  /// @returns `true` if each worker thread must be bound to a single CPU.
+  bool is_thread_pinning() const noexcept
+  {
+    return is_thread_pinning_;
+  }
+
+  /**
+   * @brief Applies the settings to the calling thread.
+   *
+   * @remarks Should be called before creating any threads.
+   */
+  void apply() const
+  {
+    if (cpus_)
+      cpus_->bind_current_thread();
+    if (numa_)
+      numa_->apply();
+  }
+
+  /// @returns `cpus()` if specified, or `Cpu_set::current()` otherwise.
+  Cpu_set effective_cpus() const
+  {
+    return cpus_ ? *cpus_ : Cpu_set::current();
+  }
+
+  /**
+   * @returns The CPUs for the worker thread with the given `index`.
+   *
+   * @details If `is_thread_pinning()` the workers are spread over the
+   * `effective_cpus()` one CPU per worker (round-robin).
+   */
+  Cpu_set worker_cpus(const std::size_t index) const
+  {
+    auto cpus = effective_cpus();
+    if (!is_thread_pinning_ || cpus.is_empty())
+      return cpus;
+    return Cpu_set{{cpus.cpus()[index % cpus.size()]}};
+  }
+
+  /**
+   * @brief Binds the calling thread to `worker_cpus(index)` if
+   * `is_thread_pinning()`.
+   *
+   * @remarks It makes the most sense to call it at the start of the worker.
+   */
+  void apply_to_worker(const std::size_t index) const
+  {
+    if (is_thread_pinning_)
+      worker_cpus(index).bind_current_thread();
+  }
+
+private:
+  std::optional<Cpu_set> cpus_;
+  std::optional<Numa_policy> numa_;
+  bool is_thread_pinning_{};
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_AFFINITY_HPP
@@ -0,0 +1,358 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_BATCH_HPP
+#define DMITIGR_PRG_BATCH_HPP
+
+#ifdef _WIN32
+#error dmitigr/prg/batch.hpp is not usable on Windows!
+#endif
+
+#include "../base/assert.hpp"
+#include "../base/noncopymove.hpp"
+#include "command.hpp"
+#include "info.hpp"
+#include "tokenizer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+namespace dmitigr::prg {
+
+/**
+ * @brief A reader of delimited records from a descriptor.
+ *
+ * @details The internal buffer is reused across the records.
+ */
+class Record_reader final : Noncopymove {
+public:
+  /// The constructor.
+  explicit Record_reader(const int fd, const char delimiter = '\n',
+    const std::size_t max_record_size = 16*1024*1024)
+    : fd_{fd}
+    , delimiter_{delimiter}
+    , max_record_size_{max_record_size}
+  {
+    if (fd_ < 0)
+      throw std::invalid_argument{"invalid descriptor of record reader"};
+    buffer_.resize(64*1024);
+  }
+
+  /**
+   * @returns The next record without the delimiter, or `nullopt` at the end
+   * of input. The last record may be not terminated by the delimiter.
+   *
+   * @remarks The returned view is valid until the next call.
+   */
+  std::optional<std::string_view> next()
+  {
+    while (true) {
+      const auto begin = buffer_.data() + offset_;
+      const auto end = buffer_.data() + size_;
+      if (const auto pos = static_cast<char*>(std::memchr(begin, delimiter_,
+            static_cast<std::size_t>(end - begin)))) {
+        offset_ = static_cast<std::size_t>(pos - buffer_.data()) + 1;
+        return std::string_view{begin, static_cast<std::size_t>(pos - begin)};
+      } else if (is_eof_) {
+        if (begin == end)
+          return std::nullopt;
+        offset_ = size_;
+        return std::string_view{begin, static_cast<std::size_t>(end - begin)};
+      }
+
+      // Compact the buffer and read more.
+      if (offset_) {
+        std::memmove(buffer_.data(), begin, static_cast<std::size_t>(end - begin));
+        size_ -= offset_;
+        offset_ = 0;
+      }
+      if (size_ == buffer_.size()) {
+        if (buffer_.size() >= max_record_size_)
+          throw std::runtime_error{"too large record"};
+        buffer_.resize(std::min(buffer_.size() * 2, max_record_size_));
+      }
+      const auto count = read(fd_, buffer_.data() + size_, buffer_.size() - size_);
+      if (count < 0) {
+        if (errno == EINTR)
+          continue;
+        throw std::system_error{errno, std::system_category(),
+          "cannot read records"};
+      } else if (!count)
+        is_eof_ = true;
+      size_ += static_cast<std::size_t>(count);
+    }
+  }
+
+private:
+  int fd_{-1};
+  char delimiter_{};
+  std::size_t max_record_size_{};
+  std::vector<char> buffer_;
+  std::size_t offset_{};
+  std::size_t size_{};
+  bool is_eof_{};
+};
+
+// =============================================================================
+
+/// The options of run_batch().
+struct Batch_options final {
+  /// The delimiter of command lines, like `\n` or `\0`.
+  char delimiter{'\n'};
+
+  /**
+   * The number of worker threads to dispatch commands to, or `0` to dispatch
+   * the commands in the calling thread.
+   */
+  std::size_t thread_count{};
+
+  /// The descriptor to write the output of commands to.
+  int output_fd{STDOUT_FILENO};
+
+  /// The descriptor to write the error messages to.
+  int error_fd{STDERR_FILENO};
+
+  /// `true` if the commands may have parameters (see make_command()).
+  bool may_have_params{true};
+};
+
+/// The summary of run_batch().
+struct Batch_summary final {
+  /// The number of dispatched commands.
+  std::size_t command_count{};
+
+  /// The number of commands failed with exception or nonzero result.
+  std::size_t failure_count{};
+};
+
+/**
+ * @brief Reads command lines from `input_fd` and dispatches them.
+ *
+ * @param handler The function with signature `int(const Command& command,
+ * std::string& output)` to call for each command. The `output` is cleared
+ * before the call and written to `options.output_fd` after it. The nonzero
+ * result and the exception are counted as failures. The message of the
+ * exception is written to `options.error_fd`.
+ *
+ * @details The command lines are split into arguments by tokenize(). The
+ * lines without arguments are skipped. The outputs are written in
+ * the order of command lines regardless of the `options.thread_count`. The
+ * dispatching stops at the end of input, or if `Info::instance().stop_signal`
+ * is set (if `Info::is_initialized()`).
+ *
+ * @remarks The `input_fd` may be a pipe, a file or a connected socket.
+ */
+template<typename F>
+Batch_summary run_batch(const int input_fd, F&& handler,
+  const Batch_options& options = {})
+{
+  struct Job final {
+    std::size_t number{};
+    std::size_t line_number{};
+    std::string line;
+    Argv argv;
+    std::string output;
+    std::string error;
+    bool is_empty{};
+    bool is_failed{};
+  };
+
+  static const auto write_all = [](const int fd, const std::string_view data)
+  {
+    for (std::size_t offset{}; offset < data.size();) {
+      const auto count = write(fd, data.data() + offset, data.size() - offset);
+      if (count < 0) {
+        if (errno == EINTR)
+          continue;
+        throw std::system_error{errno, std::system_category(),
+          "cannot write output of batch command"};
+      }
+      offset += static_cast<std::size_t>(count);
+    }
+  };
+
+  const auto dispatch = [&handler, &options](Job& job) noexcept
+  {
+    job.output.clear();
+    job.error.clear();
+    job.is_empty = false;
+    job.is_failed = true;
+    try {
+      job.argv.assign(job.line);
+      if (!job.argv.argc()) {
+        job.is_empty = true;
+        job.is_failed = false;
+        return;
+      }
+      int argc{job.argv.argc()};
+      const char* const* argv{job.argv.argv()};
+      const auto command = make_command(&argc, &argv, options.may_have_params);
+      job.is_failed = handler(command, job.output) != 0;
+    } catch (const std::exception& e) {
+      job.error.append("line ").append(std::to_string(job.line_number))
+        .append(": ").append(e.what()).append("\n");
+    } catch (...) {
+      job.error.append("line ").append(std::to_string(job.line_number))
+        .append(": unknown error\n");
+    }
+  };
+
+  const auto is_stopped = []
+  {
+    return Info::is_initialized() && Info::instance().stop_signal;
+  };
+
+  Batch_summary result;
+  Record_reader reader{input_fd, options.delimiter};
+
+  // Dispatch in the calling thread.
+  if (!options.thread_count) {
+    Job job;
+    while (!is_stopped()) {
+      const auto line = reader.next();
+      if (!line)
+        break;
+      ++job.line_number;
+      job.line.assign(*line);
+      dispatch(job);
+      result.command_count += !job.is_empty;
+      result.failure_count += job.is_failed;
+      write_all(options.output_fd, job.output);
+      write_all(options.error_fd, job.error);
+    }
+    return result;
+  }
+
+  // Dispatch in the worker threads.
+  std::mutex mutex;
+  std::condition_variable queue_cond;
+  std::condition_variable free_cond;
+  std::deque<std::unique_ptr<Job>> queue;
+  std::vector<std::unique_ptr<Job>> free_jobs;
+  std::map<std::size_t, std::unique_ptr<Job>> done;
+  std::size_t next_to_write{};
+  bool is_input_end{};
+  std::exception_ptr write_error;
+
+  for (std::size_t i{}; i < options.thread_count * 4; ++i)
+    free_jobs.push_back(std::make_unique<Job>());
+
+  const auto work = [&]
+  {
+    std::unique_lock lock{mutex};
+    while (true) {
+      queue_cond.wait(lock, [&]{return !queue.empty() || is_input_end;});
+      if (queue.empty())
+        return;
+      auto job = std::move(queue.front());
+      queue.pop_front();
+      lock.unlock();
+      dispatch(*job);
+      lock.lock();
+
+      // Write the outputs of the completed jobs in order.
+      const auto number = job->number;
+      done.emplace(number, std::move(job));
+      for (auto i = done.find(next_to_write); i != done.end();
+           i = done.find(next_to_write)) {
+        auto& j = *i->second;
+        result.command_count += !j.is_empty;
+        result.failure_count += j.is_failed;
+        try {
+          if (!write_error) {
+            write_all(options.output_fd, j.output);
+            write_all(options.error_fd, j.error);
+          }
+        } catch (...) {
+          write_error = std::current_exception();
+        }
+        free_jobs.push_back(std::move(i->second));
+        done.erase(i);
+        ++next_to_write;
+      }
+      free_cond.notify_one();
+    }
+  };
+
+  std::vector<std::thread> workers;
+  std::exception_ptr read_error;
+  try {
+    for (std::size_t i{}; i < options.thread_count; ++i)
+      workers.emplace_back(work);
+
+    std::size_t number{};
+    std::size_t line_number{};
+    while (!is_stopped()) {
+      const auto line = reader.next();
+      if (!line)
+        break;
+      ++line_number;
+
+      std::unique_lock lock{mutex};
+      free_cond.wait(lock, [&]{return !free_jobs.empty();});
+      if (write_error)
+        break;
+      auto job = std::move(free_jobs.back());
+      free_jobs.pop_back();
+      lock.unlock();
+
+      job->line.assign(*line);
+      job->number = number++;
+      job->line_number = line_number;
+
+      lock.lock();
+      queue.push_back(std::move(job));
+      lock.unlock();
+      queue_cond.notify_one();
+    }
+  } catch (...) {
+    read_error = std::current_exception();
+  }
+
+  {
+    const std::lock_guard lock{mutex};
+    is_input_end = true;
+  }
+  queue_cond.notify_all();
+  for (auto& worker : workers)
+    worker.join();
+
+  if (read_error)
+    std::rethrow_exception(read_error);
+  else if (write_error)
+    std::rethrow_exception(write_error);
+  return result;
+}
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_BATCH_HPP
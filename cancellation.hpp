@@ -0,0 +1,224 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_CANCELLATION_HPP
+#define DMITIGR_PRG_CANCELLATION_HPP
+
+#include "../base/noncopymove.hpp"
+#include "info.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace dmitigr::prg {
+
+/**
+ * @brief The scope of cancellation.
+ *
+ * @details The scopes form a tree rooted at the stop signal (normally of the
+ * process-wide Info instance). A scope is cancelled when:
+ *   - it's cancelled explicitly by cancel();
+ *   - its parent is cancelled;
+ *   - the stop signal of the root is set.
+ *
+ * Thus a subsystem can be cancelled without stopping the whole program, and
+ * restarted with a new scope.
+ *
+ * is_cancelled() costs two relaxed loads regardless of the depth of the
+ * scope, since the cancellation is propagated to the descendants eagerly
+ * and each scope caches the pointer to the stop signal of the root.
+ *
+ * The callbacks are called on the cancellation of the scope (by the thread
+ * which called cancel()). Since the stop signal is normally set by a signal
+ * handler, which cannot call the callbacks, the callbacks are called on the
+ * stop signal only by cancel_if_stopped(), which is intended to be called on
+ * the root by the main loop.
+ *
+ * @par Thread safety
+ * All the members are thread-safe. A scope must outlive the calls of its
+ * members, but may be destroyed before or after its descendants.
+ */
+class Cancellation_scope final : Noncopymove {
+public:
+  /// The alias of the callback.
+  using Callback = std::function<void()>;
+
+  /// The alias of the identifier of callback.
+  using Id = std::uint64_t;
+
+  /// The destructor. Detaches the scope from the tree.
+  ~Cancellation_scope()
+  {
+    const std::lock_guard lock{*mutex_};
+    if (parent_)
+      std::erase(parent_->children_, this);
+    for (auto* const child : children_)
+      child->parent_ = nullptr;
+  }
+
+  /**
+   * @brief Constructs the root scope of the stop signal of the process-wide
+   * Info instance.
+   *
+   * @par Requires
+   * `Info::is_process_initialized()`.
+   */
+  Cancellation_scope()
+    : Cancellation_scope{Info::process_instance().stop_signal}
+  {}
+
+  /// Constructs the root scope of the `stop_signal`.
+  explicit Cancellation_scope(const std::atomic_int& stop_signal)
+    : stop_signal_{&stop_signal}
+    , mutex_{std::make_shared<std::mutex>()}
+  {}
+
+  /// Constructs the child scope of the `parent`.
+  explicit Cancellation_scope(Cancellation_scope& parent)
+    : stop_signal_{parent.stop_signal_}
+    , mutex_{parent.mutex_}
+  {
+    const std::lock_guard lock{*mutex_};
+    parent.children_.push_back(this);
+    parent_ = &parent;
+    is_cancelled_.store(parent.is_cancelled_.load(std::memory_order_relaxed),
+      std::memory_order_relaxed);
+  }
+
+  /// @returns `true` if the scope is cancelled, or the stop signal is set.
+  bool is_cancelled() const noexcept
+  {
+    return is_cancelled_.load(std::memory_order_relaxed) ||
+      stop_signal_->load(std::memory_order_relaxed);
+  }
+
+  /// @returns The stop signal of the root.
+  int stop_signal() const noexcept
+  {
+    return stop_signal_->load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Cancels the scope and its descendants, and calls their callbacks.
+   * Has no effect if the scope is already cancelled.
+   *
+   * @details If some callbacks throw, the rest are called anyway, and the
+   * first exception is rethrown.
+   */
+  void cancel()
+  {
+    std::vector<Callback> callbacks;
+    {
+      const std::lock_guard lock{*mutex_};
+      cancel(callbacks);
+    }
+    call(callbacks);
+  }
+
+  /**
+   * @brief Calls cancel() if the stop signal is set.
+   *
+   * @returns `true` if the stop signal is set.
+   */
+  bool cancel_if_stopped()
+  {
+    if (!stop_signal())
+      return false;
+    cancel();
+    return true;
+  }
+
+  /**
+   * @brief Adds the `callback` to call on cancellation. If the scope is
+   * already cancelled (explicitly or via ancestor), calls the `callback`
+   * immediately.
+   *
+   * @returns The identifier of the callback.
+   */
+  Id add_callback(Callback callback)
+  {
+    if (!callback)
+      throw std::invalid_argument{"invalid callback of cancellation scope"};
+    Id result{};
+    {
+      const std::lock_guard lock{*mutex_};
+      result = ++last_id_;
+      if (!is_cancelled_.load(std::memory_order_relaxed)) {
+        callbacks_.emplace_back(result, std::move(callback));
+        return result;
+      }
+    }
+    callback();
+    return result;
+  }
+
+  /**
+   * @brief Removes the callback by `id`. Has no effect if the callback is
+   * already called or removed.
+   */
+  void remove_callback(const Id id)
+  {
+    const std::lock_guard lock{*mutex_};
+    std::erase_if(callbacks_, [id](const auto& c){return c.first == id;});
+  }
+
+private:
+  const std::atomic_int* stop_signal_{};
+  std::shared_ptr<std::mutex> mutex_; // guards the tree
+  std::atomic_bool is_cancelled_{};
+  Cancellation_scope* parent_{};
+  std::vector<Cancellation_scope*> children_;
+  std::vector<std::pair<Id, Callback>> callbacks_;
+  Id last_id_{};
+
+  void cancel(std::vector<Callback>& callbacks)
+  {
+    if (is_cancelled_.exchange(true, std::memory_order_relaxed))
+      return;
+    for (auto& [id, callback] : callbacks_)
+      callbacks.push_back(std::move(callback));
+    callbacks_.clear();
+    for (auto* const child : children_)
+      child->cancel(callbacks);
+  }
+
+  static void call(std::vector<Callback>& callbacks)
+  {
+    std::exception_ptr error;
+    for (auto& callback : callbacks) {
+      try {
+        callback();
+      } catch (...) {
+        if (!error)
+          error = std::current_exception();
+      }
+    }
+    if (error)
+      std::rethrow_exception(error);
+  }
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_CANCELLATION_HPP
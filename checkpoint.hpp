@@ -0,0 +1,159 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_CHECKPOINT_HPP
+#define DMITIGR_PRG_CHECKPOINT_HPP
+
+#include "info.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+
+namespace dmitigr::prg {
+
+/**
+ * @brief The amortized check of the stop signal for tight loops.
+ *
+ * @details Instead of loading the stop signal on each iteration, the
+ * checkpoint only decrements the countdown, and loads the stop signal when
+ * the countdown reaches zero. The period of checks is either:
+ *   - fixed (the number of calls between checks); or
+ *   - adaptive to the specified interval: the period is doubled or halved on
+ *   each check depending on the time elapsed since the previous check, so the
+ *   checks happen about every interval regardless of the cost of iteration
+ *   and the clock is read only on checks.
+ *
+ * Once the stop signal is noticed, every call of is_stopped() returns `true`.
+ *
+ * @par Thread safety
+ * Not thread-safe. (Each loop should use its own instance.)
+ *
+ * @remarks The worst-case latency of noticing the stop signal is the period
+ * times the cost of iteration. With the adaptive period it's about twice the
+ * interval, unless the cost of iteration changes abruptly.
+ */
+class Checkpoint final {
+public:
+  /// The maximum period.
+  static constexpr std::uint32_t max_period{1u << 24};
+
+  /**
+   * @brief Constructs the checkpoint of the stop signal of the process-wide
+   * Info instance with the fixed `period`.
+   *
+   * @par Requires
+   * `Info::is_process_initialized()`.
+   */
+  explicit Checkpoint(const std::uint32_t period = 1024)
+    : Checkpoint{period, Info::process_instance().stop_signal}
+  {}
+
+  /// Constructs the checkpoint of the `stop_signal` with the fixed `period`.
+  Checkpoint(const std::uint32_t period, const std::atomic_int& stop_signal)
+    : stop_signal_{&stop_signal}
+    , period_{period}
+    , countdown_{period}
+  {
+    if (!period || period > max_period)
+      throw std::invalid_argument{"invalid period of checkpoint"};
+  }
+
+  /**
+   * @brief Constructs the checkpoint of the stop signal of the process-wide
+   * Info instance with the period adaptive to the `interval`.
+   *
+   * @par Requires
+   * `Info::is_process_initialized()`.
+   */
+  explicit Checkpoint(const std::chrono::nanoseconds interval)
+    : Checkpoint{interval, Info::process_instance().stop_signal}
+  {}
+
+  /**
+   * @brief Constructs the checkpoint of the `stop_signal` with the period
+   * adaptive to the `interval`.
+   */
+  Checkpoint(const std::chrono::nanoseconds interval,
+    const std::atomic_int& stop_signal)
+    : stop_signal_{&stop_signal}
+    , interval_{interval}
+    , last_check_{Clock::now()}
+  {
+    if (interval <= std::chrono::nanoseconds::zero())
+      throw std::invalid_argument{"invalid interval of checkpoint"};
+  }
+
+  /**
+   * @returns `true` if the stop signal is noticed.
+   *
+   * @remarks Intended to be called on each iteration.
+   */
+  bool is_stopped() noexcept
+  {
+    if (--countdown_) [[likely]]
+      return false;
+    return check();
+  }
+
+  /// @returns The current period of checks.
+  std::uint32_t period() const noexcept
+  {
+    return period_;
+  }
+
+  /// @returns The stop signal noticed, or `0` if not noticed yet.
+  int stop_signal() const noexcept
+  {
+    return stop_signal_value_;
+  }
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  const std::atomic_int* stop_signal_{};
+  std::uint32_t period_{1};
+  std::uint32_t countdown_{1};
+  int stop_signal_value_{};
+  std::chrono::nanoseconds interval_{};
+  Clock::time_point last_check_;
+
+  bool check() noexcept
+  {
+    stop_signal_value_ = stop_signal_->load(std::memory_order_relaxed);
+    if (stop_signal_value_) {
+      countdown_ = 1;
+      return true;
+    }
+
+    if (interval_ > std::chrono::nanoseconds::zero()) {
+      const auto now = Clock::now();
+      const auto elapsed = now - last_check_;
+      last_check_ = now;
+      if (elapsed < interval_ / 2 && period_ < max_period)
+        period_ *= 2;
+      else if (elapsed > interval_ && period_ > 1)
+        period_ /= 2;
+    }
+    countdown_ = period_;
+    return false;
+  }
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_CHECKPOINT_HPP
@@ -25,9 +25,31 @@ dmitigr_libs_set_library_info(prg 0 0 0 "Program stuff")
 # ------------------------------------------------------------------------------
 
 set(dmitigr_prg_headers
+  affinity.hpp
+  batch.hpp
+  cancellation.hpp
+  checkpoint.hpp
   command.hpp
+  daemon.hpp
+  deadline.hpp
+  executor.hpp
+  exit.hpp
+  handoff.hpp
+  identity.hpp
   info.hpp
+  log.hpp
+  memory.hpp
+  metrics.hpp
+  multicall.hpp
+  profiler.hpp
+  recorder.hpp
+  resources.hpp
+  startup.hpp
+  static_info.hpp
+  supervisor.hpp
+  tokenizer.hpp
   util.hpp
+  zygote.hpp
   )
 
 # ------------------------------------------------------------------------------
@@ -41,5 +63,10 @@ set(dmitigr_libs_prg_deps base)
 # ------------------------------------------------------------------------------
 
 if(DMITIGR_LIBS_TESTS)
-  set(dmitigr_prg_tests command info)
+  set(dmitigr_prg_tests affinity cancellation checkpoint command coroutine
+    executor exit info multicall resources static_info tokenizer)
+  if(UNIX)
+    list(APPEND dmitigr_prg_tests batch daemon deadline handoff log memory
+      metrics profiler recorder supervisor zygote)
+  endif()
 endif()
@@ -0,0 +1,387 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_DAEMON_HPP
+#define DMITIGR_PRG_DAEMON_HPP
+
+#ifdef _WIN32
+#error dmitigr/prg/daemon.hpp is not usable on Windows!
+#endif
+
+#include "../base/assert.hpp"
+#include "../base/fsx.hpp"
+#include "../base/noncopymove.hpp"
+#include "info.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace dmitigr::prg {
+
+/**
+ * @brief A PID file locked by `flock()`.
+ *
+ * @details The lock is held as long as the instance (or a process forked
+ * after its creation) is alive, so the stale files left after crashes are
+ * harmless. The file is removed by the destructor.
+ *
+ * Since the file is removed by the owner, the file locked by the constructor
+ * is checked to be still the one at the path (otherwise, two processes could
+ * hold the locks of the different files).
+ */
+class Pidfile final : Noncopymove {
+public:
+  /// The destructor.
+  ~Pidfile()
+  {
+    if (fd_ >= 0) {
+      if (owner_ == getpid() && is_at_path())
+        unlink(path_.c_str());
+      close(fd_);
+    }
+  }
+
+  /**
+   * @brief The constructor. Creates and locks the file at `path`, and writes
+   * the PID of the calling process into it.
+   *
+   * @throws `std::runtime_error` if the file is locked by another process.
+   */
+  explicit Pidfile(std::filesystem::path path)
+    : path_{std::move(path)}
+  {
+    while (true) {
+      fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+      if (fd_ < 0)
+        throw std::system_error{errno, std::system_category(),
+          std::string{"cannot open PID file "}.append(path_.string())};
+
+      if (flock(fd_, LOCK_EX | LOCK_NB)) {
+        const int err{errno};
+        std::string pid(32, '\0');
+        const auto size = pread(fd_, pid.data(), pid.size(), 0);
+        pid.resize(size > 0 ? static_cast<std::size_t>(size) : 0);
+        while (!pid.empty() && (pid.back() == '\n' || pid.back() == '\0'))
+          pid.pop_back();
+        close(fd_);
+        fd_ = -1;
+        if (err == EWOULDBLOCK)
+          throw std::runtime_error{std::string{"PID file "}
+            .append(path_.string()).append(" is locked by process ")
+            .append(pid.empty() ? "?" : pid)};
+        throw std::system_error{err, std::system_category(),
+          std::string{"cannot lock PID file "}.append(path_.string())};
+      }
+
+      // Retry if the file was removed by the previous owner after open().
+      if (is_at_path())
+        break;
+      close(fd_);
+      fd_ = -1;
+    }
+
+    try {
+      update();
+    } catch (...) {
+      close(fd_);
+      fd_ = -1;
+      throw;
+    }
+  }
+
+  /**
+   * @brief Writes the PID of the calling process into the file.
+   *
+   * @details Should be called after the fork to make the child an owner.
+   */
+  void update()
+  {
+    const auto pid = std::to_string(getpid()).append("\n");
+    if (ftruncate(fd_, 0) ||
+      pwrite(fd_, pid.data(), pid.size(), 0) != static_cast<ssize_t>(pid.size()))
+      throw std::system_error{errno, std::system_category(),
+        std::string{"cannot write PID file "}.append(path_.string())};
+    owner_ = getpid();
+  }
+
+  /// @returns The path to the file.
+  const std::filesystem::path& path() const noexcept
+  {
+    return path_;
+  }
+
+  /// @returns The file descriptor.
+  int fd() const noexcept
+  {
+    return fd_;
+  }
+
+private:
+  std::filesystem::path path_;
+  int fd_{-1};
+  pid_t owner_{-1};
+
+  /// @returns `true` if the opened file is the one at the path.
+  bool is_at_path() const noexcept
+  {
+    struct stat opened{};
+    struct stat existing{};
+    return !fstat(fd_, &opened) && !stat(path_.c_str(), &existing) &&
+      opened.st_dev == existing.st_dev && opened.st_ino == existing.st_ino;
+  }
+};
+
+// =============================================================================
+
+/// The options of daemonize().
+struct Daemonize_options final {
+  /// Fork twice to guarantee that the daemon can't acquire a terminal.
+  bool is_double_fork{true};
+
+  /// Change the working directory to the root directory.
+  bool is_chdir_root{true};
+
+  /**
+   * The file mode creation mask to set, or `nullopt` to keep the inherited
+   * one. (The default denies writing by the group and any access by others.)
+   */
+  std::optional<mode_t> umask{027};
+
+  /// The descriptors to keep open in addition to the standard ones.
+  std::vector<int> keep_fds;
+};
+
+/**
+ * @brief Detaches the calling process from the controlling terminal and
+ * runs it in the background.
+ *
+ * @details The parent processes exit with `EXIT_SUCCESS` by using `_exit()`,
+ * so no destructors or exit handlers are called in them. In the daemon:
+ *   - a new session is created;
+ *   - the signal mask is reset, and the signal dispositions are reset
+ *   except the ones of the handlers installed by this library (see
+ *   Signal_handlers), such as the handlers of Flight_recorder,
+ *   Sampling_profiler, Deadline and set_signals();
+ *   - the descriptors are closed, except the standard ones which are
+ *   redirected to `/dev/null`, and `options.keep_fds`.
+ *
+ * @par Requires
+ * No threads must be created yet.
+ *
+ * @remarks The timers and threads are not inherited by the daemon, so the
+ * facilities which use them must be started after this call (e.g. the
+ * thread of `Sampling_profiler::set_toggle_signal()`). The exception is the
+ * memory guard of the process-wide Info instance, which is suspended for the
+ * time of this call and resumed in the daemon, and its deadline, which is
+ * rearmed in the daemon. (See `Info::fork_process()`.)
+ */
+inline void daemonize(const Daemonize_options& options = {})
+{
+  static const auto fork_and_exit_parent = []
+  {
+    const pid_t pid{Info::fork_process()};
+    if (pid < 0)
+      throw std::system_error{errno, std::system_category(), "cannot fork"};
+    else if (pid > 0)
+      _exit(EXIT_SUCCESS);
+  };
+
+  // Suspend the memory guard, since it uses the descriptors closed below.
+  struct Guard final {
+    Memory_guard* const memory_guard{Info::is_process_initialized() ?
+      Info::process_instance().memory_guard() : nullptr};
+    Guard()
+    {
+      if (memory_guard)
+        memory_guard->suspend();
+    }
+    ~Guard()
+    {
+      if (memory_guard) {
+        try {
+          memory_guard->resume();
+        } catch (...) {}
+      }
+    }
+  } const guard;
+
+  fork_and_exit_parent();
+  if (setsid() < 0)
+    throw std::system_error{errno, std::system_category(),
+      "cannot create session"};
+  if (options.is_double_fork)
+    fork_and_exit_parent();
+
+  // Reset signals.
+  sigset_t set;
+  sigemptyset(&set);
+  sigprocmask(SIG_SETMASK, &set, nullptr);
+  for (int sig{1}; sig < NSIG; ++sig) {
+    if (!Signal_handlers::contains(sig))
+      std::signal(sig, SIG_DFL);
+  }
+
+  if (options.umask)
+    ::umask(*options.umask);
+  if (options.is_chdir_root && chdir("/"))
+    throw std::system_error{errno, std::system_category(),
+      "cannot change directory to /"};
+
+  // Redirect the standard descriptors.
+  const int null{open("/dev/null", O_RDWR)};
+  if (null < 0)
+    throw std::system_error{errno, std::system_category(),
+      "cannot open /dev/null"};
+  for (int fd{}; fd < 3; ++fd) {
+    if (null != fd && dup2(null, fd) < 0)
+      throw std::system_error{errno, std::system_category(),
+        "cannot redirect standard descriptor"};
+  }
+  if (null > 2)
+    close(null);
+
+  // Close the rest of descriptors.
+  const auto is_kept = [&options](const int fd)
+  {
+    return fd < 3 || std::find(cbegin(options.keep_fds),
+      cend(options.keep_fds), fd) != cend(options.keep_fds);
+  };
+  std::vector<int> fds;
+  if (DIR* const dir = opendir("/proc/self/fd")) {
+    const int dir_fd{dirfd(dir)};
+    while (const dirent* const entry = readdir(dir)) {
+      if (entry->d_name[0] == '.')
+        continue;
+      const int fd{std::atoi(entry->d_name)};
+      if (fd != dir_fd && !is_kept(fd))
+        fds.push_back(fd);
+    }
+    closedir(dir);
+  } else {
+    const long max{sysconf(_SC_OPEN_MAX)};
+    for (int fd{3}; fd < (max > 0 ? max : 1024); ++fd) {
+      if (!is_kept(fd))
+        fds.push_back(fd);
+    }
+  }
+  for (const int fd : fds)
+    close(fd);
+}
+
+/**
+ * @brief Calls `daemonize(options)` keeping the descriptor of `pidfile` open
+ * and writes the PID of the daemon into it.
+ */
+inline void daemonize(Pidfile& pidfile, Daemonize_options options = {})
+{
+  options.keep_fds.push_back(pidfile.fd());
+  daemonize(options);
+  pidfile.update();
+}
+
+// =============================================================================
+
+/**
+ * @brief Sends the `state` to the service manager over the socket specified
+ * by the `NOTIFY_SOCKET` environment variable.
+ *
+ * @details The `state` is a newline separated list of assignments, like
+ * `READY=1` or `STATUS=text`, as defined by the protocol of `sd_notify()`.
+ *
+ * @returns `false` if `NOTIFY_SOCKET` is not set.
+ */
+inline bool notify(const std::string_view state)
+{
+  const char* const path{std::getenv("NOTIFY_SOCKET")};
+  if (!path || !*path)
+    return false;
+
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  const std::size_t path_size{std::strlen(path)};
+  if ((path[0] != '/' && path[0] != '@') || path_size >= sizeof(addr.sun_path))
+    throw std::runtime_error{std::string{"invalid NOTIFY_SOCKET "}.append(path)};
+  std::memcpy(addr.sun_path, path, path_size);
+  if (addr.sun_path[0] == '@')
+    addr.sun_path[0] = '\0'; // abstract namespace
+  const auto addr_size = static_cast<socklen_t>(
+    offsetof(sockaddr_un, sun_path) + path_size);
+
+  const int fd{socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0)};
+  if (fd < 0)
+    throw std::system_error{errno, std::system_category(),
+      "cannot create notification socket"};
+  const auto sent = sendto(fd, state.data(), state.size(), MSG_NOSIGNAL,
+    reinterpret_cast<const sockaddr*>(&addr), addr_size);
+  const int err{errno};
+  close(fd);
+  if (sent < 0)
+    throw std::system_error{err, std::system_category(),
+      std::string{"cannot send notification to "}.append(path)};
+  return true;
+}
+
+/// @returns `notify("READY=1")`.
+inline bool notify_ready()
+{
+  return notify("READY=1");
+}
+
+/// @returns `notify("RELOADING=1")`.
+inline bool notify_reloading()
+{
+  return notify("RELOADING=1");
+}
+
+/// @returns `notify("STOPPING=1")`.
+inline bool notify_stopping()
+{
+  return notify("STOPPING=1");
+}
+
+/// @returns `notify("WATCHDOG=1")`.
+inline bool notify_watchdog()
+{
+  return notify("WATCHDOG=1");
+}
+
+/// @returns `notify("STATUS=" + status)`.
+inline bool notify_status(const std::string_view status)
+{
+  return notify(std::string{"STATUS="}.append(status));
+}
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_DAEMON_HPP
@@ -0,0 +1,378 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_DEADLINE_HPP
+#define DMITIGR_PRG_DEADLINE_HPP
+
+#ifdef _WIN32
+#error dmitigr/prg/deadline.hpp is not usable on Windows!
+#endif
+
+#include "../base/noncopymove.hpp"
+#include "command.hpp"
+#include "recorder.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <ctime>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include <unistd.h>
+
+namespace dmitigr::prg {
+
+namespace detail {
+
+/**
+ * @returns The duration parsed from `str` in the format `n[ms|s|m|h]` (the
+ * seconds by default).
+ */
+inline std::chrono::nanoseconds to_duration(const std::string_view str)
+{
+  std::uint64_t count{};
+  const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(),
+    count);
+  const std::string_view suffix{ptr, static_cast<std::size_t>(
+      str.data() + str.size() - ptr)};
+  const auto throw_invalid = [str]
+  {
+    throw std::invalid_argument{std::string{"invalid duration \""}
+      .append(str).append("\"")};
+  };
+  if (ec != std::errc{})
+    throw_invalid();
+
+  std::uint64_t unit{};
+  if (suffix.empty() || suffix == "s")
+    unit = 1'000'000'000;
+  else if (suffix == "ms")
+    unit = 1'000'000;
+  else if (suffix == "m")
+    unit = 60'000'000'000;
+  else if (suffix == "h")
+    unit = 3'600'000'000'000;
+  else
+    throw_invalid();
+  if (count > static_cast<std::uint64_t>(
+      std::chrono::nanoseconds::max().count()) / unit)
+    throw_invalid();
+  return std::chrono::nanoseconds(count * unit);
+}
+
+} // namespace detail
+
+/**
+ * @brief The wall-clock budget of the program.
+ *
+ * @details The deadlines are enforced by the POSIX timers (`CLOCK_MONOTONIC`)
+ * which deliver `SIGALRM` when expired, so no thread is used. When the:
+ *   - soft deadline expires, the stop signal is set to `SIGALRM` (which is
+ *   distinct from the signals of the termination requests), so the program
+ *   can shut down in order and tell the reason;
+ *   - hard deadline expires, the flight recorder is dumped (see
+ *   Flight_recorder) and the process is terminated immediately by `_exit()`
+ *   with hard_exit_code (the same as `timeout(1)` uses).
+ *
+ * The deadlines are relative to the construction of the instance. Only one
+ * instance can exist at a time.
+ *
+ * The `SIGALRM` which is not from the timers of the deadline (e.g. by
+ * `alarm()` or `setitimer()`) is passed to the handler which was set before
+ * the construction. If it was `SIG_DFL`, the default action (termination)
+ * is performed by re-raising the signal with `SIG_DFL` restored. (The
+ * previous handler is recorded only on the construction, so rearm() doesn't
+ * replace it with the one set later.)
+ *
+ * @remarks The POSIX timers are not inherited by fork(), so the child has to
+ * call rearm() to keep the deadlines. (`Info::fork_process()` does it for
+ * the deadline of the process-wide instance.)
+ *
+ * The options of the deadline are parsed by Deadline::Options::make().
+ */
+class Deadline final : Noncopymove {
+public:
+  /// The exit code on the hard deadline.
+  static constexpr int hard_exit_code{124};
+
+  /// The options of Deadline.
+  struct Options final {
+    /// The soft deadline.
+    std::optional<std::chrono::nanoseconds> soft;
+
+    /// The hard deadline.
+    std::optional<std::chrono::nanoseconds> hard;
+
+    /// @returns `true` if any deadline is specified.
+    bool is_enabled() const noexcept
+    {
+      return soft || hard;
+    }
+
+    /// The names of the standard options.
+    static constexpr std::string_view option_names[]{"timeout",
+      "hard-timeout"};
+
+    /**
+     * @returns The options parsed from the `command`.
+     *
+     * @details Corresponds to the following options:
+     *   - `--timeout=n[ms|s|m|h]` - the soft deadline;
+     *   - `--hard-timeout=n[ms|s|m|h]` - the hard deadline.
+     */
+    static Options make(const Command& command)
+    {
+      static const auto to_timeout = [](const Command::Optref& opt)
+      {
+        const auto result = detail::to_duration(opt.value_not_empty());
+        if (result <= std::chrono::nanoseconds::zero())
+          throw std::invalid_argument{std::string{"invalid value of option --"}
+            .append(opt.name())};
+        return result;
+      };
+
+      Options result;
+      const auto [soft, hard] = command.options("timeout", "hard-timeout");
+      if (soft.is_valid_throw_if_no_value())
+        result.soft = to_timeout(soft);
+      if (hard.is_valid_throw_if_no_value())
+        result.hard = to_timeout(hard);
+      return result;
+    }
+  };
+
+  /// The destructor. Disarms the timers.
+  ~Deadline()
+  {
+    disarm();
+  }
+
+  /**
+   * @brief The constructor. Arms the timers.
+   *
+   * @param stop_signal The stop signal to set to `SIGALRM` on the soft
+   * deadline.
+   *
+   * @par Requires
+   * `options.is_enabled()`, and the hard deadline is later than the soft one.
+   */
+  Deadline(Options options, std::atomic_int& stop_signal)
+    : options_{std::move(options)}
+  {
+    if (!options_.is_enabled())
+      throw std::invalid_argument{"no deadline specified"};
+    else if (options_.soft && options_.hard && *options_.hard <= *options_.soft)
+      throw std::invalid_argument{"hard deadline is not later than soft one"};
+    else if (instance_.exchange(true))
+      throw std::logic_error{"deadline is already set"};
+
+    stop_signal_ = &stop_signal;
+    is_expired_ = false;
+    try {
+      const auto now = monotonic_now();
+      if (options_.soft)
+        soft_expiry_ = now + *options_.soft;
+      if (options_.hard)
+        hard_expiry_ = now + *options_.hard;
+      rearm();
+    } catch (...) {
+      disarm();
+      throw;
+    }
+  }
+
+  /**
+   * @brief Recreates the timers with the original expiration times, and
+   * reinstalls the handler of `SIGALRM` if it's replaced.
+   *
+   * @details Intended to be called in the child after fork(), since the POSIX
+   * timers are not inherited, or after the reset of the signal dispositions.
+   * The expired timers fire immediately.
+   */
+  void rearm()
+  {
+    // The timers of the parent are not valid in the child.
+    const auto pid = getpid();
+    for (auto* const timer : {&soft_timer_, &hard_timer_}) {
+      if (*timer) {
+        if (timers_pid_ == pid)
+          timer_delete(**timer);
+        timer->reset();
+      }
+    }
+
+    struct sigaction current{};
+    if (sigaction(SIGALRM, nullptr, &current))
+      throw std::system_error{errno, std::system_category(),
+        "cannot get handler of SIGALRM"};
+    if (!(current.sa_flags & SA_SIGINFO) ||
+      current.sa_sigaction != &handle_alarm) {
+      struct sigaction sa{};
+      sa.sa_sigaction = &handle_alarm;
+      sa.sa_flags = SA_SIGINFO | SA_RESTART;
+      sigemptyset(&sa.sa_mask);
+      if (!is_handler_set_)
+        old_action_ = current;
+      if (sigaction(SIGALRM, &sa, nullptr))
+        throw std::system_error{errno, std::system_category(),
+          "cannot set handler of SIGALRM"};
+      Signal_handlers::add(SIGALRM);
+      is_handler_set_ = true;
+    }
+
+    timers_pid_ = pid;
+    if (soft_expiry_ && !is_expired_)
+      soft_timer_ = arm(*soft_expiry_, &soft_tag_);
+    if (hard_expiry_)
+      hard_timer_ = arm(*hard_expiry_, &hard_tag_);
+  }
+
+  /// @returns The options.
+  const Options& options() const noexcept
+  {
+    return options_;
+  }
+
+  /// @returns `true` if the soft deadline is expired.
+  bool is_expired() const noexcept
+  {
+    return is_expired_;
+  }
+
+  /**
+   * @returns The time remaining until the soft deadline, or until the hard
+   * one if the soft one is not specified.
+   */
+  std::chrono::nanoseconds remaining() const
+  {
+    const auto result = (soft_expiry_ ? *soft_expiry_ : *hard_expiry_) -
+      monotonic_now();
+    return std::max(result, std::chrono::nanoseconds::zero());
+  }
+
+private:
+  inline static char soft_tag_; // the address identifies the soft timer
+  inline static char hard_tag_; // the address identifies the hard timer
+  inline static std::atomic_bool instance_;
+  inline static std::atomic_int* volatile stop_signal_{};
+  inline static volatile std::sig_atomic_t is_expired_{};
+  inline static struct sigaction old_action_{};
+
+  Options options_;
+  std::optional<std::chrono::nanoseconds> soft_expiry_; // CLOCK_MONOTONIC
+  std::optional<std::chrono::nanoseconds> hard_expiry_; // CLOCK_MONOTONIC
+  std::optional<timer_t> soft_timer_;
+  std::optional<timer_t> hard_timer_;
+  pid_t timers_pid_{};
+  bool is_handler_set_{}; // old_action_ is recorded
+
+  /// @returns The current time of `CLOCK_MONOTONIC`.
+  static std::chrono::nanoseconds monotonic_now() noexcept
+  {
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return std::chrono::seconds{now.tv_sec} +
+      std::chrono::nanoseconds{now.tv_nsec};
+  }
+
+  void disarm() noexcept
+  {
+    for (auto* const timer : {&soft_timer_, &hard_timer_}) {
+      if (*timer) {
+        if (timers_pid_ == getpid())
+          timer_delete(**timer);
+        timer->reset();
+      }
+    }
+    if (is_handler_set_) {
+      sigaction(SIGALRM, &old_action_, nullptr);
+      Signal_handlers::remove(SIGALRM);
+      is_handler_set_ = false;
+    }
+    stop_signal_ = nullptr;
+    instance_.store(false);
+  }
+
+  /**
+   * @returns The timer which expires at `expiry` of `CLOCK_MONOTONIC` and
+   * delivers `tag` with the signal.
+   */
+  static timer_t arm(const std::chrono::nanoseconds expiry, char* const tag)
+  {
+    sigevent event{};
+    event.sigev_notify = SIGEV_SIGNAL;
+    event.sigev_signo = SIGALRM;
+    event.sigev_value.sival_ptr = tag;
+    timer_t result{};
+    if (timer_create(CLOCK_MONOTONIC, &event, &result))
+      throw std::system_error{errno, std::system_category(),
+        "cannot create timer of deadline"};
+
+    const auto secs = std::chrono::floor<std::chrono::seconds>(expiry);
+    itimerspec spec{};
+    spec.it_value.tv_sec = static_cast<std::time_t>(secs.count());
+    spec.it_value.tv_nsec = static_cast<long>((expiry - secs).count());
+    if (timer_settime(result, TIMER_ABSTIME, &spec, nullptr)) {
+      const int err{errno};
+      timer_delete(result);
+      throw std::system_error{err, std::system_category(),
+        "cannot arm timer of deadline"};
+    }
+    return result;
+  }
+
+  static void handle_alarm(const int sig, siginfo_t* const info,
+    void* const context) noexcept
+  {
+    const void* const tag{info->si_code == SI_TIMER ?
+      info->si_value.sival_ptr : nullptr};
+    if (tag == &hard_tag_) {
+      Flight_recorder::dump(SIGALRM);
+      _exit(hard_exit_code);
+    } else if (tag == &soft_tag_) {
+      is_expired_ = true;
+      if (const auto stop_signal = stop_signal_)
+        stop_signal->store(SIGALRM);
+    } else if (old_action_.sa_flags & SA_SIGINFO) {
+      if (old_action_.sa_sigaction)
+        old_action_.sa_sigaction(sig, info, context);
+    } else if (old_action_.sa_handler == SIG_DFL) {
+      // Perform the default action. (The signal is blocked in the handler.)
+      struct sigaction current{};
+      sigaction(SIGALRM, &old_action_, &current);
+      raise(SIGALRM);
+      sigset_t set;
+      sigemptyset(&set);
+      sigaddset(&set, SIGALRM);
+      pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
+      sigaction(SIGALRM, &current, nullptr); // if the process survived
+    } else if (old_action_.sa_handler != SIG_IGN) {
+      old_action_.sa_handler(sig);
+    }
+  }
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_DEADLINE_HPP
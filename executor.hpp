@@ -0,0 +1,377 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_EXECUTOR_HPP
+#define DMITIGR_PRG_EXECUTOR_HPP
+
+#include "../base/noncopymove.hpp"
+#include "info.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <csignal>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dmitigr::prg {
+
+/// The policy of handling the queued tasks on stop.
+enum class Stop_policy {
+  /// Execute the queued tasks.
+  drain,
+  /// Discard the queued tasks.
+  discard
+};
+
+/// The options of Executor.
+struct Executor_options final {
+  /**
+   * The number of worker threads, or `0` to use the number of CPUs of
+   * `Info::process_instance().affinity().effective_cpus()` (if
+   * `Info::is_process_initialized()`), or of the hardware otherwise.
+   */
+  std::size_t thread_count{};
+
+  /// The policy of handling the queued tasks on stop.
+  Stop_policy stop_policy{Stop_policy::drain};
+
+  /// The stop signal to set when a task fails with exception.
+  int error_stop_signal{SIGTERM};
+};
+
+/**
+ * @brief The pool of threads with work-stealing.
+ *
+ * @details Each worker has its own deque of tasks. The tasks submitted from
+ * a worker are pushed to its own deque and popped in LIFO order (for cache
+ * locality), the other tasks are pushed to the shared queue and popped in
+ * FIFO order. The idle workers steal the tasks from the fronts of deques of
+ * others.
+ *
+ * The workers are bound to the CPUs by `Affinity::apply_to_worker()` (if
+ * `Info::is_process_initialized()`).
+ *
+ * The executor stops when:
+ *   - stop() is called;
+ *   - the stop signal of the process-wide Info instance is set (the idle
+ *   workers are not polling it, but woken up by the callback registered in
+ *   Stop_waiters if `Info::is_process_initialized()` on construction, i.e.
+ *   immediately if the stop signal is set by handle_signal() or
+ *   with_signal_on_error(), or within `Stop_waiters::watch_interval()`
+ *   otherwise);
+ *   - a task fails with exception. (The task is called by
+ *   with_signal_on_error(), so the stop signal is set to initiate the orderly
+ *   shutdown of the whole program.)
+ *
+ * On stop, the queued tasks are executed or discarded according to the
+ * Stop_policy, and the new tasks are rejected.
+ *
+ * @par Thread safety
+ * All the members are thread-safe.
+ */
+class Executor final : Noncopymove {
+public:
+  /// The alias of task.
+  using Task = std::function<void()>;
+
+  /// The destructor. Calls stop() and join().
+  ~Executor()
+  {
+    if (stop_callback_id_)
+      Stop_waiters::instance().remove_callback(*stop_callback_id_);
+    stop();
+    join();
+  }
+
+  /// The constructor. Starts the workers.
+  explicit Executor(Executor_options options = {})
+    : options_{std::move(options)}
+  {
+    auto count = options_.thread_count;
+    if (!count && Info::is_process_initialized()) {
+      try {
+        count = Info::process_instance().affinity().effective_cpus().size();
+      } catch (...) {}
+    }
+    if (!count)
+      count = std::max(std::thread::hardware_concurrency(), 1u);
+
+    queues_.reserve(count);
+    for (std::size_t i{}; i < count; ++i)
+      queues_.push_back(std::make_unique<Queue>());
+    threads_.reserve(count);
+    try {
+      for (std::size_t i{}; i < count; ++i)
+        threads_.emplace_back([this, i]{work(i);});
+      if (Info::is_process_initialized())
+        stop_callback_id_ = Stop_waiters::instance().add_callback([this]
+        {
+          stop();
+        });
+    } catch (...) {
+      stop();
+      join();
+      throw;
+    }
+  }
+
+  /// @returns The number of workers.
+  std::size_t thread_count() const noexcept
+  {
+    return queues_.size();
+  }
+
+  /**
+   * @brief Submits the `task`.
+   *
+   * @returns `false` if the task is rejected since the executor is stopping.
+   */
+  bool submit(Task task)
+  {
+    if (!task)
+      throw std::invalid_argument{"invalid task of executor"};
+    else if (is_stopping())
+      return false;
+
+    // The counter is incremented first to never be decremented below zero.
+    {
+      const std::lock_guard lock{idle_mutex_};
+      ++pending_count_;
+    }
+    bool is_pushed{};
+    try {
+      auto& queue = current_ == this ? *queues_[current_index_] : injected_;
+      const std::lock_guard lock{queue.mutex};
+      /*
+       * Since stop() sets the flag before discarding the queue under its
+       * lock, the task pushed under the same lock after this check is
+       * always discarded by stop(Stop_policy::discard).
+       */
+      if (!is_stopping()) {
+        queue.tasks.push_back(std::move(task));
+        is_pushed = true;
+      }
+    } catch (...) {
+      {
+        const std::lock_guard lock{idle_mutex_};
+        --pending_count_;
+      }
+      idle_cond_.notify_all();
+      throw;
+    }
+    if (!is_pushed) {
+      {
+        const std::lock_guard lock{idle_mutex_};
+        --pending_count_;
+      }
+      idle_cond_.notify_all();
+      return false;
+    }
+    idle_cond_.notify_one();
+    return true;
+  }
+
+  /**
+   * @brief Stops the executor according to the Stop_policy. Has no effect if
+   * already stopping.
+   */
+  void stop()
+  {
+    stop(options_.stop_policy);
+  }
+
+  /// Stops the executor with the specified `policy`.
+  void stop(const Stop_policy policy)
+  {
+    {
+      const std::lock_guard lock{idle_mutex_};
+      if (is_stopping_.exchange(true))
+        return;
+    }
+    if (policy == Stop_policy::discard) {
+      const auto discard = [this](Queue& queue)
+      {
+        std::deque<Task> tasks;
+        {
+          const std::lock_guard lock{queue.mutex};
+          tasks.swap(queue.tasks);
+        }
+        const std::lock_guard lock{idle_mutex_};
+        pending_count_ -= tasks.size();
+      };
+      discard(injected_);
+      for (const auto& queue : queues_)
+        discard(*queue);
+    }
+    idle_cond_.notify_all();
+  }
+
+  /// @returns `true` if the executor is stopping.
+  bool is_stopping() const noexcept
+  {
+    return is_stopping_.load();
+  }
+
+  /**
+   * @brief Waits for the workers to finish.
+   *
+   * @par Requires
+   * Called not from a worker.
+   */
+  void join()
+  {
+    if (current_ == this)
+      throw std::logic_error{"cannot join executor from its worker"};
+    const std::lock_guard lock{join_mutex_};
+    for (auto& thread : threads_) {
+      if (thread.joinable())
+        thread.join();
+    }
+  }
+
+  /// @returns The exception of the first failed task, if any.
+  std::exception_ptr error() const
+  {
+    const std::lock_guard lock{idle_mutex_};
+    return error_;
+  }
+
+private:
+  struct Queue final {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  inline static thread_local Executor* current_{};
+  inline static thread_local std::size_t current_index_{};
+
+  Executor_options options_;
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  Queue injected_;
+  std::atomic_bool is_stopping_{};
+  mutable std::mutex idle_mutex_;
+  std::condition_variable idle_cond_;
+  std::size_t pending_count_{}; // guarded by idle_mutex_
+  std::exception_ptr error_; // guarded by idle_mutex_
+  std::mutex join_mutex_;
+  std::optional<Stop_waiters::Callback_id> stop_callback_id_;
+
+  /// @returns The task from the own queue, the shared one, or stolen.
+  Task take(const std::size_t index)
+  {
+    {
+      auto& queue = *queues_[index];
+      const std::lock_guard lock{queue.mutex};
+      if (!queue.tasks.empty()) {
+        auto result = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        return result;
+      }
+    }
+    {
+      const std::lock_guard lock{injected_.mutex};
+      if (!injected_.tasks.empty()) {
+        auto result = std::move(injected_.tasks.front());
+        injected_.tasks.pop_front();
+        return result;
+      }
+    }
+    for (std::size_t i{1}; i < queues_.size(); ++i) {
+      auto& queue = *queues_[(index + i) % queues_.size()];
+      const std::lock_guard lock{queue.mutex};
+      if (!queue.tasks.empty()) {
+        auto result = std::move(queue.tasks.front());
+        queue.tasks.pop_front();
+        return result;
+      }
+    }
+    return {};
+  }
+
+  void work(const std::size_t index)
+  {
+    current_ = this;
+    current_index_ = index;
+    if (Info::is_process_initialized()) {
+      try {
+        Info::process_instance().affinity().apply_to_worker(index);
+      } catch (...) {}
+    }
+
+    const auto is_stop_signaled = []
+    {
+      return Info::is_process_initialized() &&
+        Info::process_instance().stop_signal.load(std::memory_order_relaxed);
+    };
+
+    while (true) {
+      if (!is_stopping() && is_stop_signaled())
+        stop();
+
+      if (auto task = take(index)) {
+        {
+          const std::lock_guard lock{idle_mutex_};
+          --pending_count_;
+        }
+        run(task);
+        continue;
+      }
+
+      std::unique_lock lock{idle_mutex_};
+      if (is_stopping() && !pending_count_)
+        break;
+      idle_cond_.wait(lock, [this]{return pending_count_ || is_stopping();});
+      if (is_stopping() && !pending_count_)
+        break;
+    }
+    current_ = nullptr;
+  }
+
+  void run(Task& task) noexcept
+  {
+    try {
+      if (Info::is_process_initialized())
+        with_signal_on_error(task, options_.error_stop_signal);
+      else
+        task();
+    } catch (...) {
+      {
+        const std::lock_guard lock{idle_mutex_};
+        if (!error_)
+          error_ = std::current_exception();
+      }
+      try {
+        stop();
+      } catch (...) {}
+    }
+  }
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_EXECUTOR_HPP
@@ -0,0 +1,376 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_EXIT_HPP
+#define DMITIGR_PRG_EXIT_HPP
+
+#include "../base/noncopymove.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace dmitigr::prg {
+
+/**
+ * @brief The registry of sinks (logs, metrics, files) which must be flushed
+ * before the fast exit.
+ *
+ * @par Thread safety
+ * All the members are thread-safe.
+ *
+ * @see fast_exit().
+ */
+class Exit_sinks final : Noncopymove {
+public:
+  /// The alias of the sink identifier.
+  using Id = std::uint64_t;
+
+  /// The alias of the sink flush function.
+  using Flush = std::function<void()>;
+
+  /// @returns The process-wide instance.
+  static Exit_sinks& instance()
+  {
+    static Exit_sinks result;
+    return result;
+  }
+
+  /**
+   * @brief Registers the sink.
+   *
+   * @param name The name of the sink for the diagnostics.
+   * @param flush The function to flush the sink. Must not throw.
+   *
+   * @returns The identifier of the sink to pass to remove().
+   *
+   * @par Requires
+   * `flush`.
+   */
+  Id add(std::string name, Flush flush)
+  {
+    if (!flush)
+      throw std::invalid_argument{"invalid flush function of exit sink"};
+    const std::lock_guard lock{mutex_};
+    const auto id = ++last_id_;
+    sinks_.push_back(Sink{id, std::move(name), std::move(flush)});
+    return id;
+  }
+
+  /// Unregisters the sink `id`. Has no effect if no such a sink.
+  void remove(const Id id)
+  {
+    const std::lock_guard lock{mutex_};
+    std::erase_if(sinks_, [id](const auto& sink){return sink.id == id;});
+  }
+
+  /**
+   * @brief Flushes the registered sinks in parallel.
+   *
+   * @returns The names of sinks which are not flushed within the `timeout`.
+   *
+   * @remarks The flushes which are not completed within the `timeout` are
+   * left running in detached threads. Thus, this function is intended to be
+   * called right before the termination of the process.
+   */
+  std::vector<std::string> flush(const std::chrono::nanoseconds timeout)
+  {
+    struct State final {
+      std::mutex mutex;
+      std::condition_variable cond;
+      std::vector<Sink> sinks;
+      std::vector<bool> done;
+      std::size_t done_count{};
+    };
+
+    const auto state = std::make_shared<State>();
+    {
+      const std::lock_guard lock{mutex_};
+      state->sinks = sinks_;
+    }
+    state->done.resize(state->sinks.size());
+
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    std::size_t started{};
+    for (; started < state->sinks.size(); ++started) {
+      try {
+        std::thread{[state, started]
+        {
+          try {
+            state->sinks[started].flush();
+          } catch (...) {}
+          const std::lock_guard lock{state->mutex};
+          state->done[started] = true;
+          ++state->done_count;
+          state->cond.notify_one();
+        }}.detach();
+      } catch (...) {
+        break; // no resources to start the thread
+      }
+    }
+
+    // Flush the rest in the calling thread.
+    for (auto i = started; i < state->sinks.size(); ++i) {
+      try {
+        state->sinks[i].flush();
+      } catch (...) {}
+      const std::lock_guard lock{state->mutex};
+      state->done[i] = true;
+      ++state->done_count;
+    }
+
+    std::vector<std::string> result;
+    std::unique_lock lock{state->mutex};
+    state->cond.wait_until(lock, deadline,
+      [&state]{return state->done_count == state->sinks.size();});
+    for (std::size_t i{}; i < state->sinks.size(); ++i) {
+      if (!state->done[i])
+        result.push_back(state->sinks[i].name);
+    }
+    return result;
+  }
+
+  /**
+   * @brief Enables or disables the fast exit by exit_program().
+   *
+   * @param timeout The timeout of flushing the sinks.
+   */
+  void set_fast_exit_enabled(const bool value,
+    const std::chrono::milliseconds timeout = std::chrono::seconds{3}) noexcept
+  {
+    fast_exit_timeout_ms_.store(timeout.count(), std::memory_order_relaxed);
+    is_fast_exit_enabled_.store(value, std::memory_order_relaxed);
+  }
+
+  /// @returns `true` if the fast exit by exit_program() is enabled.
+  bool is_fast_exit_enabled() const noexcept
+  {
+    return is_fast_exit_enabled_.load(std::memory_order_relaxed);
+  }
+
+  /// @returns The timeout of flushing the sinks by exit_program().
+  std::chrono::milliseconds fast_exit_timeout() const noexcept
+  {
+    return std::chrono::milliseconds{
+      fast_exit_timeout_ms_.load(std::memory_order_relaxed)};
+  }
+
+private:
+  struct Sink final {
+    Id id{};
+    std::string name;
+    Flush flush;
+  };
+
+  mutable std::mutex mutex_;
+  Id last_id_{};
+  std::vector<Sink> sinks_;
+  std::atomic_bool is_fast_exit_enabled_{};
+  std::atomic<std::chrono::milliseconds::rep> fast_exit_timeout_ms_{3000};
+
+  Exit_sinks() = default;
+};
+
+/**
+ * @brief The registry of sinks (logs) which are flushed by the signal
+ * handlers, i.e. on the fatal paths where the process may terminate without
+ * reaching `exit()` (see handle_signal() and
+ * `Flight_recorder::install_fatal_handlers()`).
+ *
+ * @details The registry has `max_count` fixed slots, so registering doesn't
+ * allocate memory.
+ *
+ * @par Thread safety
+ * All the members are thread-safe and async-signal-safe. (But see remove().)
+ */
+class Signal_sinks final {
+public:
+  /// The maximum number of registered sinks.
+  static constexpr std::size_t max_count{64};
+
+  /// The alias of the async-signal-safe function to flush the sink `data`.
+  using Flush = void(*)(void* data) noexcept;
+
+  /**
+   * @brief Registers the sink `data`.
+   *
+   * @returns `false` if there are no free slots.
+   *
+   * @par Requires
+   * `flush && data`.
+   */
+  static bool add(const Flush flush, void* const data) noexcept
+  {
+    if (!flush || !data)
+      return false;
+    for (auto& slot : slots_) {
+      void* expected{};
+      if (slot.data.compare_exchange_strong(expected, data,
+          std::memory_order_acq_rel)) {
+        slot.flush.store(flush, std::memory_order_release);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**
+   * @brief Unregisters the sink `data`. Has no effect if no such a sink.
+   *
+   * @details Spins until the flushing of the sink which is in progress
+   * concurrently (if any) is finished, so the sink can be destroyed right
+   * after this call.
+   *
+   * @par Requires
+   * Must not be called from the flush function or from the signal handler
+   * which interrupted flush() in the same thread, since it would spin
+   * forever.
+   */
+  static void remove(void* const data) noexcept
+  {
+    if (!data)
+      return;
+    for (auto& slot : slots_) {
+      if (slot.data.load() == data) {
+        slot.flush.store(nullptr);
+        slot.data.store(nullptr);
+        while (slot.flush_count.load())
+          std::this_thread::yield();
+      }
+    }
+  }
+
+  /// Flushes the registered sinks.
+  static void flush() noexcept
+  {
+    for (auto& slot : slots_) {
+      // The counter is incremented before reading the slot, so remove()
+      // either awaits the call or prevents it.
+      ++slot.flush_count;
+      const auto flush = slot.flush.load();
+      void* const data{slot.data.load()};
+      if (flush && data)
+        flush(data);
+      --slot.flush_count;
+    }
+  }
+
+private:
+  struct Slot final {
+    std::atomic<Flush> flush;
+    std::atomic<void*> data;
+    std::atomic_int flush_count; // the number of flushes in progress
+  };
+
+  inline static Slot slots_[max_count];
+};
+
+/**
+ * @brief The registry of the signals handled by this library.
+ *
+ * @details The signals are registered when their handlers are installed, so
+ * daemonize() keeps the handlers when resets the signal dispositions.
+ *
+ * @par Thread safety
+ * All the members are thread-safe and async-signal-safe.
+ */
+class Signal_handlers final {
+public:
+  /// The upper bound of signal numbers.
+  static constexpr int max_signal{128};
+
+  /// Registers the signal `sig` as handled by this library.
+  static void add(const int sig) noexcept
+  {
+    if (0 < sig && sig < max_signal)
+      signals_[sig].store(true, std::memory_order_relaxed);
+  }
+
+  /// Unregisters the signal `sig`.
+  static void remove(const int sig) noexcept
+  {
+    if (0 < sig && sig < max_signal)
+      signals_[sig].store(false, std::memory_order_relaxed);
+  }
+
+  /// @returns `true` if the signal `sig` is handled by this library.
+  static bool contains(const int sig) noexcept
+  {
+    return 0 < sig && sig < max_signal &&
+      signals_[sig].load(std::memory_order_relaxed);
+  }
+
+private:
+  inline static std::atomic_bool signals_[max_signal];
+};
+
+/**
+ * @brief Flushes the registered sinks (see Exit_sinks) and the standard
+ * streams and terminates the process by `std::_Exit(code)`.
+ *
+ * @details Unlike `std::exit()`, neither the destructors of static objects
+ * nor the functions registered by `std::atexit()` are called, which avoids
+ * the teardown of large heaps on shutdown. The names of sinks which are not
+ * flushed within the `timeout` are reported on the standard error.
+ *
+ * @remarks Not async-signal-safe. Should be called from a normal context
+ * (e.g. after the stop signal is noticed).
+ */
+[[noreturn]] inline void fast_exit(const int code,
+  const std::chrono::nanoseconds timeout = std::chrono::seconds{3}) noexcept
+{
+  try {
+    for (const auto& name : Exit_sinks::instance().flush(timeout))
+      std::cerr << "sink " << name << " is not flushed before exit" << '\n';
+    std::cout.flush();
+    std::clog.flush();
+    std::cerr.flush();
+  } catch (...) {}
+  std::fflush(nullptr);
+  std::_Exit(code);
+}
+
+/**
+ * @brief Terminates the process by fast_exit() if enabled, or by
+ * `std::exit()` otherwise.
+ *
+ * @see Exit_sinks::set_fast_exit_enabled().
+ */
+[[noreturn]] inline void exit_program(const int code)
+{
+  const auto& sinks = Exit_sinks::instance();
+  if (sinks.is_fast_exit_enabled())
+    fast_exit(code, sinks.fast_exit_timeout());
+  else
+    std::exit(code);
+}
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_EXIT_HPP
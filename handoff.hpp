@@ -0,0 +1,513 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_HANDOFF_HPP
+#define DMITIGR_PRG_HANDOFF_HPP
+
+#ifdef _WIN32
+#error dmitigr/prg/handoff.hpp is not usable on Windows!
+#endif
+
+#include "../base/assert.hpp"
+#include "../base/fsx.hpp"
+#include "../base/noncopymove.hpp"
+#include "command.hpp"
+#include "info.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace dmitigr::prg {
+
+namespace detail {
+
+/// @returns The address of the Unix domain socket at `path`.
+inline sockaddr_un unix_address(const std::filesystem::path& path)
+{
+  sockaddr_un result{};
+  result.sun_family = AF_UNIX;
+  const auto& str = path.native();
+  if (str.empty() || str.size() >= sizeof(result.sun_path))
+    throw std::invalid_argument{std::string{"invalid Unix socket path "}
+      .append(str)};
+  std::memcpy(result.sun_path, str.data(), str.size());
+  return result;
+}
+
+/// @returns The new Unix domain stream socket.
+inline int unix_socket()
+{
+  const int result{socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)};
+  if (result < 0)
+    throw std::system_error{errno, std::system_category(),
+      "cannot create Unix socket"};
+  return result;
+}
+
+/// @returns The effective user ID of the peer of the connected `socket`.
+inline uid_t peer_euid(const int socket)
+{
+#ifdef SO_PEERCRED
+  ucred cred{};
+  socklen_t size{sizeof(cred)};
+  if (getsockopt(socket, SOL_SOCKET, SO_PEERCRED, &cred, &size))
+    throw std::system_error{errno, std::system_category(),
+      "cannot get credentials of Unix socket peer"};
+  return cred.uid;
+#else
+  uid_t uid{};
+  gid_t gid{};
+  if (getpeereid(socket, &uid, &gid))
+    throw std::system_error{errno, std::system_category(),
+      "cannot get credentials of Unix socket peer"};
+  return uid;
+#endif
+}
+
+/// Closes the descriptor on destruction.
+class Fd_guard final : Noncopymove {
+public:
+  explicit Fd_guard(const int fd) noexcept
+    : fd_{fd}
+  {}
+
+  ~Fd_guard()
+  {
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  int get() const noexcept
+  {
+    return fd_;
+  }
+
+  int release() noexcept
+  {
+    return std::exchange(fd_, -1);
+  }
+
+private:
+  int fd_{-1};
+};
+
+} // namespace detail
+
+// =============================================================================
+
+/// The maximum number of descriptors sent by a single send_descriptors().
+constexpr std::size_t max_sent_descriptors{250};
+
+/**
+ * @brief Sends `data` along with descriptors `fds` over the Unix domain
+ * socket.
+ *
+ * @par Requires
+ * `!data.empty() && fds.size() <= max_sent_descriptors`.
+ */
+inline void send_descriptors(const int socket, const std::string_view data,
+  const std::vector<int>& fds)
+{
+  if (data.empty())
+    throw std::invalid_argument{"cannot send descriptors without data"};
+  else if (fds.size() > max_sent_descriptors)
+    throw std::invalid_argument{"too many descriptors to send"};
+
+  const std::size_t fds_size{fds.size() * sizeof(int)};
+  std::vector<char> control(fds.empty() ? 0 : CMSG_SPACE(fds_size));
+  iovec iov{const_cast<char*>(data.data()), data.size()};
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (!fds.empty()) {
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    cmsghdr* const cmsg{CMSG_FIRSTHDR(&msg)};
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(fds_size);
+    std::memcpy(CMSG_DATA(cmsg), fds.data(), fds_size);
+  }
+
+  while (iov.iov_len) {
+    const auto sent = sendmsg(socket, &msg, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::system_error{errno, std::system_category(),
+        "cannot send descriptors"};
+    }
+    // The descriptors are sent along with the first byte.
+    msg.msg_control = nullptr;
+    msg.msg_controllen = 0;
+    iov.iov_base = static_cast<char*>(iov.iov_base) + sent;
+    iov.iov_len -= static_cast<std::size_t>(sent);
+  }
+}
+
+/**
+ * @brief Receives exactly `size` bytes of data along with descriptors sent
+ * by send_descriptors() over the Unix domain socket.
+ *
+ * @details The received descriptors are appended to `fds` and have the
+ * `FD_CLOEXEC` flag set.
+ *
+ * @returns The received data.
+ */
+inline std::string receive_descriptors(const int socket, const std::size_t size,
+  std::vector<int>& fds)
+{
+  std::string result(size, '\0');
+  std::vector<char> control(CMSG_SPACE(max_sent_descriptors * sizeof(int)));
+  std::size_t offset{};
+  while (offset < size) {
+    iovec iov{result.data() + offset, size - offset};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    const auto received = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+    if (received < 0) {
+      if (errno == EINTR)
+        continue;
+      throw std::system_error{errno, std::system_category(),
+        "cannot receive descriptors"};
+    } else if (!received)
+      throw std::runtime_error{"unexpected end of descriptors stream"};
+
+    for (cmsghdr* cmsg{CMSG_FIRSTHDR(&msg)}; cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+      if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        const auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const auto old_size = fds.size();
+        fds.resize(old_size + count);
+        std::memcpy(fds.data() + old_size, CMSG_DATA(cmsg), count * sizeof(int));
+      }
+    }
+    if (msg.msg_flags & MSG_CTRUNC)
+      throw std::runtime_error{"descriptors truncated"};
+    offset += static_cast<std::size_t>(received);
+  }
+  return result;
+}
+
+// =============================================================================
+
+/// A named descriptor to hand off.
+struct Handoff_descriptor final {
+  /// The name of the descriptor, like `http` or `cache`.
+  std::string name;
+
+  /// The descriptor.
+  int fd{-1};
+};
+
+/// The state received from the previous process.
+class Handoff final {
+public:
+  /// @returns The received descriptors.
+  const std::vector<Handoff_descriptor>& descriptors() const noexcept
+  {
+    return descriptors_;
+  }
+
+  /// @returns The descriptor with the given `name`, or `-1` if no such one.
+  int fd(const std::string_view name) const noexcept
+  {
+    const auto i = std::find_if(cbegin(descriptors_), cend(descriptors_),
+      [name](const auto& d){return d.name == name;});
+    return i != cend(descriptors_) ? i->fd : -1;
+  }
+
+  /// @returns The received opaque state.
+  const std::string& state() const noexcept
+  {
+    return state_;
+  }
+
+private:
+  friend Handoff receive_handoff(const std::filesystem::path&);
+
+  std::vector<Handoff_descriptor> descriptors_;
+  std::string state_;
+};
+
+namespace detail {
+
+/// The header of the handoff message.
+struct Handoff_header final {
+  std::uint32_t magic{0x68616e64}; // "hand"
+  std::uint32_t descriptor_count{};
+  std::uint64_t names_size{};
+  std::uint64_t state_size{};
+};
+
+} // namespace detail
+
+/**
+ * @brief The server side of the handoff. (Used by the old process.)
+ *
+ * @details The protocol is as follows:
+ *   -# the old process creates the instance and waits for a connection (for
+ *   example, upon `SIGUSR2` or a command);
+ *   -# the new process is started with the `--handoff=path` option and calls
+ *   receive_handoff();
+ *   -# the old process sends the descriptors and the state, waits for the
+ *   acknowledgement and sets `Info::instance().stop_signal` to drain and
+ *   exit, while the new process starts accepting on the received sockets.
+ *
+ * Since the listening sockets stay open during the whole process, no
+ * connections are refused or lost.
+ *
+ * The socket is created with mode `0600`, and the connections from the
+ * processes with the effective user ID other than `geteuid()` are rejected.
+ */
+class Handoff_server final : Noncopymove {
+public:
+  /// The destructor.
+  ~Handoff_server()
+  {
+    if (fd_ >= 0) {
+      close(fd_);
+      unlink(path_.c_str());
+    }
+  }
+
+  /**
+   * @brief The constructor. Starts listening on the Unix domain socket at
+   * `path` with mode `0600`.
+   */
+  explicit Handoff_server(std::filesystem::path path)
+    : path_{std::move(path)}
+  {
+    const auto addr = detail::unix_address(path_);
+    detail::Fd_guard fd{detail::unix_socket()};
+    unlink(path_.c_str());
+    // On Linux the mode of the socket inode is inherited by the bound file,
+    // so there is no window when the file is accessible by others.
+    fchmod(fd.get(), S_IRUSR | S_IWUSR);
+    if (bind(fd.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)))
+      throw std::system_error{errno, std::system_category(),
+        std::string{"cannot bind handoff socket to "}.append(path_.string())};
+    if (chmod(path_.c_str(), S_IRUSR | S_IWUSR)) {
+      const int err{errno};
+      unlink(path_.c_str());
+      throw std::system_error{err, std::system_category(),
+        std::string{"cannot change mode of handoff socket "}
+          .append(path_.string())};
+    }
+    if (listen(fd.get(), 1))
+      throw std::system_error{errno, std::system_category(),
+        "cannot listen on handoff socket"};
+    fd_ = fd.release();
+  }
+
+  /// @returns The path to the socket.
+  const std::filesystem::path& path() const noexcept
+  {
+    return path_;
+  }
+
+  /// @returns The listening descriptor to poll for readability.
+  int fd() const noexcept
+  {
+    return fd_;
+  }
+
+  /**
+   * @brief Waits for a connection from the new process and hands off the
+   * `descriptors` and the `state` to it.
+   *
+   * @param timeout The maximum time to wait for a connection, or `nullopt`
+   * to wait infinitely. (The connections from the processes of other users
+   * are closed without response, and the waiting continues.)
+   * @param stop_signal The value to set `Info::instance().stop_signal` to
+   * on success, or `0` to keep it untouched.
+   *
+   * @returns `false` on timeout, or `true` if the new process acknowledged
+   * receiving.
+   *
+   * @remarks The caller still owns the `descriptors` and should close them
+   * after draining.
+   */
+  bool serve(const std::vector<Handoff_descriptor>& descriptors,
+    const std::string_view state = {},
+    const std::optional<std::chrono::milliseconds> timeout = {},
+    const int stop_signal = SIGTERM)
+  {
+    namespace chrono = std::chrono;
+    const auto deadline = chrono::steady_clock::now() +
+      timeout.value_or(chrono::milliseconds::zero());
+    int conn_fd{-1};
+    while (conn_fd < 0) {
+      int wait_ms{-1};
+      if (timeout) {
+        const auto left = chrono::ceil<chrono::milliseconds>(
+          deadline - chrono::steady_clock::now());
+        wait_ms = static_cast<int>(std::max(left.count(),
+          chrono::milliseconds::rep{}));
+      }
+      pollfd pfd{fd_, POLLIN, 0};
+      const int ready{poll(&pfd, 1, wait_ms)};
+      if (ready < 0 && errno != EINTR)
+        throw std::system_error{errno, std::system_category(),
+          "cannot poll handoff socket"};
+      else if (ready <= 0)
+        return false;
+
+      detail::Fd_guard fd{accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC)};
+      if (fd.get() < 0)
+        throw std::system_error{errno, std::system_category(),
+          "cannot accept handoff connection"};
+      if (detail::peer_euid(fd.get()) == geteuid())
+        conn_fd = fd.release();
+    }
+    const detail::Fd_guard conn{conn_fd};
+
+    // Send the header with names and the descriptors in chunks.
+    std::string names;
+    for (const auto& d : descriptors) {
+      if (d.fd < 0)
+        throw std::invalid_argument{std::string{"invalid handoff descriptor "}
+          .append(d.name)};
+      names.append(d.name).push_back('\0');
+    }
+    detail::Handoff_header header;
+    header.descriptor_count = static_cast<std::uint32_t>(descriptors.size());
+    header.names_size = names.size();
+    header.state_size = state.size();
+    send_descriptors(conn.get(), {reinterpret_cast<const char*>(&header),
+      sizeof(header)}, {});
+    for (std::size_t i{}; i < descriptors.size(); i += max_sent_descriptors) {
+      std::vector<int> fds;
+      const auto end = std::min(descriptors.size(), i + max_sent_descriptors);
+      for (auto j = i; j < end; ++j)
+        fds.push_back(descriptors[j].fd);
+      send_descriptors(conn.get(), "d", fds);
+    }
+    if (!names.empty())
+      send_descriptors(conn.get(), names, {});
+    if (!state.empty())
+      send_descriptors(conn.get(), state, {});
+
+    // Wait for the acknowledgement.
+    char ack{};
+    ssize_t received{};
+    while ((received = recv(conn.get(), &ack, 1, 0)) < 0 && errno == EINTR);
+    if (received != 1 || ack != 'k')
+      throw std::runtime_error{"handoff is not acknowledged"};
+
+    if (stop_signal)
+      Info::instance().stop_signal = stop_signal;
+    return true;
+  }
+
+private:
+  std::filesystem::path path_;
+  int fd_{-1};
+};
+
+/**
+ * @brief Connects to the Handoff_server at `path` and receives the
+ * descriptors and the state from it.
+ *
+ * @par Requires
+ * The server process has the same effective user ID as the caller.
+ *
+ * @remarks The caller becomes an owner of the received descriptors.
+ */
+inline Handoff receive_handoff(const std::filesystem::path& path)
+{
+  const auto addr = detail::unix_address(path);
+  const detail::Fd_guard conn{detail::unix_socket()};
+  if (connect(conn.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)))
+    throw std::system_error{errno, std::system_category(),
+      std::string{"cannot connect to handoff socket "}.append(path.string())};
+  else if (detail::peer_euid(conn.get()) != geteuid())
+    throw std::runtime_error{std::string{"handoff socket "}
+      .append(path.string()).append(" is owned by other user")};
+
+  std::vector<int> fds;
+  try {
+    detail::Handoff_header header;
+    const auto header_data = receive_descriptors(conn.get(), sizeof(header), fds);
+    std::memcpy(&header, header_data.data(), sizeof(header));
+    if (header.magic != detail::Handoff_header{}.magic)
+      throw std::runtime_error{"invalid handoff header"};
+    const auto chunk_count = (header.descriptor_count + max_sent_descriptors - 1)
+      / max_sent_descriptors;
+    for (std::size_t i{}; i < chunk_count; ++i)
+      receive_descriptors(conn.get(), 1, fds);
+    if (fds.size() != header.descriptor_count)
+      throw std::runtime_error{"unexpected number of handoff descriptors"};
+
+    Handoff result;
+    const auto names = receive_descriptors(conn.get(), header.names_size, fds);
+    result.state_ = receive_descriptors(conn.get(), header.state_size, fds);
+    std::string_view rest{names};
+    for (const int fd : fds) {
+      const auto pos = rest.find('\0');
+      if (pos == std::string_view::npos)
+        throw std::runtime_error{"invalid handoff descriptor names"};
+      result.descriptors_.push_back({std::string{rest.substr(0, pos)}, fd});
+      rest.remove_prefix(pos + 1);
+    }
+
+    if (send(conn.get(), "k", 1, MSG_NOSIGNAL) != 1)
+      throw std::system_error{errno, std::system_category(),
+        "cannot acknowledge handoff"};
+    return result;
+  } catch (...) {
+    for (const int fd : fds)
+      close(fd);
+    throw;
+  }
+}
+
+/**
+ * @returns The result of `receive_handoff(path)` if `command` has the
+ * option `--handoff=path`, or `nullopt` otherwise.
+ */
+inline std::optional<Handoff> receive_handoff(const Command& command)
+{
+  if (const auto opt = command.option("handoff");
+    opt.is_valid_throw_if_no_value())
+    return receive_handoff(std::filesystem::path{opt.value_not_empty()});
+  return std::nullopt;
+}
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_HANDOFF_HPP
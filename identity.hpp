@@ -0,0 +1,222 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_IDENTITY_HPP
+#define DMITIGR_PRG_IDENTITY_HPP
+
+#include "../base/fsx.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <link.h>
+#endif
+
+namespace dmitigr::prg {
+
+namespace detail {
+
+/**
+ * @returns The time elapsed since the system boot till the process start,
+ * or `nullopt` if unknown.
+ *
+ * @remarks The resolution is the clock tick (usually 10 ms). The value is
+ * comparable with `CLOCK_BOOTTIME`.
+ */
+inline std::optional<std::chrono::nanoseconds> process_start_since_boot()
+{
+#ifdef __linux__
+  std::ifstream stat{"/proc/self/stat"};
+  std::string line;
+  if (!std::getline(stat, line))
+    return std::nullopt;
+
+  // The command name (field 2) may contain spaces and parentheses.
+  const auto pos = line.rfind(')');
+  if (pos == std::string::npos)
+    return std::nullopt;
+  std::istringstream fields{line.substr(pos + 1)};
+  std::string field;
+  for (int i{3}; i < 22 && fields >> field; ++i);
+  unsigned long long ticks{};
+  if (!(fields >> ticks))
+    return std::nullopt;
+  const long hz{sysconf(_SC_CLK_TCK)};
+  if (hz <= 0)
+    return std::nullopt;
+  return std::chrono::nanoseconds{static_cast<std::int64_t>(
+      ticks * (1000000000ull / static_cast<unsigned long long>(hz)))};
+#else
+  return std::nullopt;
+#endif
+}
+
+/// @returns The process start time, or the current time if unknown.
+inline std::chrono::system_clock::time_point process_start_time()
+{
+  const auto now = std::chrono::system_clock::now();
+#ifdef __linux__
+  std::ifstream stat{"/proc/stat"};
+  std::string key;
+  long long boot_time{};
+  while (stat >> key) {
+    if (key == "btime") {
+      stat >> boot_time;
+      break;
+    }
+    stat.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+  if (const auto since_boot = process_start_since_boot(); since_boot && boot_time)
+    return std::chrono::system_clock::time_point{
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(
+        std::chrono::seconds{boot_time} + *since_boot)};
+#endif
+  return now;
+}
+
+/// @returns The ID of the current boot, or empty string if unknown.
+inline std::string boot_id()
+{
+  std::string result;
+#ifdef __linux__
+  std::ifstream{"/proc/sys/kernel/random/boot_id"} >> result;
+#endif
+  return result;
+}
+
+/**
+ * @returns The build ID of the executable in hexadecimal, or empty string
+ * if unknown.
+ *
+ * @remarks The build ID is produced by the linker (`--build-id`).
+ */
+inline std::string build_id()
+{
+  std::string result;
+#ifdef __linux__
+  dl_iterate_phdr([](dl_phdr_info* const info, std::size_t, void* const data)
+  {
+    // The first object is the executable.
+    auto& result = *static_cast<std::string*>(data);
+    for (ElfW(Half) i{}; i < info->dlpi_phnum; ++i) {
+      const auto& phdr = info->dlpi_phdr[i];
+      if (phdr.p_type != PT_NOTE)
+        continue;
+
+      const auto* ptr = reinterpret_cast<const char*>(info->dlpi_addr +
+        phdr.p_vaddr);
+      const auto* const end = ptr + phdr.p_memsz;
+      constexpr auto align = [](const std::size_t size)
+      {
+        return (size + 3) & ~std::size_t{3};
+      };
+      while (ptr + sizeof(ElfW(Nhdr)) <= end) {
+        const auto* const note = reinterpret_cast<const ElfW(Nhdr)*>(ptr);
+        const auto* const name = ptr + sizeof(ElfW(Nhdr));
+        const auto* const desc = name + align(note->n_namesz);
+        if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+          std::string_view{name, 3} == "GNU") {
+          static const char digits[] = "0123456789abcdef";
+          for (ElfW(Word) j{}; j < note->n_descsz; ++j) {
+            const auto byte = static_cast<unsigned char>(desc[j]);
+            result += digits[byte >> 4];
+            result += digits[byte & 0xf];
+          }
+          return 1;
+        }
+        ptr = desc + align(note->n_descsz);
+      }
+    }
+    return 1;
+  }, &result);
+#endif
+  return result;
+}
+
+/// @returns The host name, or empty string if unknown.
+inline std::string hostname()
+{
+#ifdef _WIN32
+  // Avoid a dependency on Winsock.
+  const char* const name{std::getenv("COMPUTERNAME")};
+  return name ? name : "";
+#else
+  char name[256]{};
+  return !gethostname(name, sizeof(name) - 1) ? name : "";
+#endif
+}
+
+} // namespace detail
+
+/// The identity of the process.
+struct Identity final {
+  /// The file name of the executable.
+  std::string program_name;
+
+  /// The path to the executable.
+  std::filesystem::path executable_path;
+
+  /// The process ID. (See `Info::identity()` regarding `fork()`.)
+  std::int64_t pid{};
+
+  /// The host name.
+  std::string hostname;
+
+  /// The process start time.
+  std::chrono::system_clock::time_point start_time;
+
+  /// The ID of the current system boot (Linux only).
+  std::string boot_id;
+
+  /// The build ID of the executable in hexadecimal (ELF only).
+  std::string build_id;
+
+  /// @returns The identity of the calling process.
+  static Identity make(std::filesystem::path executable_path)
+  {
+    Identity result;
+    result.program_name = executable_path.filename().string();
+    result.executable_path = std::move(executable_path);
+#ifdef _WIN32
+    result.pid = _getpid();
+#else
+    result.pid = getpid();
+#endif
+    result.hostname = detail::hostname();
+    result.start_time = detail::process_start_time();
+    result.boot_id = detail::boot_id();
+    result.build_id = detail::build_id();
+    return result;
+  }
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_IDENTITY_HPP
@@ -20,10 +20,29 @@
 #include "../base/assert.hpp"
 #include "../base/fsx.hpp"
 #include "../base/noncopymove.hpp"
+#include "affinity.hpp"
+#include "command.hpp"
+#include "identity.hpp"
+#include "resources.hpp"
+#include "startup.hpp"
+#ifndef _WIN32
+#include "deadline.hpp"
+#include "memory.hpp"
+#include "profiler.hpp"
+#include "recorder.hpp"
 
+#include <unistd.h>
+#endif
+
+#include <algorithm>
 #include <atomic>
+#include <iterator>
 #include <memory>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 namespace dmitigr::prg {
 
@@ -40,10 +59,13 @@ public:
    */
   static std::unique_ptr<Info> make();
 
-  /// @returns `true` if instance initialized.
+  /**
+   * @returns `true` if instance initialized, or if the calling thread is
+   * bound to an instance. (See Scope.)
+   */
   static bool is_initialized() noexcept
   {
-    return static_cast<bool>(instance_);
+    return current_ || instance_;
   }
 
   /**
@@ -57,22 +79,112 @@ public:
    *
    * @returns instance().
    *
+   * @details The standard options enabled by standard_options() are applied
+   * and removed from the arguments before calling `init()`.
+   *
    * @remarks It makes the most sense to call it from main().
    */
   static Info& initialize(const int argc, const char* const* argv)
   {
     DMITIGR_ASSERT(!instance_);
+    return initialize(make(), argc, argv);
+  }
+
+  /**
+   * @brief Initializes the instance by using the given `instance` rather
+   * than the one returned by make().
+   *
+   * @par Requires
+   * `!is_initialized() && instance && argc && argv`.
+   *
+   * @par Effects
+   * `is_initialized()`.
+   *
+   * @returns instance().
+   *
+   * @remarks Useful when the program consists of several programs with the
+   * different info. (See Multicall.)
+   */
+  static Info& initialize(std::unique_ptr<Info> instance,
+    const int argc, const char* const* argv)
+  {
+    DMITIGR_ASSERT(!instance_);
+    DMITIGR_ASSERT(instance);
     DMITIGR_ASSERT(argc);
     DMITIGR_ASSERT(argv);
-    instance_ = make();
-    DMITIGR_ASSERT(instance_);
-    instance_->init(argc, argv);
+    auto& profiler = Startup_profiler::instance();
+    profiler.mark("static-init");
+    instance_ = std::move(instance);
+    instance_->register_process_instance();
+    instance_->init_standard(argc, argv);
+    profiler.mark("standard-options");
+    instance_->identity_ = Identity::make(instance_->executable_path());
+    profiler.mark("identity");
+    instance_->init(static_cast<int>(instance_->argv_.size() - 1),
+      instance_->argv_.data());
+    instance_->update_identity();
+    profiler.mark("init");
     DMITIGR_ASSERT(is_initialized());
     return *instance_;
   }
 
-  /*
-   * @returns Initialized instance.
+  /**
+   * @brief Initializes the `instance` which is not process-wide.
+   *
+   * @details Unlike initialize(), the standard options enabled by
+   * standard_options() are parsed (and removed from the arguments) but not
+   * applied, since they affect the whole
+   * process. To make the result the current instance of a thread use Scope.
+   *
+   * @par Requires
+   * `instance && argc && argv`.
+   *
+   * @returns The initialized `instance`.
+   *
+   * @remarks Useful to run several programs within the same process, such
+   * as when embedding or testing.
+   */
+  static std::unique_ptr<Info> create(std::unique_ptr<Info> instance,
+    int argc, const char* const* argv)
+  {
+    DMITIGR_ASSERT(instance);
+    DMITIGR_ASSERT(argc);
+    DMITIGR_ASSERT(argv);
+    instance->init_standard(argc, argv, false);
+    instance->identity_ = Identity::make(instance->executable_path());
+    instance->init(static_cast<int>(instance->argv_.size() - 1),
+      instance->argv_.data());
+    instance->update_identity();
+    return instance;
+  }
+
+  /**
+   * @brief Binds the calling thread to an instance for the lifetime of the
+   * scope, so `instance()` returns it rather than the process-wide one.
+   *
+   * @details Scopes can be nested. The destructor restores the previously
+   * bound instance.
+   */
+  class Scope final : Noncopymove {
+  public:
+    /// The constructor.
+    explicit Scope(Info& info) noexcept
+      : previous_{std::exchange(current_, &info)}
+    {}
+
+    /// The destructor.
+    ~Scope()
+    {
+      current_ = previous_;
+    }
+
+  private:
+    Info* previous_{};
+  };
+
+  /**
+   * @returns The instance bound to the calling thread (see Scope), or the
+   * process-wide instance otherwise.
    *
    * @par Requires
    * `is_initialized()`.
@@ -80,17 +192,173 @@ public:
   static Info& instance() noexcept
   {
     DMITIGR_ASSERT(is_initialized());
+    return current_ ? *current_ : *instance_;
+  }
+
+  /**
+   * @returns The process-wide instance regardless of the instance bound to
+   * the calling thread.
+   *
+   * @par Requires
+   * `is_process_initialized()`.
+   */
+  static Info& process_instance() noexcept
+  {
+    DMITIGR_ASSERT(is_process_initialized());
     return *instance_;
   }
 
+  /// @returns `true` if the process-wide instance initialized.
+  static bool is_process_initialized() noexcept
+  {
+    return static_cast<bool>(instance_);
+  }
+
+  /**
+   * @returns The names of all the standard options (without leading dashes),
+   * which can be enabled by standard_options().
+   *
+   * @details The standard options are those of Affinity, Resources,
+   * Memory_guard, Deadline, Startup_profiler (`--startup-profile`),
+   * Sampling_profiler (`--profile`) and Flight_recorder (`--flight-recorder`).
+   *
+   * @remarks Useful to enable all the standard options.
+   */
+  static const std::vector<std::string_view>& standard_option_names()
+  {
+    static const auto result = []
+    {
+      std::vector<std::string_view> result;
+      const auto append = [&result](const auto& names)
+      {
+        result.insert(cend(result), std::cbegin(names), std::cend(names));
+      };
+      append(Affinity::option_names);
+      append(Resources::option_names);
+      result.push_back("startup-profile");
+#ifndef _WIN32
+      append(Memory_guard::Options::option_names);
+      append(Deadline::Options::option_names);
+      result.push_back("profile");
+      result.push_back("flight-recorder");
+#endif
+      return result;
+    }();
+    return result;
+  }
+
+  /**
+   * @returns The names of the standard options (without leading dashes)
+   * recognized and removed from the arguments by initialize() and create()
+   * before calling `init()`. Each name must be one of
+   * standard_option_names().
+   *
+   * @details The default implementation returns an empty vector, so the
+   * options of the program are never shadowed by the standard ones.
+   */
+  virtual std::vector<std::string_view> standard_options() const
+  {
+    return {};
+  }
+
   /// The stop signal.
   std::atomic_int stop_signal{0};
 
-  /// @returns The program name.
-  std::string program_name() const
+  /**
+   * @returns The identity of the process computed once by initialize() or
+   * create() right before calling init(), so it's available in init().
+   *
+   * @remarks The `executable_path` and the `program_name` are updated after
+   * init() if executable_path() is changed by it.
+   *
+   * @remarks The `pid` of the process-wide instance is refreshed only in the
+   * child processes created by fork_process(). The rest of the identity
+   * (including the `start_time`) is inherited from the parent.
+   */
+  const Identity& identity() const noexcept
+  {
+    return identity_;
+  }
+
+  /// @returns `identity().program_name`.
+  const std::string& program_name() const noexcept
+  {
+    return identity_.program_name;
+  }
+
+  /// @returns The placement settings specified by the standard options.
+  const Affinity& affinity() const noexcept
+  {
+    return affinity_;
+  }
+
+  /// @returns The statuses of the settings specified by the standard options.
+  const std::vector<Resource_status>& resource_statuses() const noexcept
+  {
+    return resource_statuses_;
+  }
+
+#ifndef _WIN32
+  /**
+   * @returns The memory guard started by initialize() if any limit is
+   * specified by the standard options, or `nullptr` otherwise. The guard
+   * sets the `stop_signal` when the hard limit is exceeded.
+   *
+   * @remarks The thread of the guard is stopped for the time of
+   * fork_process() and restarted in both the parent and the child processes.
+   */
+  Memory_guard* memory_guard() const noexcept
+  {
+    return memory_guard_.get();
+  }
+
+  /**
+   * @returns The deadline armed by initialize() if any timeout is specified
+   * by the standard options, or `nullptr` otherwise. The deadline sets the
+   * `stop_signal` to `SIGALRM` when the soft timeout expires. The deadline
+   * is rearmed in the children created by fork_process().
+   */
+  Deadline* deadline() const noexcept
+  {
+    return deadline_.get();
+  }
+
+  /**
+   * @brief Calls `fork()` keeping the process-wide instance consistent.
+   *
+   * @details The memory guard is suspended for the time of `fork()` and
+   * resumed in both the parent and the child processes. In the child the
+   * `pid` of the identity is refreshed and the deadline is rearmed. The
+   * errors of resuming the guard and rearming the deadline are ignored.
+   *
+   * @returns The result of `fork()`.
+   *
+   * @remarks Used by the fork points of the library (daemonize(), Supervisor
+   * and Zygote). The `fork()`s made by other code leave the instance as is.
+   */
+  static pid_t fork_process()
   {
-    return executable_path().filename().string();
+    Memory_guard* const memory_guard{instance_ ?
+      instance_->memory_guard_.get() : nullptr};
+    if (memory_guard)
+      memory_guard->suspend();
+    const pid_t result{::fork()};
+    if (!result && instance_) {
+      instance_->identity_.pid = getpid();
+      if (instance_->deadline_) {
+        try {
+          instance_->deadline_->rearm();
+        } catch (...) {}
+      }
+    }
+    if (memory_guard) {
+      try {
+        memory_guard->resume();
+      } catch (...) {}
+    }
+    return result;
   }
+#endif
 
   /// @returns The path to the executable.
   virtual std::filesystem::path executable_path() const = 0;
@@ -104,6 +372,94 @@ protected:
 
 private:
   inline static std::unique_ptr<Info> instance_;
+  inline static constinit thread_local Info* current_{};
+
+  /**
+   * @brief Called from initialize() right after this instance became the
+   * process-wide one, before applying the standard options.
+   */
+  virtual void register_process_instance() noexcept
+  {}
+
+  Identity identity_;
+  std::vector<const char*> argv_; // null-terminated, without standard options
+  Affinity affinity_;
+  std::vector<Resource_status> resource_statuses_;
+#ifndef _WIN32
+  std::unique_ptr<Memory_guard> memory_guard_;
+  std::unique_ptr<Deadline> deadline_;
+#endif
+
+  /// Updates the identity if executable_path() is changed by init().
+  void update_identity()
+  {
+    if (auto path = executable_path(); path != identity_.executable_path) {
+      identity_.program_name = path.filename().string();
+      identity_.executable_path = std::move(path);
+    }
+  }
+
+  /**
+   * @brief Parses, removes from the arguments and, if `is_process_wide`,
+   * applies the standard options.
+   */
+  void init_standard(const int argc, const char* const* const argv,
+    const bool is_process_wide = true)
+  {
+    const auto enabled = standard_options();
+    for (const auto name : enabled) {
+      const auto& names = standard_option_names();
+      if (std::find(cbegin(names), cend(names), name) == cend(names))
+        throw std::invalid_argument{std::string{"unknown standard option --"}
+          .append(name)};
+    }
+
+    // Only the options preceding the parameters are recognized.
+    std::vector<const char*> standard_argv{argv[0]};
+    argv_.assign(argv, argv + 1);
+    int i{1};
+    for (; i < argc && is_option(argv[i]) && std::string_view{argv[i]} != "--";
+         ++i) {
+      const std::string_view arg{argv[i]};
+      const auto name = arg.substr(2, arg.find('=') - 2);
+      const bool is_standard{std::find(cbegin(enabled), cend(enabled), name) !=
+        cend(enabled)};
+      (is_standard ? standard_argv : argv_).push_back(argv[i]);
+    }
+    argv_.insert(cend(argv_), argv + i, argv + argc);
+    argv_.push_back(nullptr);
+
+    auto standard_argc = static_cast<int>(standard_argv.size());
+    const char* const* standard_argv_p{standard_argv.data()};
+    const auto command = make_command(&standard_argc, &standard_argv_p,
+      false);
+    affinity_ = Affinity::make(command);
+    const auto resources = Resources::make(command);
+    const auto [startup_profile, profile, flight_recorder] = command.options(
+      "startup-profile", "profile", "flight-recorder");
+    if (is_process_wide) {
+      affinity_.apply();
+      resource_statuses_ = resources.apply();
+      if (startup_profile.is_valid_throw_if_no_value())
+        Startup_profiler::instance().set_output(startup_profile.value_not_empty());
+#ifndef _WIN32
+      if (auto options = Memory_guard::Options::make(command); options.is_enabled())
+        memory_guard_ = std::make_unique<Memory_guard>(std::move(options),
+          stop_signal);
+      if (auto options = Deadline::Options::make(command); options.is_enabled())
+        deadline_ = std::make_unique<Deadline>(std::move(options), stop_signal);
+      if (flight_recorder.is_valid_throw_if_no_value()) {
+        Flight_recorder::set_output(flight_recorder.value_not_empty());
+        Flight_recorder::install_fatal_handlers();
+      }
+      if (profile.is_valid_throw_if_no_value()) {
+        auto& profiler = Sampling_profiler::instance();
+        profiler.set_output(profile.value_not_empty());
+        profiler.start();
+      }
+#endif
+    }
+  }
 };
 
 } // namespace dmitigr::prg
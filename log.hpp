@@ -0,0 +1,440 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_LOG_HPP
+#define DMITIGR_PRG_LOG_HPP
+
+#ifdef _WIN32
+#error dmitigr/prg/log.hpp is not usable on Windows!
+#endif
+
+#include "../base/noncopymove.hpp"
+#include "exit.hpp"
+#include "info.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace dmitigr::prg {
+
+/// The options of Logger.
+struct Logger_options final {
+  /// The descriptor to write the log to.
+  int fd{STDERR_FILENO};
+
+  /// The size of the buffer of each thread in bytes.
+  std::size_t buffer_size{64*1024};
+
+  /// The maximum interval of writing.
+  std::chrono::milliseconds interval{10};
+
+  /**
+   * The prefix of each line. If not specified, `<program name>[<pid>]: ` is
+   * used if `Info::is_process_initialized()`, where `<pid>` is the `pid` of
+   * `Info::identity()` at the time of logging (so it's refreshed in the child
+   * processes created by `Info::fork_process()`).
+   */
+  std::optional<std::string> prefix;
+};
+
+/**
+ * @brief The asynchronous logger.
+ *
+ * @details Each thread writes the lines into its own single-producer
+ * single-consumer ring buffer without locks and system calls. The background
+ * thread writes the buffered lines of all the threads by `writev()` in
+ * batches every `Logger_options::interval`, or earlier if a buffer gets half
+ * full. If the buffer is full, the producer waits for the space.
+ *
+ * The order of lines is preserved within a thread, but not across threads.
+ *
+ * The logger is flushed:
+ *   - periodically (so the lines logged before the stop signal is noticed
+ *   are written in `Logger_options::interval`);
+ *   - by flush();
+ *   - by fast_exit(), since the logger is registered in Exit_sinks;
+ *   - by the destructor (so by `std::exit()` if the logger is static);
+ *   - by flush_unsafe() called from the signal handlers (such as
+ *   handle_signal() and the handlers of fatal signals of Flight_recorder),
+ *   since the logger is registered in Signal_sinks.
+ *
+ * @remarks The background thread is not inherited by `fork()`, so the child
+ * process should create its own logger.
+ *
+ * @par Thread safety
+ * All the members are thread-safe.
+ */
+class Logger final : Noncopymove {
+public:
+  /// The destructor. Flushes the logger.
+  ~Logger()
+  {
+    Signal_sinks::remove(this);
+    Exit_sinks::instance().remove(exit_sink_);
+    {
+      const std::lock_guard lock{mutex_};
+      is_stopping_ = true;
+    }
+    cond_.notify_one();
+    writer_.join();
+    flush();
+  }
+
+  /// The constructor. Starts the background thread.
+  explicit Logger(Logger_options options = {})
+    : options_{std::move(options)}
+    , id_{++last_id_}
+  {
+    if (options_.fd < 0)
+      throw std::invalid_argument{"invalid descriptor of logger"};
+    else if (options_.buffer_size < 256)
+      throw std::invalid_argument{"too small buffer of logger"};
+    else if (options_.interval <= std::chrono::milliseconds::zero())
+      throw std::invalid_argument{"invalid interval of logger"};
+
+    if (options_.prefix)
+      prefix_ = std::move(*options_.prefix);
+    else if (Info::is_process_initialized()) {
+      prefix_.append(Info::process_instance().identity().program_name)
+        .append("[");
+      is_pid_in_prefix_ = true;
+    }
+
+    writer_ = std::thread{[this]
+    {
+      std::unique_lock lock{mutex_};
+      while (!is_stopping_) {
+        cond_.wait_for(lock, options_.interval,
+          [this]{return is_stopping_ || is_write_requested_;});
+        is_write_requested_ = false;
+        lock.unlock();
+        flush();
+        lock.lock();
+      }
+    }};
+    exit_sink_ = Exit_sinks::instance().add("logger", [this]{flush();});
+    Signal_sinks::add([](void* const self) noexcept
+    {
+      static_cast<Logger*>(self)->flush_unsafe();
+    }, this);
+  }
+
+  /// @returns The prefix of lines.
+  std::string prefix() const
+  {
+    char buf[pid_suffix_size];
+    return std::string{prefix_}.append(pid_suffix(buf));
+  }
+
+  /**
+   * @brief Logs the line consisting of the prefix, the `message` and the
+   * newline.
+   *
+   * @details Lines larger than the buffer are written synchronously.
+   */
+  void log(const std::string_view message)
+  {
+    char buf[pid_suffix_size];
+    const auto suffix = pid_suffix(buf);
+    const auto size = prefix_.size() + suffix.size() + message.size() + 1;
+    auto& ring = this->ring();
+    if (size > ring.capacity) {
+      std::string line;
+      line.reserve(size);
+      line.append(prefix_).append(suffix).append(message).append("\n");
+      const std::lock_guard lock{flush_mutex_};
+      drain();
+      iovec iov{line.data(), line.size()};
+      write_all(&iov, 1);
+      return;
+    }
+
+    // Wait for the space.
+    const auto head = ring.head.load(std::memory_order_relaxed);
+    while (ring.capacity - (head - ring.tail.load(std::memory_order_acquire)) < size) {
+      request_write();
+      std::this_thread::yield();
+    }
+
+    auto pos = head;
+    const auto put = [&ring, &pos](const std::string_view data)
+    {
+      const auto offset = pos & (ring.capacity - 1);
+      const auto first = std::min(data.size(), ring.capacity - offset);
+      std::memcpy(ring.data.get() + offset, data.data(), first);
+      std::memcpy(ring.data.get(), data.data() + first, data.size() - first);
+      pos += data.size();
+    };
+    put(prefix_);
+    if (!suffix.empty())
+      put(suffix);
+    put(message);
+    put("\n");
+    ring.head.store(pos, std::memory_order_release);
+
+    if (pos - ring.tail.load(std::memory_order_relaxed) > ring.capacity / 2)
+      request_write();
+  }
+
+  /// Writes the buffered lines of all the threads.
+  void flush()
+  {
+    const std::lock_guard lock{flush_mutex_};
+    drain();
+  }
+
+  /**
+   * @brief Writes the buffered lines of all the threads without locking.
+   *
+   * @details Intended for the signal handlers (see Signal_sinks). Has no
+   * effect if the lines are being written concurrently (possibly by the
+   * interrupted thread).
+   *
+   * @remarks Async-signal-safe.
+   */
+  void flush_unsafe() noexcept
+  {
+    if (is_draining_.test_and_set(std::memory_order_acquire))
+      return;
+    for (auto* ring = first_ring_.load(std::memory_order_acquire); ring;
+         ring = ring->next) {
+      const auto tail = ring->tail.load(std::memory_order_relaxed);
+      const auto head = ring->head.load(std::memory_order_acquire);
+      const auto offset = tail & (ring->capacity - 1);
+      const auto size = head - tail;
+      const auto first = std::min(size, ring->capacity - offset);
+      iovec iovs[]{{ring->data.get() + offset, first},
+        {ring->data.get(), size - first}};
+      write_all(iovs, 2);
+      ring->tail.store(head, std::memory_order_release);
+    }
+    is_draining_.clear(std::memory_order_release);
+  }
+
+private:
+  struct Ring final {
+    explicit Ring(const std::size_t size)
+      : capacity{std::bit_ceil(size)}
+      , data{std::make_unique<char[]>(capacity)}
+    {}
+
+    const std::size_t capacity;
+    std::unique_ptr<char[]> data;
+    Ring* next{}; // immutable after publishing in first_ring_
+    alignas(64) std::atomic_size_t head{};
+    alignas(64) std::atomic_size_t tail{};
+    std::atomic_bool is_orphan{};
+  };
+
+  /// The rings of the calling thread.
+  struct Thread_rings final {
+    ~Thread_rings()
+    {
+      for (const auto& [id, ring] : rings)
+        ring->is_orphan.store(true, std::memory_order_release);
+    }
+
+    std::vector<std::pair<std::uint64_t, std::shared_ptr<Ring>>> rings;
+  };
+
+  inline static std::atomic_uint64_t last_id_;
+  inline static thread_local Thread_rings thread_rings_;
+
+  /// The size of the buffer for pid_suffix().
+  static constexpr std::size_t pid_suffix_size{32};
+
+  Logger_options options_;
+  std::uint64_t id_{};
+  std::string prefix_;
+  bool is_pid_in_prefix_{};
+  Exit_sinks::Id exit_sink_{};
+
+  /*
+   * The rings are never removed while the logger is alive, but the rings of
+   * the exited threads are reused. So the list of rings can be traversed
+   * without locking by flush_unsafe().
+   */
+  std::mutex rings_mutex_;
+  std::vector<std::shared_ptr<Ring>> rings_; // the owners of the list nodes
+  std::atomic<Ring*> first_ring_{};
+  std::mutex flush_mutex_;
+  std::vector<std::size_t> heads_; // guarded by flush_mutex_
+  std::vector<iovec> iovs_; // guarded by flush_mutex_
+  std::atomic_flag is_draining_;
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  bool is_stopping_{};
+  bool is_write_requested_{};
+  std::thread writer_;
+
+  Ring& ring()
+  {
+    auto& rings = thread_rings_.rings;
+    for (const auto& [id, ring] : rings) {
+      if (id == id_)
+        return *ring;
+    }
+
+    // Release the rings of the destroyed loggers.
+    std::erase_if(rings, [](const auto& r){return r.second.use_count() == 1;});
+
+    // Reuse the ring of an exited thread, or create the new one.
+    std::shared_ptr<Ring> ring;
+    {
+      const std::lock_guard lock{rings_mutex_};
+      for (const auto& r : rings_) {
+        bool expected{true};
+        if (r->is_orphan.compare_exchange_strong(expected, false,
+            std::memory_order_acq_rel)) {
+          ring = r;
+          break;
+        }
+      }
+      if (!ring) {
+        ring = std::make_shared<Ring>(options_.buffer_size);
+        rings_.push_back(ring);
+        ring->next = first_ring_.load(std::memory_order_relaxed);
+        first_ring_.store(ring.get(), std::memory_order_release);
+      }
+    }
+    try {
+      rings.emplace_back(id_, ring);
+    } catch (...) {
+      ring->is_orphan.store(true, std::memory_order_release);
+      throw;
+    }
+    return *ring;
+  }
+
+  /**
+   * @returns The `<pid>]: ` part of the default prefix written into `buf`,
+   * or empty string if the prefix is not default.
+   */
+  std::string_view pid_suffix(char (&buf)[pid_suffix_size]) const noexcept
+  {
+    if (!is_pid_in_prefix_)
+      return {};
+    const auto pid = Info::process_instance().identity().pid;
+    const auto [end, ec] = std::to_chars(buf, buf + sizeof(buf) - 3, pid);
+    std::memcpy(end, "]: ", 3);
+    return {buf, static_cast<std::size_t>(end - buf) + 3};
+  }
+
+  void request_write()
+  {
+    {
+      const std::lock_guard lock{mutex_};
+      is_write_requested_ = true;
+    }
+    cond_.notify_one();
+  }
+
+  /// Writes the `iov`. Modifies it on partial writes.
+  void write_all(iovec* iov, std::size_t count) noexcept
+  {
+    while (count) {
+      const auto n = writev(options_.fd, iov,
+        static_cast<int>(std::min<std::size_t>(count, IOV_MAX)));
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+        return; // the lines are lost
+      }
+
+      // Skip the written data.
+      auto written = static_cast<std::size_t>(n);
+      while (count && written >= iov->iov_len) {
+        written -= iov->iov_len;
+        ++iov;
+        --count;
+      }
+      if (written) {
+        iov->iov_base = static_cast<char*>(iov->iov_base) + written;
+        iov->iov_len -= written;
+      }
+    }
+  }
+
+  /**
+   * @par Requires
+   * The `flush_mutex_` is locked.
+   */
+  void drain() noexcept
+  {
+    // The rings are prepended, so the list from the snapshot is stable.
+    Ring* const first{first_ring_.load(std::memory_order_acquire)};
+    std::size_t count{};
+    for (auto* ring = first; ring; ring = ring->next)
+      ++count;
+    try {
+      heads_.resize(count);
+      iovs_.clear();
+      iovs_.reserve(count * 2);
+    } catch (...) {
+      return;
+    }
+
+    // Wait for flush_unsafe() called concurrently from a signal handler.
+    while (is_draining_.test_and_set(std::memory_order_acquire))
+      std::this_thread::yield();
+
+    std::size_t i{};
+    for (auto* ring = first; ring; ring = ring->next, ++i) {
+      const auto tail = ring->tail.load(std::memory_order_relaxed);
+      const auto head = ring->head.load(std::memory_order_acquire);
+      heads_[i] = head;
+      if (head == tail)
+        continue;
+      const auto offset = tail & (ring->capacity - 1);
+      const auto size = head - tail;
+      const auto first_size = std::min(size, ring->capacity - offset);
+      iovs_.push_back(iovec{ring->data.get() + offset, first_size});
+      if (first_size < size)
+        iovs_.push_back(iovec{ring->data.get(), size - first_size});
+    }
+    write_all(iovs_.data(), iovs_.size());
+    i = 0;
+    for (auto* ring = first; ring; ring = ring->next, ++i)
+      ring->tail.store(heads_[i], std::memory_order_release);
+    is_draining_.clear(std::memory_order_release);
+  }
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_LOG_HPP
@@ -0,0 +1,549 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_MEMORY_HPP
+#define DMITIGR_PRG_MEMORY_HPP
+
+#ifdef _WIN32
+#error dmitigr/prg/memory.hpp is not usable on Windows!
+#endif
+
+#include "../base/fsx.hpp"
+#include "../base/noncopymove.hpp"
+#include "command.hpp"
+#include "resources.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace dmitigr::prg {
+
+/// A sample of the memory usage.
+struct Memory_usage final {
+  /// The resident set size of the process in bytes.
+  std::optional<std::uint64_t> rss;
+
+  /// The memory usage of the cgroup of the process in bytes.
+  std::optional<std::uint64_t> cgroup_current;
+
+  /// The memory limit of the cgroup of the process in bytes.
+  std::optional<std::uint64_t> cgroup_max;
+
+  /**
+   * The share of time (in percents over the last 10 seconds) in which some
+   * tasks of the cgroup (or the system) were stalled on memory (PSI).
+   */
+  std::optional<double> pressure;
+
+  /**
+   * @returns The usage to compare with the limits: the usage of the cgroup
+   * if the cgroup is limited (since the OOM killer acts on the cgroup), or
+   * the resident set size of the process otherwise.
+   */
+  std::optional<std::uint64_t> used() const noexcept
+  {
+    if (cgroup_max && cgroup_current)
+      return rss ? std::max(*rss, *cgroup_current) : *cgroup_current;
+    return rss;
+  }
+};
+
+/**
+ * @brief The sampler of the memory usage.
+ *
+ * @details The files of `/proc` and of the cgroup (v2 or v1) are opened once
+ * and reread by `pread()`, so the sampling is cheap. The data which is not
+ * available (e.g. without cgroup or on the kernels without PSI) is omitted.
+ *
+ * @remarks The files of `/proc/self` refer to the process which constructed
+ * the sampler, so the child process must construct its own one.
+ */
+class Memory_sampler final : Noncopymove {
+public:
+  /// The destructor.
+  ~Memory_sampler()
+  {
+    for (const int fd : {statm_fd_, current_fd_, max_fd_, pressure_fd_}) {
+      if (fd >= 0)
+        close(fd);
+    }
+  }
+
+  /// The constructor.
+  Memory_sampler()
+  {
+    namespace fs = std::filesystem;
+    static const auto open_file = [](const fs::path& path)
+    {
+      return open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    };
+
+    statm_fd_ = open_file("/proc/self/statm");
+    page_size_ = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+
+    // Find the cgroup of the process.
+    std::optional<fs::path> dir;
+    std::ifstream cgroup{"/proc/self/cgroup"};
+    for (std::string line; std::getline(cgroup, line);) {
+      const auto pos1 = line.find(':');
+      const auto pos2 = line.find(':', pos1 + 1);
+      if (pos1 == std::string::npos || pos2 == std::string::npos)
+        continue;
+      const std::string_view controllers{line.data() + pos1 + 1, pos2 - pos1 - 1};
+      const std::string_view path{line.data() + pos2 + 1};
+      if (controllers.empty()) {
+        // v2
+        if (const auto d = find_cgroup_dir("/sys/fs/cgroup", path);
+          d && !is_v1_) {
+          dir = d;
+          is_v1_ = false;
+        }
+      } else if (controllers == "memory" ||
+        controllers.find("memory,") == 0 ||
+        controllers.find(",memory") != std::string_view::npos) {
+        // v1 takes precedence on hybrid hierarchy since it holds the limits.
+        if (const auto d = find_cgroup_dir("/sys/fs/cgroup/memory", path)) {
+          dir = d;
+          is_v1_ = true;
+        }
+      }
+    }
+    if (dir) {
+      current_fd_ = open_file(*dir / (is_v1_ ? "memory.usage_in_bytes" :
+          "memory.current"));
+      max_fd_ = open_file(*dir / (is_v1_ ? "memory.limit_in_bytes" :
+          "memory.max"));
+      if (!is_v1_)
+        pressure_fd_ = open_file(*dir / "memory.pressure");
+    }
+    if (pressure_fd_ < 0)
+      pressure_fd_ = open_file("/proc/pressure/memory");
+  }
+
+  /// @returns The sample of the memory usage.
+  Memory_usage sample() const
+  {
+    Memory_usage result;
+    char buf[512];
+    if (const auto data = read_file(statm_fd_, buf, sizeof(buf))) {
+      // The second field is the resident set size in pages.
+      const auto pos = data->find(' ');
+      if (pos != std::string_view::npos)
+        if (const auto pages = to_number(data->substr(pos + 1)))
+          result.rss = *pages * page_size_;
+    }
+    if (const auto data = read_file(current_fd_, buf, sizeof(buf)))
+      result.cgroup_current = to_number(*data);
+    if (const auto data = read_file(max_fd_, buf, sizeof(buf))) {
+      // "max" (v2) or the huge value (v1) means no limit.
+      const auto max = to_number(*data);
+      if (max && *max < (std::uint64_t{1} << 62))
+        result.cgroup_max = max;
+    }
+    if (const auto data = read_file(pressure_fd_, buf, sizeof(buf))) {
+      // some avg10=0.00 avg60=0.00 avg300=0.00 total=0
+      constexpr std::string_view key{"some avg10="};
+      if (data->substr(0, key.size()) == key) {
+        const auto value = data->substr(key.size());
+        double pressure{};
+        if (std::from_chars(value.data(), value.data() + value.size(),
+            pressure).ec == std::errc{})
+          result.pressure = pressure;
+      }
+    }
+    return result;
+  }
+
+private:
+  int statm_fd_{-1};
+  int current_fd_{-1};
+  int max_fd_{-1};
+  int pressure_fd_{-1};
+  std::uint64_t page_size_{};
+  bool is_v1_{};
+
+  /**
+   * @returns The directory of the cgroup `path` under `root`. If the `path`
+   * is not visible (e.g. in a cgroup namespace), returns `root`.
+   */
+  static std::optional<std::filesystem::path>
+  find_cgroup_dir(const std::filesystem::path& root, std::string_view path)
+  {
+    std::error_code ec;
+    while (!path.empty() && path.front() == '/')
+      path.remove_prefix(1);
+    if (auto result = root / path; is_directory(result, ec))
+      return result;
+    else if (is_directory(root, ec))
+      return root;
+    return std::nullopt;
+  }
+
+  static std::optional<std::string_view> read_file(const int fd, char* const buf,
+    const std::size_t size)
+  {
+    if (fd < 0)
+      return std::nullopt;
+    const auto count = pread(fd, buf, size, 0);
+    if (count <= 0)
+      return std::nullopt;
+    return std::string_view{buf, static_cast<std::size_t>(count)};
+  }
+
+  static std::optional<std::uint64_t> to_number(const std::string_view str)
+  {
+    std::uint64_t result{};
+    if (std::from_chars(str.data(), str.data() + str.size(), result).ec !=
+      std::errc{})
+      return std::nullopt;
+    return result;
+  }
+};
+
+// =============================================================================
+
+/**
+ * @brief The guard of the memory usage.
+ *
+ * @details The guard samples the memory usage in the background thread and:
+ *   - calls the registered callbacks when the soft limit is exceeded, and
+ *   when the usage gets back below it, so the application can shed load
+ *   (e.g. drop caches or reject requests);
+ *   - sets the stop signal when the hard limit is exceeded, so the
+ *   application can shut down in order before the OOM killer intervenes.
+ *
+ * The limits are compared with Memory_usage::used(), i.e. with the usage of
+ * the cgroup if it's limited, or with the resident set size of the process
+ * otherwise. The memory pressure (PSI) limit is the additional condition of
+ * the soft limit.
+ *
+ * The options of the guard are parsed by Memory_guard::Options::make().
+ *
+ * Since the background thread is not inherited by `fork()`, and `fork()` of
+ * the multi-threaded process is unsafe, the thread must be stopped by
+ * suspend() before `fork()` and restarted by resume() in both the parent and
+ * the child processes. (For the guard of the process-wide Info instance it's
+ * done by `Info::fork_process()`.) The thread restarted in the child process
+ * samples the memory usage of the child.
+ */
+class Memory_guard final : Noncopymove {
+public:
+  /// The options of the guard.
+  struct Options final {
+    /// The soft limit in bytes.
+    std::optional<std::uint64_t> soft_limit;
+
+    /// The hard limit in bytes.
+    std::optional<std::uint64_t> hard_limit;
+
+    /// The memory pressure (see Memory_usage::pressure) considered excessive.
+    std::optional<double> pressure_limit;
+
+    /// The interval of sampling.
+    std::chrono::milliseconds interval{250};
+
+    /// @returns `true` if any limit is specified.
+    bool is_enabled() const noexcept
+    {
+      return soft_limit || hard_limit || pressure_limit;
+    }
+
+    /// The names of the standard options.
+    static constexpr std::string_view option_names[]{"memory-soft-limit",
+      "memory-hard-limit", "memory-pressure-limit", "memory-check-interval"};
+
+    /**
+     * @returns The options parsed from the `command`.
+     *
+     * @details Corresponds to the following options:
+     *   - `--memory-soft-limit=size|n%` - the soft limit;
+     *   - `--memory-hard-limit=size|n%` - the hard limit;
+     *   - `--memory-pressure-limit=n` - the memory pressure limit in percents;
+     *   - `--memory-check-interval=ms` - the interval of sampling.
+     *
+     * The `size` is in the format of `--nofile` (see Resources), and `n%` is
+     * the percentage of the cgroup memory limit, or of the physical memory
+     * if the cgroup is not limited.
+     */
+    static Options make(const Command& command)
+    {
+      static const auto to_limit = [](const Command::Optref& opt)
+      {
+        const auto& value = opt.value_not_empty();
+        if (value.back() != '%')
+          return detail::to_size(value);
+
+        const auto percent = detail::to_size(std::string_view{value}
+          .substr(0, value.size() - 1));
+        if (!percent || percent > 100)
+          throw std::invalid_argument{std::string{"invalid value of option --"}
+            .append(opt.name())};
+        return physical_limit() / 100 * percent;
+      };
+
+      Options result;
+      const auto [soft, hard, pressure, interval] = command.options(
+        "memory-soft-limit", "memory-hard-limit", "memory-pressure-limit",
+        "memory-check-interval");
+      if (soft.is_valid_throw_if_no_value())
+        result.soft_limit = to_limit(soft);
+      if (hard.is_valid_throw_if_no_value())
+        result.hard_limit = to_limit(hard);
+      if (pressure.is_valid_throw_if_no_value()) {
+        const auto& value = pressure.value_not_empty();
+        double limit{};
+        const auto [ptr, ec] = std::from_chars(value.data(),
+          value.data() + value.size(), limit);
+        if (ec != std::errc{} || ptr != value.data() + value.size() ||
+          !(limit > 0 && limit <= 100))
+          throw std::invalid_argument{
+            "invalid value of option --memory-pressure-limit"};
+        result.pressure_limit = limit;
+      }
+      if (interval.is_valid_throw_if_no_value()) {
+        const auto ms = detail::to_size(interval.value_not_empty());
+        if (!ms)
+          throw std::invalid_argument{
+            "invalid value of option --memory-check-interval"};
+        result.interval = std::chrono::milliseconds{ms};
+      }
+      return result;
+    }
+  };
+
+  /**
+   * @brief The alias of the callback.
+   *
+   * @details The callback is called with `true` when the soft limit is
+   * exceeded, and with `false` when the usage gets back below it.
+   */
+  using Callback = std::function<void(bool is_exceeded,
+    const Memory_usage& usage)>;
+
+  /// The destructor. Stops the sampling.
+  ~Memory_guard()
+  {
+    stop();
+  }
+
+  /**
+   * @brief The constructor. Starts the sampling.
+   *
+   * @param stop_signal The stop signal to set to `stop_signal_value` when
+   * the hard limit is exceeded (usually `Info::stop_signal`).
+   */
+  Memory_guard(Options options, std::atomic_int& stop_signal,
+    const int stop_signal_value = SIGTERM)
+    : options_{std::move(options)}
+    , stop_signal_{stop_signal}
+    , stop_signal_value_{stop_signal_value}
+  {
+    if (options_.interval <= std::chrono::milliseconds::zero())
+      throw std::invalid_argument{"invalid interval of memory guard"};
+    start();
+  }
+
+  /// @returns The options.
+  const Options& options() const noexcept
+  {
+    return options_;
+  }
+
+  /**
+   * @brief Registers the `callback`.
+   *
+   * @details The callbacks are called in the thread of the guard. If the
+   * soft limit is currently exceeded, the `callback` is called with `true`
+   * on the next sampling.
+   */
+  void add_callback(Callback callback)
+  {
+    if (!callback)
+      throw std::invalid_argument{"invalid callback of memory guard"};
+    const std::lock_guard lock{mutex_};
+    callbacks_.push_back(std::move(callback));
+    is_notified_.push_back(false);
+  }
+
+  /// @returns The last sample.
+  Memory_usage usage() const
+  {
+    const std::lock_guard lock{mutex_};
+    return usage_;
+  }
+
+  /// @returns `true` if the soft limit is exceeded by the last sample.
+  bool is_soft_limit_exceeded() const noexcept
+  {
+    return is_soft_limit_exceeded_.load(std::memory_order_relaxed);
+  }
+
+  /// @returns `true` if the hard limit has been exceeded.
+  bool is_hard_limit_exceeded() const noexcept
+  {
+    return is_hard_limit_exceeded_.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Stops the sampling until the paired call of resume().
+   *
+   * @details The calls can be nested, so the sampling is resumed by the last
+   * resume().
+   *
+   * @remarks Has no effect on the sampling if called from the callback of
+   * the guard.
+   */
+  void suspend()
+  {
+    const std::lock_guard lock{suspend_mutex_};
+    if (!suspend_count_++)
+      stop();
+  }
+
+  /// Resumes the sampling suspended by suspend().
+  void resume()
+  {
+    const std::lock_guard lock{suspend_mutex_};
+    if (suspend_count_ && !--suspend_count_)
+      start();
+  }
+
+  /**
+   * @returns The memory limit of the cgroup of the process, or the physical
+   * memory size if the cgroup is not limited.
+   */
+  static std::uint64_t physical_limit()
+  {
+    const auto pages = sysconf(_SC_PHYS_PAGES);
+    const auto page_size = sysconf(_SC_PAGESIZE);
+    const auto physical = pages > 0 && page_size > 0 ?
+      static_cast<std::uint64_t>(pages) * static_cast<std::uint64_t>(page_size) :
+      std::uint64_t{};
+    if (const auto max = Memory_sampler{}.sample().cgroup_max)
+      return physical ? std::min(*max, physical) : *max;
+    return physical;
+  }
+
+private:
+  Options options_;
+  std::atomic_int& stop_signal_;
+  int stop_signal_value_{};
+  std::optional<Memory_sampler> sampler_;
+  pid_t sampler_pid_{};
+  std::mutex suspend_mutex_;
+  int suspend_count_{}; // guarded by suspend_mutex_
+  mutable std::mutex mutex_;
+  std::condition_variable cond_;
+  bool is_stopping_{};
+  Memory_usage usage_;
+  std::vector<Callback> callbacks_;
+  std::vector<bool> is_notified_;
+  std::atomic_bool is_soft_limit_exceeded_{};
+  std::atomic_bool is_hard_limit_exceeded_{};
+  std::thread thread_;
+
+  /**
+   * @brief Starts the thread if it's not running. The sampler is recreated
+   * in the child process.
+   */
+  void start()
+  {
+    if (thread_.joinable())
+      return;
+    if (const auto pid = getpid(); !sampler_ || sampler_pid_ != pid) {
+      sampler_.emplace();
+      sampler_pid_ = pid;
+    }
+    {
+      const std::lock_guard lock{mutex_};
+      is_stopping_ = false;
+    }
+    thread_ = std::thread{[this]{run();}};
+  }
+
+  /// Stops the thread unless called from it.
+  void stop()
+  {
+    if (!thread_.joinable() || thread_.get_id() == std::this_thread::get_id())
+      return;
+    {
+      const std::lock_guard lock{mutex_};
+      is_stopping_ = true;
+    }
+    cond_.notify_one();
+    thread_.join();
+  }
+
+  void run()
+  {
+    std::unique_lock lock{mutex_};
+    while (!is_stopping_) {
+      lock.unlock();
+      const auto usage = sampler_->sample();
+      const auto used = usage.used();
+      const bool is_soft_exceeded{
+        (options_.soft_limit && used && *used >= *options_.soft_limit) ||
+        (options_.pressure_limit && usage.pressure &&
+          *usage.pressure >= *options_.pressure_limit)};
+      is_soft_limit_exceeded_.store(is_soft_exceeded, std::memory_order_relaxed);
+      if (options_.hard_limit && used && *used >= *options_.hard_limit) {
+        is_hard_limit_exceeded_.store(true, std::memory_order_relaxed);
+        int expected{};
+        stop_signal_.compare_exchange_strong(expected, stop_signal_value_);
+      }
+      lock.lock();
+      usage_ = usage;
+
+      // Notify about the changes of the state.
+      for (std::size_t i{}; i < callbacks_.size(); ++i) {
+        if (is_notified_[i] != is_soft_exceeded) {
+          is_notified_[i] = is_soft_exceeded;
+          const auto callback = callbacks_[i];
+          lock.unlock();
+          try {
+            callback(is_soft_exceeded, usage);
+          } catch (...) {}
+          lock.lock();
+        }
+      }
+
+      cond_.wait_for(lock, options_.interval, [this]{return is_stopping_;});
+    }
+  }
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_MEMORY_HPP
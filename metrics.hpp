@@ -0,0 +1,678 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_METRICS_HPP
+#define DMITIGR_PRG_METRICS_HPP
+
+#ifdef _WIN32
+#error dmitigr/prg/metrics.hpp is not usable on Windows!
+#endif
+
+#include "../base/fsx.hpp"
+#include "../base/noncopymove.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace dmitigr::prg {
+
+/**
+ * @brief The binary layout of the metrics file.
+ *
+ * @details The file consists of:
+ *   - the Header at offset 0;
+ *   - `max_metrics` of Descriptor at `descriptors_offset`;
+ *   - `shard_count` of shards at `shards_offset`, each of `shard_size` bytes
+ *   (a multiple of 64) consisting of 64-bit slots.
+ *
+ * The values are in the native byte order. The slots are written atomically.
+ * The slots of metric are allocated at the same indexes in each shard:
+ *   - counter: 1 slot, the value is the sum of slots of all shards;
+ *   - gauge: 1 slot, the value (signed) is in the shard 0;
+ *   - histogram with `n` bounds: `n + 1` slots of bucket counts (the last
+ *   bucket is for the values greater than the last bound) and 1 slot of the
+ *   sum of observed values, each is summed across the shards, followed by
+ *   `n` slots of the bounds in the shard 0.
+ *
+ * The descriptors are immutable after publishing by the increment of
+ * `Header::metric_count`.
+ */
+namespace metrics_layout {
+
+/// The magic of the metrics file.
+constexpr char magic[8]{'D', 'M', 'P', 'R', 'G', 'M', 'T', 'R'};
+
+/// The version of the layout.
+constexpr std::uint32_t version{1};
+
+/// The kind of metric.
+enum class Kind : std::uint32_t {
+  /// A monotonic counter.
+  counter = 1,
+  /// A gauge.
+  gauge = 2,
+  /// A histogram.
+  histogram = 3
+};
+
+/// The header of the metrics file.
+struct Header final {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t header_size;
+  std::uint32_t descriptor_size;
+  std::uint32_t max_metrics;
+  std::uint32_t shard_count;
+  std::uint32_t shard_size;
+  std::uint64_t descriptors_offset;
+  std::uint64_t shards_offset;
+  std::uint64_t pid;
+  std::uint32_t metric_count; // accessed atomically
+  std::uint32_t reserved;
+};
+static_assert(sizeof(Header) == 64);
+
+/// The maximum length of metric name.
+constexpr std::size_t max_name_size{95};
+
+/// The descriptor of metric.
+struct Descriptor final {
+  char name[max_name_size + 1]; // null-terminated
+  Kind kind;
+  std::uint32_t slot;
+  std::uint32_t slot_count;
+  std::uint32_t bound_count;
+  std::uint64_t reserved[2];
+};
+static_assert(sizeof(Descriptor) == 128);
+
+} // namespace metrics_layout
+
+namespace detail {
+
+/// @returns The slot at `ptr` as atomic.
+inline std::atomic_ref<std::uint64_t> metric_slot(std::uint64_t* const ptr) noexcept
+{
+  return std::atomic_ref<std::uint64_t>{*ptr};
+}
+
+/// @returns The index of the shard of the calling thread.
+inline std::uint32_t metric_shard(const std::uint32_t shard_count) noexcept
+{
+  static constinit std::atomic_uint32_t next{};
+  static constinit thread_local std::uint32_t index{
+    std::numeric_limits<std::uint32_t>::max()};
+  if (index == std::numeric_limits<std::uint32_t>::max())
+    index = next.fetch_add(1, std::memory_order_relaxed);
+  return index % shard_count;
+}
+
+} // namespace detail
+
+/// The options of Metrics_registry.
+struct Metrics_options final {
+  /// The maximum number of metrics.
+  std::uint32_t max_metrics{1024};
+
+  /// The maximum number of slots (see metrics_layout).
+  std::uint32_t max_slots{8192};
+
+  /// The number of shards, or `0` to use the number of CPUs.
+  std::uint32_t shard_count{};
+};
+
+/**
+ * @brief A monotonic counter.
+ *
+ * @details The updates are sharded by thread (see metrics_layout).
+ */
+class Counter final {
+public:
+  /// The default constructor. Constructs invalid instance.
+  Counter() = default;
+
+  /// @returns `true` if the instance is valid.
+  bool is_valid() const noexcept
+  {
+    return base_;
+  }
+
+  /// Adds the `value`.
+  void add(const std::uint64_t value = 1) const noexcept
+  {
+    detail::metric_slot(slot(detail::metric_shard(shard_count_)))
+      .fetch_add(value, std::memory_order_relaxed);
+  }
+
+private:
+  friend class Metrics_registry;
+  std::byte* base_{};
+  std::uint32_t shard_size_{};
+  std::uint32_t shard_count_{};
+
+  Counter(std::byte* const base, const std::uint32_t shard_size,
+    const std::uint32_t shard_count) noexcept
+    : base_{base}
+    , shard_size_{shard_size}
+    , shard_count_{shard_count}
+  {}
+
+  std::uint64_t* slot(const std::uint32_t shard) const noexcept
+  {
+    return reinterpret_cast<std::uint64_t*>(base_ + std::size_t{shard} * shard_size_);
+  }
+};
+
+/// A gauge.
+class Gauge final {
+public:
+  /// The default constructor. Constructs invalid instance.
+  Gauge() = default;
+
+  /// @returns `true` if the instance is valid.
+  bool is_valid() const noexcept
+  {
+    return slot_;
+  }
+
+  /// Sets the `value`.
+  void set(const std::int64_t value) const noexcept
+  {
+    detail::metric_slot(slot_).store(static_cast<std::uint64_t>(value),
+      std::memory_order_relaxed);
+  }
+
+  /// Adds the `value`.
+  void add(const std::int64_t value) const noexcept
+  {
+    detail::metric_slot(slot_).fetch_add(static_cast<std::uint64_t>(value),
+      std::memory_order_relaxed);
+  }
+
+  /// @returns The value.
+  std::int64_t value() const noexcept
+  {
+    return static_cast<std::int64_t>(detail::metric_slot(slot_)
+      .load(std::memory_order_relaxed));
+  }
+
+private:
+  friend class Metrics_registry;
+  std::uint64_t* slot_{};
+
+  explicit Gauge(std::uint64_t* const slot) noexcept
+    : slot_{slot}
+  {}
+};
+
+/**
+ * @brief A histogram with fixed buckets.
+ *
+ * @details The updates are sharded by thread (see metrics_layout).
+ */
+class Histogram final {
+public:
+  /// The default constructor. Constructs invalid instance.
+  Histogram() = default;
+
+  /// @returns `true` if the instance is valid.
+  bool is_valid() const noexcept
+  {
+    return base_;
+  }
+
+  /// Observes the `value`.
+  void observe(const std::uint64_t value) const noexcept
+  {
+    const auto bucket = static_cast<std::size_t>(
+      std::lower_bound(bounds_, bounds_ + bound_count_, value) - bounds_);
+    auto* const slots = reinterpret_cast<std::uint64_t*>(base_ +
+      std::size_t{detail::metric_shard(shard_count_)} * shard_size_);
+    detail::metric_slot(slots + bucket).fetch_add(1, std::memory_order_relaxed);
+    detail::metric_slot(slots + bound_count_ + 1).fetch_add(value,
+      std::memory_order_relaxed);
+  }
+
+private:
+  friend class Metrics_registry;
+  std::byte* base_{};
+  const std::uint64_t* bounds_{};
+  std::uint32_t bound_count_{};
+  std::uint32_t shard_size_{};
+  std::uint32_t shard_count_{};
+
+  Histogram(std::byte* const base, const std::uint64_t* const bounds,
+    const std::uint32_t bound_count, const std::uint32_t shard_size,
+    const std::uint32_t shard_count) noexcept
+    : base_{base}
+    , bounds_{bounds}
+    , bound_count_{bound_count}
+    , shard_size_{shard_size}
+    , shard_count_{shard_count}
+  {}
+};
+
+// =============================================================================
+
+/**
+ * @brief The registry of metrics stored in the memory-mapped file.
+ *
+ * @details The metrics are updated by atomic instructions on the shared
+ * mapping without system calls and locks, and the external process can read
+ * them by mapping the file (see Metrics_reader and metrics_layout). Only the
+ * registration of metrics takes the lock.
+ *
+ * @par Thread safety
+ * All the members are thread-safe.
+ */
+class Metrics_registry final : Noncopymove {
+public:
+  /// The destructor. Removes the file.
+  ~Metrics_registry()
+  {
+    if (data_) {
+      munmap(data_, size_);
+      unlink(path_.c_str());
+    }
+  }
+
+  /**
+   * @brief The constructor. Creates (or truncates) the file at `path`.
+   *
+   * @see default_path().
+   */
+  explicit Metrics_registry(std::filesystem::path path,
+    Metrics_options options = {})
+    : path_{std::move(path)}
+  {
+    using namespace metrics_layout;
+
+    if (!options.max_metrics || !options.max_slots)
+      throw std::invalid_argument{"invalid options of metrics registry"};
+    if (!options.shard_count)
+      options.shard_count = std::clamp(std::thread::hardware_concurrency(), 1u, 256u);
+
+    const auto shard_size = (std::uint64_t{options.max_slots} * 8 + 63) / 64 * 64;
+    const auto descriptors_offset = sizeof(Header);
+    const auto shards_offset = (descriptors_offset +
+      std::uint64_t{options.max_metrics} * sizeof(Descriptor) + 4095) / 4096 * 4096;
+    const auto size = shards_offset + shard_size * options.shard_count;
+    if (shard_size > std::numeric_limits<std::uint32_t>::max())
+      throw std::invalid_argument{"too many slots of metrics registry"};
+
+    const int fd{open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)};
+    if (fd < 0)
+      throw std::system_error{errno, std::system_category(),
+        std::string{"cannot open metrics file "}.append(path_.string())};
+    if (ftruncate(fd, static_cast<off_t>(size))) {
+      const int err{errno};
+      close(fd);
+      unlink(path_.c_str());
+      throw std::system_error{err, std::system_category(),
+        "cannot resize metrics file"};
+    }
+    void* const data{mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)};
+    const int err{errno};
+    close(fd);
+    if (data == MAP_FAILED) {
+      unlink(path_.c_str());
+      throw std::system_error{err, std::system_category(),
+        "cannot map metrics file"};
+    }
+    data_ = static_cast<std::byte*>(data);
+    size_ = size;
+    max_slots_ = options.max_slots;
+
+    auto& header = this->header();
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.header_size = sizeof(Header);
+    header.descriptor_size = sizeof(Descriptor);
+    header.max_metrics = options.max_metrics;
+    header.shard_count = options.shard_count;
+    header.shard_size = static_cast<std::uint32_t>(shard_size);
+    header.descriptors_offset = descriptors_offset;
+    header.shards_offset = shards_offset;
+    header.pid = static_cast<std::uint64_t>(getpid());
+  }
+
+  /**
+   * @returns The default path of the metrics file of the program `name`:
+   * `<runtime directory>/<name>.<pid>.metrics`, where the runtime directory
+   * is `$XDG_RUNTIME_DIR` if set, or `/dev/shm` if exists, or the temporary
+   * directory otherwise. (The file should reside in memory-backed file system
+   * to avoid the writeback of the updates to disk.)
+   */
+  static std::filesystem::path default_path(const std::string_view name)
+  {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    const char* const runtime_dir{std::getenv("XDG_RUNTIME_DIR")};
+    const fs::path dir{runtime_dir && *runtime_dir ? fs::path{runtime_dir} :
+      is_directory(fs::path{"/dev/shm"}, ec) ? fs::path{"/dev/shm"} :
+      fs::temp_directory_path()};
+    return dir / std::string{name}.append(".")
+      .append(std::to_string(getpid())).append(".metrics");
+  }
+
+  /// @returns The path to the metrics file.
+  const std::filesystem::path& path() const noexcept
+  {
+    return path_;
+  }
+
+  /**
+   * @returns The counter `name`. Registers it if not registered.
+   *
+   * @throws `std::runtime_error` if the capacity is exhausted, or if the
+   * metric `name` of other kind is registered.
+   */
+  Counter counter(const std::string_view name)
+  {
+    const std::lock_guard lock{mutex_};
+    const auto& desc = descriptor(name, metrics_layout::Kind::counter, {});
+    return Counter{shard(0) + desc.slot * 8, header().shard_size,
+      header().shard_count};
+  }
+
+  /// @returns The gauge `name`. Registers it if not registered.
+  Gauge gauge(const std::string_view name)
+  {
+    const std::lock_guard lock{mutex_};
+    const auto& desc = descriptor(name, metrics_layout::Kind::gauge, {});
+    return Gauge{reinterpret_cast<std::uint64_t*>(shard(0) + desc.slot * 8)};
+  }
+
+  /**
+   * @returns The histogram `name` with the sorted upper `bounds` of buckets.
+   * Registers it if not registered.
+   *
+   * @par Requires
+   * `bounds` are strictly increasing.
+   */
+  Histogram histogram(const std::string_view name,
+    const std::vector<std::uint64_t>& bounds)
+  {
+    if (std::adjacent_find(bounds.begin(), bounds.end(),
+        std::greater_equal<>{}) != bounds.end())
+      throw std::invalid_argument{"invalid bounds of histogram"};
+
+    const std::lock_guard lock{mutex_};
+    const auto& desc = descriptor(name, metrics_layout::Kind::histogram, bounds);
+    auto* const base = shard(0) + desc.slot * 8;
+    return Histogram{base,
+      reinterpret_cast<const std::uint64_t*>(base) + desc.bound_count + 2,
+      desc.bound_count, header().shard_size, header().shard_count};
+  }
+
+private:
+  std::filesystem::path path_;
+  std::byte* data_{};
+  std::size_t size_{};
+  std::uint32_t max_slots_{};
+  std::uint32_t slot_count_{};
+  std::map<std::string, std::uint32_t, std::less<>> indexes_;
+  std::mutex mutex_;
+
+  metrics_layout::Header& header() const noexcept
+  {
+    return *reinterpret_cast<metrics_layout::Header*>(data_);
+  }
+
+  std::byte* shard(const std::uint32_t index) const noexcept
+  {
+    const auto& h = header();
+    return data_ + h.shards_offset + std::size_t{index} * h.shard_size;
+  }
+
+  metrics_layout::Descriptor& descriptor_at(const std::uint32_t index) const noexcept
+  {
+    return reinterpret_cast<metrics_layout::Descriptor*>(
+      data_ + header().descriptors_offset)[index];
+  }
+
+  const metrics_layout::Descriptor& descriptor(const std::string_view name,
+    const metrics_layout::Kind kind, const std::vector<std::uint64_t>& bounds)
+  {
+    using metrics_layout::Kind;
+
+    if (const auto i = indexes_.find(name); i != indexes_.end()) {
+      const auto& result = descriptor_at(i->second);
+      if (result.kind != kind || (kind == Kind::histogram &&
+          !std::equal(bounds.begin(), bounds.end(),
+            reinterpret_cast<const std::uint64_t*>(shard(0) + result.slot * 8) +
+            result.bound_count + 2, reinterpret_cast<const std::uint64_t*>(
+              shard(0) + result.slot * 8) + 2 * result.bound_count + 2)))
+        throw std::runtime_error{std::string{"metric "}.append(name)
+          .append(" is already registered with other kind or bounds")};
+      return result;
+    }
+
+    if (name.empty() || name.size() > metrics_layout::max_name_size ||
+      name.find('\0') != std::string_view::npos)
+      throw std::invalid_argument{std::string{"invalid metric name \""}
+        .append(name).append("\"")};
+
+    auto& h = header();
+    const auto index = std::atomic_ref<std::uint32_t>{h.metric_count}
+      .load(std::memory_order_relaxed);
+    const auto bound_count = static_cast<std::uint32_t>(bounds.size());
+    const auto slot_count = kind == Kind::histogram ? 2 * bound_count + 2 : 1;
+    if (index == h.max_metrics || slot_count > max_slots_ - slot_count_)
+      throw std::runtime_error{"metrics registry is full"};
+
+    auto& result = descriptor_at(index);
+    std::memcpy(result.name, name.data(), name.size());
+    result.kind = kind;
+    result.slot = slot_count_;
+    result.slot_count = slot_count;
+    result.bound_count = bound_count;
+    if (kind == Kind::histogram)
+      std::copy(bounds.begin(), bounds.end(),
+        reinterpret_cast<std::uint64_t*>(shard(0) + result.slot * 8) +
+        bound_count + 2);
+    slot_count_ += slot_count;
+    indexes_.emplace(name, index);
+    std::atomic_ref<std::uint32_t>{h.metric_count}.store(index + 1,
+      std::memory_order_release);
+    return result;
+  }
+};
+
+// =============================================================================
+
+/// A value of metric read by Metrics_reader.
+struct Metric_value final {
+  /// The name.
+  std::string name;
+
+  /// The kind.
+  metrics_layout::Kind kind{};
+
+  /// The value of counter or gauge (cast to signed), or the count of histogram.
+  std::uint64_t value{};
+
+  /// The upper bounds of buckets of histogram.
+  std::vector<std::uint64_t> bounds;
+
+  /// The counts of buckets of histogram (`bounds.size() + 1`).
+  std::vector<std::uint64_t> buckets;
+
+  /// The sum of the observed values of histogram.
+  std::uint64_t sum{};
+};
+
+/**
+ * @brief The reader of the metrics file written by Metrics_registry.
+ *
+ * @details Intended to be used by the external process.
+ */
+class Metrics_reader final : Noncopymove {
+public:
+  /// The destructor.
+  ~Metrics_reader()
+  {
+    if (data_)
+      munmap(data_, size_);
+  }
+
+  /**
+   * @brief The constructor. Maps the file at `path`.
+   *
+   * @throws `std::runtime_error` if the file is not a metrics file of the
+   * supported version.
+   */
+  explicit Metrics_reader(const std::filesystem::path& path)
+  {
+    using namespace metrics_layout;
+
+    const int fd{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (fd < 0)
+      throw std::system_error{errno, std::system_category(),
+        std::string{"cannot open metrics file "}.append(path.string())};
+    struct stat st{};
+    if (fstat(fd, &st) || static_cast<std::size_t>(st.st_size) < sizeof(Header)) {
+      close(fd);
+      throw std::runtime_error{std::string{"invalid metrics file "}
+        .append(path.string())};
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+    void* const data{mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0)};
+    const int err{errno};
+    close(fd);
+    if (data == MAP_FAILED)
+      throw std::system_error{err, std::system_category(),
+        "cannot map metrics file"};
+    data_ = static_cast<std::byte*>(data);
+
+    const auto& h = header();
+    if (std::memcmp(h.magic, magic, sizeof(magic)) || h.version != version ||
+      h.header_size != sizeof(Header) || h.descriptor_size != sizeof(Descriptor) ||
+      h.descriptors_offset + std::uint64_t{h.max_metrics} * sizeof(Descriptor) >
+      size_ || h.shards_offset + std::uint64_t{h.shard_count} * h.shard_size > size_)
+      throw std::runtime_error{std::string{"invalid metrics file "}
+        .append(path.string())};
+  }
+
+  /// @returns The PID of the writer.
+  std::uint64_t pid() const noexcept
+  {
+    return header().pid;
+  }
+
+  /// @returns The current values of all the published metrics.
+  std::vector<Metric_value> read() const
+  {
+    using metrics_layout::Descriptor;
+    using metrics_layout::Kind;
+
+    const auto& h = header();
+    const auto count = std::min(load32(h.metric_count), h.max_metrics);
+    const auto* const descs = reinterpret_cast<const Descriptor*>(
+      data_ + h.descriptors_offset);
+    const auto slot_limit = h.shard_size / 8;
+    const auto sum = [this, &h](const std::uint32_t slot)
+    {
+      std::uint64_t result{};
+      for (std::uint32_t i{}; i < h.shard_count; ++i)
+        result += load64(i, slot);
+      return result;
+    };
+
+    std::vector<Metric_value> result;
+    result.reserve(count);
+    for (std::uint32_t i{}; i < count; ++i) {
+      const auto& desc = descs[i];
+      if (desc.slot + std::uint64_t{desc.slot_count} > slot_limit)
+        continue;
+
+      Metric_value value;
+      value.name.assign(desc.name, strnlen(desc.name, sizeof(desc.name)));
+      value.kind = desc.kind;
+      switch (desc.kind) {
+      case Kind::counter:
+        value.value = sum(desc.slot);
+        break;
+      case Kind::gauge:
+        value.value = load64(0, desc.slot);
+        break;
+      case Kind::histogram:
+        for (std::uint32_t j{}; j <= desc.bound_count; ++j) {
+          value.buckets.push_back(sum(desc.slot + j));
+          value.value += value.buckets.back();
+        }
+        value.sum = sum(desc.slot + desc.bound_count + 1);
+        for (std::uint32_t j{}; j < desc.bound_count; ++j)
+          value.bounds.push_back(load64(0, desc.slot + desc.bound_count + 2 + j));
+        break;
+      default:
+        continue;
+      }
+      result.push_back(std::move(value));
+    }
+    return result;
+  }
+
+private:
+  std::byte* data_{};
+  std::size_t size_{};
+
+  const metrics_layout::Header& header() const noexcept
+  {
+    return *reinterpret_cast<const metrics_layout::Header*>(data_);
+  }
+
+  static std::uint32_t load32(const std::uint32_t& value) noexcept
+  {
+    return std::atomic_ref<std::uint32_t>{const_cast<std::uint32_t&>(value)}
+      .load(std::memory_order_acquire);
+  }
+
+  std::uint64_t load64(const std::uint32_t shard,
+    const std::uint32_t slot) const noexcept
+  {
+    const auto& h = header();
+    auto* const ptr = reinterpret_cast<std::uint64_t*>(data_ + h.shards_offset +
+      std::size_t{shard} * h.shard_size) + slot;
+    return detail::metric_slot(ptr).load(std::memory_order_relaxed);
+  }
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_METRICS_HPP
@@ -0,0 +1,151 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_MULTICALL_HPP
+#define DMITIGR_PRG_MULTICALL_HPP
+
+#include "../base/assert.hpp"
+#include "../base/fsx.hpp"
+#include "info.hpp"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace dmitigr::prg {
+
+/**
+ * @brief A registry of programs of a multi-call (busybox-style) executable.
+ *
+ * @details The single executable contains many programs and selects the one
+ * to run by the file name of `argv[0]` (so the programs are usually
+ * installed as symbolic or hard links to the executable), or by the first
+ * argument otherwise (e.g. `tools ls -l`). Since all the programs share the
+ * one executable image, it's likely warm in the page cache.
+ */
+class Multicall final {
+public:
+  /// The alias of the program entry point.
+  using Main = std::function<int(int argc, const char* const* argv)>;
+
+  /// The alias of the program info factory.
+  using Make_info = std::function<std::unique_ptr<Info>()>;
+
+  /**
+   * @brief Registers the program.
+   *
+   * @param name The name of the program.
+   * @param main The entry point of the program.
+   * @param make_info The factory of the program info. If specified, the
+   * result is passed to `Info::initialize()` before calling `main`.
+   *
+   * @par Requires
+   * `!name.empty() && main` and no program with the same `name` registered.
+   *
+   * @returns `*this`.
+   */
+  Multicall& add(std::string name, Main main, Make_info make_info = {})
+  {
+    if (name.empty())
+      throw std::invalid_argument{"empty program name"};
+    else if (!main)
+      throw std::invalid_argument{std::string{"invalid main of program "}
+        .append(name)};
+
+    const auto [i, inserted] = programs_.try_emplace(std::move(name),
+      Program{std::move(main), std::move(make_info)});
+    if (!inserted)
+      throw std::invalid_argument{std::string{"program "}.append(i->first)
+        .append(" is already registered")};
+    return *this;
+  }
+
+  /// @returns The sorted names of the registered programs.
+  std::vector<std::string> names() const
+  {
+    std::vector<std::string> result;
+    result.reserve(programs_.size());
+    for (const auto& [name, program] : programs_)
+      result.push_back(name);
+    return result;
+  }
+
+  /// @returns `true` if the program `name` is registered.
+  bool contains(const std::string_view name) const
+  {
+    return programs_.find(name) != programs_.end();
+  }
+
+  /**
+   * @brief Selects the program and runs it.
+   *
+   * @details If no program matches the file name of `argv[0]`, the first
+   * argument is considered as the program name and the arguments are
+   * shifted (so the program gets its name as `argv[0]`).
+   *
+   * @returns The result of the program.
+   *
+   * @throws `std::runtime_error` if no program selected.
+   *
+   * @par Requires
+   * `argc > 0 && argv && argv[0]`.
+   */
+  int run(int argc, const char* const* argv) const
+  {
+    if (argc <= 0 || !argv || !argv[0])
+      throw std::invalid_argument{"invalid arguments of multi-call executable"};
+
+    const auto find = [this](const char* const arg)
+    {
+      return programs_.find(std::filesystem::path{arg}.filename().string());
+    };
+    auto i = find(argv[0]);
+    if (i == programs_.end() && argc > 1 && argv[1]) {
+      i = find(argv[1]);
+      if (i != programs_.end()) {
+        --argc;
+        ++argv;
+      }
+    }
+    if (i == programs_.end()) {
+      std::string message{"no program selected; available programs are:"};
+      for (const auto& [name, program] : programs_)
+        message.append(" ").append(name);
+      throw std::runtime_error{message};
+    }
+
+    const auto& program = i->second;
+    if (program.make_info)
+      Info::initialize(program.make_info(), argc, argv);
+    return program.main(argc, argv);
+  }
+
+private:
+  struct Program final {
+    Main main;
+    Make_info make_info;
+  };
+  std::map<std::string, Program, std::less<>> programs_;
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_MULTICALL_HPP
@@ -17,8 +17,33 @@
 #ifndef DMITIGR_PRG_HPP
 #define DMITIGR_PRG_HPP
 
+#include "affinity.hpp"
+#include "cancellation.hpp"
+#include "checkpoint.hpp"
 #include "command.hpp"
+#include "executor.hpp"
+#include "exit.hpp"
+#include "identity.hpp"
 #include "info.hpp"
+#include "multicall.hpp"
+#include "resources.hpp"
+#include "startup.hpp"
+#include "static_info.hpp"
+#include "tokenizer.hpp"
 #include "util.hpp"
 
+#ifndef _WIN32
+#include "batch.hpp"
+#include "daemon.hpp"
+#include "deadline.hpp"
+#include "handoff.hpp"
+#include "log.hpp"
+#include "memory.hpp"
+#include "metrics.hpp"
+#include "profiler.hpp"
+#include "recorder.hpp"
+#include "supervisor.hpp"
+#include "zygote.hpp"
+#endif
+
 #endif  // DMITIGR_PRG_HPP
@@ -0,0 +1,554 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_PROFILER_HPP
+#define DMITIGR_PRG_PROFILER_HPP
+
+#ifdef _WIN32
+#error dmitigr/prg/profiler.hpp is not usable on Windows!
+#endif
+
+#include "../base/fsx.hpp"
+#include "../base/noncopymove.hpp"
+#include "exit.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+namespace dmitigr::prg {
+
+/// The options of Sampling_profiler.
+struct Sampling_options final {
+  /// The number of samples per second of the CPU time consumed by the process.
+  int frequency{99};
+
+  /**
+   * The size of the preallocated buffer of samples in frames. The samples
+   * which don't fit are dropped.
+   */
+  std::size_t buffer_size{1024*1024};
+};
+
+/**
+ * @brief The in-process sampling profiler.
+ *
+ * @details The samples are taken by the `SIGPROF` handler triggered by
+ * `setitimer(ITIMER_PROF)`, i.e. in the threads which consume CPU. The
+ * handler captures the stack into the preallocated buffer reserving the
+ * space with an atomic increment. On stop() the samples are aggregated and
+ * written to the output in the folded format (`frame;frame;frame count`)
+ * consumed by the flame graph tools.
+ *
+ * The stack is captured by walking the chain of frame pointers of the
+ * interrupted context rather than by the unwinder (`backtrace()`), since the
+ * unwinder is not async-signal-safe. The chain is followed while the frames
+ * are ascending within the stack, and the memory is read by
+ * `process_vm_readv()`, so an invalid frame pointer stops the walk instead
+ * of faulting. Thus, the stacks are truncated at the frames compiled without
+ * frame pointers (see `-fno-omit-frame-pointer`). The walk is implemented
+ * for x86-64 and AArch64 only, on other architectures no samples are taken.
+ *
+ * The profiling can be started and stopped:
+ *   - by the standard option `--profile=PATH` (see `Info::initialize()`);
+ *   - by the signal (see set_toggle_signal() and `set_profiler_signal()`);
+ *   - by start() and stop().
+ *
+ * While running, the profiler is registered in Exit_sinks, so the output is
+ * written on fast_exit() as well.
+ *
+ * @remarks The frames are symbolized by `dladdr()`, which sees only the
+ * dynamic symbols. Thus, the executable should be linked with `-rdynamic`,
+ * otherwise its frames are written as `[module]`.
+ *
+ * @remarks `SIGPROF` is used exclusively since the first start().
+ */
+class Sampling_profiler final : Noncopymove {
+public:
+  /// The maximum number of frames in the sample.
+  static constexpr int max_depth{64};
+
+  /// The destructor. Calls stop().
+  ~Sampling_profiler()
+  {
+    try {
+      stop();
+    } catch (const std::exception& e) {
+      std::cerr << "cannot stop sampling profiler: " << e.what() << std::endl;
+    } catch (...) {}
+
+    if (toggle_write_fd_ >= 0) {
+      toggle_fd_.store(-1);
+      close(toggle_write_fd_); // makes the service thread to return
+      toggle_thread_.join();
+    }
+  }
+
+  /// @returns The process-wide instance.
+  static Sampling_profiler& instance()
+  {
+    static Sampling_profiler result;
+    return result;
+  }
+
+  /**
+   * @brief Sets the output of stop().
+   *
+   * @param path The path to the file to write the folded stacks to, or empty
+   * path to write nothing. The file is rewritten on each stop().
+   */
+  void set_output(std::filesystem::path path)
+  {
+    const std::lock_guard lock{mutex_};
+    output_ = std::move(path);
+    make_output_ = {};
+  }
+
+  /**
+   * @brief Sets the output of stop() to the result of `make_path` called on
+   * each stop() (e.g. to include the ID of the process, which may change
+   * after `fork()`).
+   */
+  void set_output(std::function<std::filesystem::path()> make_path)
+  {
+    const std::lock_guard lock{mutex_};
+    output_.clear();
+    make_output_ = std::move(make_path);
+  }
+
+  /// @returns The output of stop().
+  std::filesystem::path output() const
+  {
+    const std::lock_guard lock{mutex_};
+    return make_output_ ? make_output_() : output_;
+  }
+
+  /// @returns `true` if the profiling is running.
+  bool is_running() const noexcept
+  {
+    return active_.load() != nullptr;
+  }
+
+  /**
+   * @brief Discards the samples of the previous run and starts the profiling.
+   *
+   * @par Requires
+   * `!is_running() && options.frequency > 0 && options.buffer_size > 0`.
+   */
+  void start(const Sampling_options& options = {})
+  {
+    if (options.frequency <= 0 || options.frequency > 1000000)
+      throw std::invalid_argument{"invalid frequency of sampling profiler"};
+    else if (!options.buffer_size)
+      throw std::invalid_argument{"invalid buffer size of sampling profiler"};
+
+    const std::lock_guard lock{mutex_};
+    if (is_running())
+      throw std::logic_error{"sampling profiler is already running"};
+
+    buffer_ = std::make_unique<std::uintptr_t[]>(options.buffer_size);
+    buffer_size_ = options.buffer_size;
+    next_ = 0;
+    sample_count_ = 0;
+    dropped_count_ = 0;
+    options_ = options;
+
+    /*
+     * The handler is left installed after stop(), since the pending SIGPROF
+     * would terminate the process otherwise.
+     */
+    if (!is_handler_installed_) {
+      struct sigaction sa{};
+      sa.sa_sigaction = &handle_sigprof;
+      sa.sa_flags = SA_RESTART | SA_SIGINFO;
+      sigemptyset(&sa.sa_mask);
+      if (sigaction(SIGPROF, &sa, nullptr))
+        throw std::system_error{errno, std::system_category(),
+          "cannot set SIGPROF handler"};
+      Signal_handlers::add(SIGPROF);
+      is_handler_installed_ = true;
+    }
+    active_ = this;
+
+    const long period{1000000 / options.frequency}; // microseconds
+    itimerval timer{};
+    timer.it_interval.tv_sec = period / 1000000;
+    timer.it_interval.tv_usec = period % 1000000;
+    timer.it_value = timer.it_interval;
+    if (setitimer(ITIMER_PROF, &timer, nullptr)) {
+      const int err{errno};
+      active_ = nullptr;
+      throw std::system_error{err, std::system_category(),
+        "cannot set profiling timer"};
+    }
+
+    exit_sink_ = Exit_sinks::instance().add("sampling profiler", [this]
+    {
+      try {
+        stop();
+      } catch (...) {}
+    });
+  }
+
+  /**
+   * @brief Stops the profiling and writes the folded stacks to the output.
+   * Has no effect if not running.
+   *
+   * @throws `std::runtime_error` if the output cannot be written.
+   */
+  void stop()
+  {
+    std::unique_lock lock{mutex_};
+    if (!is_running())
+      return;
+
+    const itimerval timer{};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    active_ = nullptr;
+    while (handler_count_.load())
+      std::this_thread::yield();
+    Exit_sinks::instance().remove(exit_sink_);
+
+    const auto output = make_output_ ? make_output_() : output_;
+    lock.unlock();
+    if (!output.empty()) {
+      std::ofstream file{output, std::ios::binary | std::ios::trunc};
+      write_folded(file);
+      if (!(file << std::flush))
+        throw std::runtime_error{std::string{"cannot write profile to "}
+          .append(output.string())};
+    }
+  }
+
+  /**
+   * @brief Stops the profiling if running, or starts it with the options of
+   * the previous run otherwise.
+   */
+  void toggle()
+  {
+    if (is_running()) {
+      stop();
+    } else {
+      Sampling_options options;
+      {
+        const std::lock_guard lock{mutex_};
+        options = options_;
+      }
+      start(options);
+    }
+  }
+
+  /// @returns The number of samples taken by the last run.
+  std::size_t sample_count() const noexcept
+  {
+    return sample_count_.load();
+  }
+
+  /// @returns The number of samples dropped by the last run.
+  std::size_t dropped_count() const noexcept
+  {
+    return dropped_count_.load();
+  }
+
+  /**
+   * @brief Writes the samples of the last run in the folded format.
+   *
+   * @par Requires
+   * `!is_running()`.
+   */
+  void write_folded(std::ostream& out) const
+  {
+    const std::lock_guard lock{mutex_};
+    if (is_running())
+      throw std::logic_error{"sampling profiler is running"};
+
+    std::unordered_map<std::uintptr_t, std::string> names;
+    std::map<std::string, std::size_t> stacks;
+    std::string stack;
+    const auto end = std::min(next_.load(), buffer_size_);
+    for (std::size_t i{}; i < end;) {
+      const auto depth = buffer_[i++];
+      if (!depth || i + depth > end)
+        break;
+
+      // The frames are stored from the innermost.
+      stack.clear();
+      for (auto j = depth; j--;) {
+        const auto address = buffer_[i + j];
+        auto name = names.find(address);
+        if (name == names.end())
+          name = names.emplace(address, symbolize(address)).first;
+        if (!stack.empty())
+          stack += ';';
+        stack += name->second;
+      }
+      ++stacks[stack];
+      i += depth;
+    }
+    for (const auto& [frames, count] : stacks)
+      out << frames << ' ' << count << '\n';
+  }
+
+  /**
+   * @brief Makes the signal `sig` to toggle() the profiling.
+   *
+   * @details The signal handler notifies the service thread through the pipe,
+   * and the service thread calls toggle(). The errors are reported on the
+   * standard error.
+   *
+   * @par Requires
+   * Not called before.
+   */
+  void set_toggle_signal(const int sig = SIGUSR2)
+  {
+    const std::lock_guard lock{mutex_};
+    if (toggle_write_fd_ >= 0)
+      throw std::logic_error{"toggle signal of sampling profiler is already set"};
+
+    int fds[2];
+    if (pipe(fds))
+      throw std::system_error{errno, std::system_category(),
+        "cannot create pipe for sampling profiler"};
+    for (const int fd : fds)
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+    try {
+      toggle_thread_ = std::thread{[this, read_fd = fds[0]]
+      {
+        char c;
+        while (true) {
+          const auto count = read(read_fd, &c, 1);
+          if (count < 0 && errno == EINTR)
+            continue;
+          else if (count <= 0)
+            break;
+
+          try {
+            toggle();
+          } catch (const std::exception& e) {
+            std::cerr << "cannot toggle sampling profiler: " << e.what()
+                      << std::endl;
+          }
+        }
+        close(read_fd);
+      }};
+    } catch (...) {
+      close(fds[0]);
+      close(fds[1]);
+      throw;
+    }
+    toggle_write_fd_ = fds[1];
+    toggle_fd_.store(fds[1]);
+
+    struct sigaction sa{};
+    sa.sa_handler = &handle_toggle_signal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(sig, &sa, nullptr))
+      throw std::system_error{errno, std::system_category(),
+        "cannot set toggle signal handler of sampling profiler"};
+    Signal_handlers::add(sig);
+  }
+
+private:
+  inline static std::atomic<Sampling_profiler*> active_;
+  inline static std::atomic_int handler_count_;
+  inline static std::atomic_int toggle_fd_{-1};
+
+  mutable std::mutex mutex_;
+  std::filesystem::path output_;
+  std::function<std::filesystem::path()> make_output_;
+  Sampling_options options_;
+  std::unique_ptr<std::uintptr_t[]> buffer_;
+  std::size_t buffer_size_{};
+  std::atomic_size_t next_{};
+  std::atomic_size_t sample_count_{};
+  std::atomic_size_t dropped_count_{};
+  bool is_handler_installed_{};
+  Exit_sinks::Id exit_sink_{};
+  int toggle_write_fd_{-1};
+  std::thread toggle_thread_;
+
+  Sampling_profiler()
+  {
+    // Make the registry to outlive this instance.
+    Exit_sinks::instance();
+  }
+
+  /**
+   * @brief Reads `size` bytes at `address` to `data` without faulting.
+   *
+   * @returns `true` on success.
+   */
+  static bool read_memory(const std::uintptr_t address, void* const data,
+    const std::size_t size) noexcept
+  {
+    iovec local{data, size};
+    iovec remote{reinterpret_cast<void*>(address), size};
+    return process_vm_readv(getpid(), &local, 1, &remote, 1, 0) ==
+      static_cast<ssize_t>(size);
+  }
+
+  /**
+   * @brief Walks the chain of frame pointers of the interrupted `context`.
+   *
+   * @returns The number of return addresses (the first one is the program
+   * counter) written to `frames`.
+   *
+   * @remarks Async-signal-safe.
+   */
+  static int walk_stack(const void* const context, std::uintptr_t* const frames,
+    const int capacity) noexcept
+  {
+    // The maximum distance between the adjacent frames.
+    constexpr std::uintptr_t max_frame_size{1024*1024};
+
+    const auto& mc = static_cast<const ucontext_t*>(context)->uc_mcontext;
+#if defined(__x86_64__)
+    const auto pc = static_cast<std::uintptr_t>(mc.gregs[REG_RIP]);
+    auto fp = static_cast<std::uintptr_t>(mc.gregs[REG_RBP]);
+    auto low = static_cast<std::uintptr_t>(mc.gregs[REG_RSP]);
+#elif defined(__aarch64__)
+    const auto pc = static_cast<std::uintptr_t>(mc.pc);
+    auto fp = static_cast<std::uintptr_t>(mc.regs[29]);
+    auto low = static_cast<std::uintptr_t>(mc.sp);
+#else
+    (void)mc;
+    (void)frames;
+    (void)capacity;
+    return 0;
+#endif
+
+#if defined(__x86_64__) || defined(__aarch64__)
+    int depth{};
+    if (!pc || capacity <= 0)
+      return depth;
+    frames[depth++] = pc;
+    // Each frame starts with the previous frame pointer and return address.
+    while (depth < capacity && fp >= low && fp - low <= max_frame_size &&
+      !(fp % alignof(std::uintptr_t))) {
+      std::uintptr_t record[2];
+      if (!read_memory(fp, record, sizeof(record)) || !record[1])
+        break;
+      frames[depth++] = record[1];
+      low = fp + sizeof(record);
+      fp = record[0];
+    }
+    return depth;
+#endif
+  }
+
+  static void handle_sigprof(int, siginfo_t*, void* const context) noexcept
+  {
+    const int saved_errno{errno};
+    ++handler_count_;
+    if (auto* const self = active_.load()) {
+      std::uintptr_t frames[max_depth];
+      const int depth{walk_stack(context, frames, max_depth)};
+      if (depth > 0) {
+        const auto size = static_cast<std::size_t>(depth);
+        const auto pos = self->next_.fetch_add(size + 1);
+        if (pos + size + 1 <= self->buffer_size_) {
+          auto* const record = self->buffer_.get() + pos;
+          record[0] = size;
+          for (std::size_t i{}; i < size; ++i)
+            record[i + 1] = frames[i];
+          ++self->sample_count_;
+        } else {
+          if (pos < self->buffer_size_)
+            self->buffer_[pos] = 0; // terminate the records
+          ++self->dropped_count_;
+        }
+      }
+    }
+    --handler_count_;
+    errno = saved_errno;
+  }
+
+  static void handle_toggle_signal(int) noexcept
+  {
+    const int saved_errno{errno};
+    if (const int fd{toggle_fd_.load()}; fd >= 0) {
+      const char c{'t'};
+      [[maybe_unused]] const auto count = write(fd, &c, 1);
+    }
+    errno = saved_errno;
+  }
+
+  /**
+   * @returns The name of the function containing `address`, or the name of
+   * the module in brackets if the function is unknown.
+   */
+  static std::string symbolize(const std::uintptr_t address)
+  {
+    // The return address may point past the end of the function.
+    const auto pc = address ? address - 1 : address;
+    Dl_info info{};
+    if (!dladdr(reinterpret_cast<void*>(pc), &info)) {
+      char result[32];
+      std::snprintf(result, sizeof(result), "0x%zx",
+        static_cast<std::size_t>(address));
+      return result;
+    }
+
+    if (info.dli_sname) {
+      int status{};
+      const std::unique_ptr<char, void(*)(void*)> demangled{
+        abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status),
+        &std::free};
+      std::string result{!status && demangled ? demangled.get() : info.dli_sname};
+      for (auto& c : result) {
+        if (c == ';')
+          c = ':';
+      }
+      return result;
+    }
+
+    return std::string{"["}.append(std::filesystem::path{info.dli_fname ?
+      info.dli_fname : "?"}.filename().string()).append("]");
+  }
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_PROFILER_HPP
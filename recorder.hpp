@@ -0,0 +1,506 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_RECORDER_HPP
+#define DMITIGR_PRG_RECORDER_HPP
+
+#ifdef _WIN32
+#error dmitigr/prg/recorder.hpp is not usable on Windows!
+#endif
+
+#include "../base/fsx.hpp"
+#include "exit.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define DMITIGR_PRG_RECORDER_TSC
+#endif
+
+namespace dmitigr::prg {
+
+/// An event of the flight recorder.
+struct Flight_event final {
+  /**
+   * The time in ticks of the recorder clock (see
+   * `Flight_recording::to_nanoseconds()`).
+   */
+  std::uint64_t ticks;
+
+  /// The identifier of the event.
+  std::uint32_t id;
+
+  /// Reserved.
+  std::uint32_t reserved;
+
+  /// The first argument.
+  std::int64_t a;
+
+  /// The second argument.
+  std::int64_t b;
+};
+static_assert(sizeof(Flight_event) == 32);
+
+namespace detail {
+
+/// @returns The current ticks of the flight recorder clock.
+inline std::uint64_t flight_ticks() noexcept
+{
+#ifdef DMITIGR_PRG_RECORDER_TSC
+  return __rdtsc();
+#else
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 +
+    static_cast<std::uint64_t>(ts.tv_nsec);
+#endif
+}
+
+/// @returns The current `CLOCK_MONOTONIC` time in nanoseconds.
+inline std::uint64_t flight_monotonic_ns() noexcept
+{
+  timespec ts{};
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 +
+    static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+/// The header of the recording.
+struct Flight_header final {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t event_size;
+  std::uint64_t pid;
+  std::int32_t reason;
+  std::uint32_t thread_count;
+  std::uint64_t start_ticks;
+  std::uint64_t start_ns;
+  std::uint64_t dump_ticks;
+  std::uint64_t dump_ns;
+};
+
+/// The header of the events of a thread in the recording.
+struct Flight_thread_header final {
+  std::uint64_t thread_id;
+  std::uint64_t recorded_count;
+  std::uint64_t event_count;
+};
+
+constexpr char flight_magic[8]{'D', 'M', 'P', 'R', 'G', 'F', 'R', 'C'};
+constexpr std::uint32_t flight_version{1};
+
+} // namespace detail
+
+/**
+ * @brief The flight recorder.
+ *
+ * @details Each thread records the events into its own fixed-size ring
+ * buffer of `capacity` events, overwriting the oldest ones. The recording
+ * takes neither locks nor system calls (the time is read from the TSC on
+ * x86), so it costs a few nanoseconds. The buffers are allocated on the first
+ * record() in a thread, and outlive the thread, so the events of exited
+ * threads are dumped too. The buffers of exited threads are reused only when
+ * `max_threads` buffers are allocated.
+ *
+ * The buffers are dumped by dump() which is async-signal-safe, so it can be
+ * called in the handlers of fatal signals (see install_fatal_handlers()).
+ * The dump is read by Flight_recording.
+ *
+ * @remarks Up to `max_threads` threads record at the same time. The events of
+ * other threads are discarded.
+ *
+ * @remarks The memory of each buffer is `capacity * sizeof(Flight_event)`
+ * (128 KiB).
+ */
+class Flight_recorder final {
+public:
+  /// The number of events of each thread.
+  static constexpr std::size_t capacity{4096};
+
+  /// The maximum number of threads recording at the same time.
+  static constexpr std::size_t max_threads{256};
+
+  /// Records the event `id` with the arguments `a` and `b`.
+  static void record(const std::uint32_t id, const std::int64_t a = 0,
+    const std::int64_t b = 0) noexcept
+  {
+    auto* ring = thread_ring_.ring;
+    if (!ring) [[unlikely]] {
+      ring = thread_ring_.ring = acquire_ring();
+      if (!ring)
+        return;
+    }
+    const auto count = ring->count.load(std::memory_order_relaxed);
+    ring->events[count & (capacity - 1)] = Flight_event{detail::flight_ticks(),
+      id, 0, a, b};
+    ring->count.store(count + 1, std::memory_order_release);
+  }
+
+  /**
+   * @brief Sets the path of the file to dump the events to.
+   *
+   * @par Requires
+   * `path.native().size() < 4096`.
+   */
+  static void set_output(const std::filesystem::path& path)
+  {
+    const auto& str = path.native();
+    if (str.size() >= output_.size())
+      throw std::invalid_argument{"too long path of flight recorder output"};
+    // Keep the output consistent for the concurrent dump().
+    output_[0] = '\0';
+    if (!str.empty()) {
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      std::memcpy(output_.data() + 1, str.c_str() + 1, str.size());
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+      output_[0] = str[0];
+    }
+  }
+
+  /// @returns The path of the file to dump the events to.
+  static std::filesystem::path output()
+  {
+    return std::filesystem::path{output_.data()};
+  }
+
+  /**
+   * @brief Dumps the events of all the threads to the output (rewriting it).
+   * Has no effect if the output is not set.
+   *
+   * @param reason The reason of the dump, such as the signal number.
+   *
+   * @returns `true` on success.
+   *
+   * @remarks Async-signal-safe.
+   */
+  static bool dump(const int reason = 0) noexcept
+  {
+    if (!output_[0])
+      return false;
+    const int fd{open(output_.data(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+      0644)};
+    if (fd < 0)
+      return false;
+    const bool result{dump(fd, reason)};
+    close(fd);
+    return result;
+  }
+
+  /**
+   * @brief Dumps the events of all the threads to the `fd`.
+   *
+   * @returns `true` on success.
+   *
+   * @remarks Async-signal-safe.
+   */
+  static bool dump(const int fd, const int reason) noexcept
+  {
+    std::uint32_t thread_count{};
+    for (const auto& slot : rings_) {
+      if (slot.load(std::memory_order_acquire))
+        ++thread_count;
+    }
+
+    detail::Flight_header header{};
+    std::memcpy(header.magic, detail::flight_magic, sizeof(header.magic));
+    header.version = detail::flight_version;
+    header.event_size = sizeof(Flight_event);
+    header.pid = static_cast<std::uint64_t>(getpid());
+    header.reason = reason;
+    header.thread_count = thread_count;
+    header.start_ticks = start_ticks_.load(std::memory_order_relaxed);
+    header.start_ns = start_ns_.load(std::memory_order_relaxed);
+    header.dump_ticks = detail::flight_ticks();
+    header.dump_ns = detail::flight_monotonic_ns();
+    if (!write_all(fd, &header, sizeof(header)))
+      return false;
+
+    for (std::uint32_t i{}; i < max_threads && thread_count; ++i) {
+      const auto* const ring = rings_[i].load(std::memory_order_acquire);
+      if (!ring)
+        continue;
+      --thread_count;
+
+      const auto count = ring->count.load(std::memory_order_acquire);
+      const auto event_count = std::min<std::uint64_t>(count, capacity);
+      const detail::Flight_thread_header thread{ring->thread_id, count,
+        event_count};
+      if (!write_all(fd, &thread, sizeof(thread)))
+        return false;
+
+      // Write the events from the oldest.
+      const auto first = (count - event_count) & (capacity - 1);
+      const auto first_size = std::min(event_count, capacity - first);
+      if (!write_all(fd, ring->events + first, first_size * sizeof(Flight_event)) ||
+        !write_all(fd, ring->events, (event_count - first_size) *
+          sizeof(Flight_event)))
+        return false;
+    }
+    return !thread_count;
+  }
+
+  /**
+   * @brief Installs the handlers of fatal signals (`SIGSEGV`, `SIGBUS`,
+   * `SIGFPE`, `SIGILL`, `SIGABRT`) which flush the sinks registered in
+   * Signal_sinks, dump the events and re-raise the signal with the default
+   * action.
+   *
+   * @details The alternate signal stack is set for the calling thread, so the
+   * stack overflow in it can be handled too.
+   */
+  static void install_fatal_handlers()
+  {
+    static std::unique_ptr<char[]> alt_stack;
+    if (!alt_stack) {
+      constexpr std::size_t alt_stack_size{64*1024};
+      alt_stack = std::make_unique<char[]>(alt_stack_size);
+      stack_t ss{};
+      ss.ss_sp = alt_stack.get();
+      ss.ss_size = alt_stack_size;
+      if (sigaltstack(&ss, nullptr))
+        throw std::system_error{errno, std::system_category(),
+          "cannot set alternate signal stack"};
+    }
+
+    struct sigaction sa{};
+    sa.sa_handler = &handle_fatal_signal;
+    sa.sa_flags = SA_RESETHAND | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    for (const int sig : {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT}) {
+      if (sigaction(sig, &sa, nullptr))
+        throw std::system_error{errno, std::system_category(),
+          "cannot set handler of fatal signal"};
+      Signal_handlers::add(sig);
+    }
+  }
+
+private:
+  struct Ring final {
+    std::atomic_uint64_t count;
+    std::uint64_t thread_id;
+    Flight_event events[capacity];
+  };
+
+  /// The ring of the calling thread.
+  struct Thread_ring final {
+    ~Thread_ring()
+    {
+      if (ring)
+        release_ring(ring);
+    }
+    Ring* ring{};
+  };
+
+  inline static std::atomic<Ring*> rings_[max_threads];
+  inline static std::atomic<Ring*> free_rings_[max_threads];
+  static thread_local Thread_ring thread_ring_;
+  inline static std::array<char, 4096> output_{};
+  inline static std::atomic_uint64_t start_ticks_;
+  inline static std::atomic_uint64_t start_ns_;
+
+  static Ring* acquire_ring() noexcept
+  {
+    if (!start_ns_.load(std::memory_order_relaxed)) {
+      start_ticks_.store(detail::flight_ticks(), std::memory_order_relaxed);
+      start_ns_.store(detail::flight_monotonic_ns(), std::memory_order_relaxed);
+    }
+
+    const auto reset = [](Ring* const ring) noexcept
+    {
+      ring->count.store(0, std::memory_order_relaxed);
+#ifdef __linux__
+      ring->thread_id = static_cast<std::uint64_t>(syscall(SYS_gettid));
+#else
+      ring->thread_id = reinterpret_cast<std::uintptr_t>(ring);
+#endif
+      return ring;
+    };
+
+    // Allocate the new ring while there is a free slot, so the events of the
+    // exited threads are kept as long as possible.
+    if (rings_[max_threads - 1].load(std::memory_order_acquire) == nullptr) {
+      if (auto* const ring = new (std::nothrow) Ring) {
+        reset(ring);
+        for (auto& slot : rings_) {
+          Ring* expected{};
+          if (slot.compare_exchange_strong(expected, ring,
+              std::memory_order_acq_rel))
+            return ring;
+        }
+        delete ring;
+      }
+    }
+
+    // Reuse the ring of exited thread (it's already in rings_).
+    for (auto& slot : free_rings_) {
+      if (auto* const ring = slot.exchange(nullptr, std::memory_order_acq_rel))
+        return reset(ring);
+    }
+    return nullptr;
+  }
+
+  /// Makes the `ring` reusable, but keeps its events available for dump.
+  static void release_ring(Ring* const ring) noexcept
+  {
+    for (auto& slot : free_rings_) {
+      Ring* expected{};
+      if (slot.compare_exchange_strong(expected, ring, std::memory_order_acq_rel))
+        return;
+    }
+  }
+
+  static bool write_all(const int fd, const void* const data,
+    const std::size_t size) noexcept
+  {
+    const auto* ptr = static_cast<const char*>(data);
+    for (std::size_t offset{}; offset < size;) {
+      const auto count = write(fd, ptr + offset, size - offset);
+      if (count < 0) {
+        if (errno == EINTR)
+          continue;
+        return false;
+      }
+      offset += static_cast<std::size_t>(count);
+    }
+    return true;
+  }
+
+  static void handle_fatal_signal(const int sig) noexcept
+  {
+    Signal_sinks::flush();
+    dump(sig);
+    raise(sig); // with the default action restored by SA_RESETHAND
+  }
+};
+
+inline thread_local Flight_recorder::Thread_ring Flight_recorder::thread_ring_;
+
+// =============================================================================
+
+/// The recording dumped by `Flight_recorder::dump()`.
+class Flight_recording final {
+public:
+  /// The events of a thread.
+  struct Thread final {
+    /// The thread ID.
+    std::uint64_t id{};
+
+    /// The total number of events recorded by the thread.
+    std::uint64_t recorded_count{};
+
+    /// The last events from the oldest.
+    std::vector<Flight_event> events;
+  };
+
+  /**
+   * @brief Reads the recording from the file at `path`.
+   *
+   * @throws `std::runtime_error` if the file is not a valid recording.
+   */
+  explicit Flight_recording(const std::filesystem::path& path)
+  {
+    std::ifstream file{path, std::ios::binary};
+    const auto read = [&file, &path](void* const data, const std::size_t size)
+    {
+      if (!file.read(static_cast<char*>(data), static_cast<std::streamsize>(size)))
+        throw std::runtime_error{std::string{"invalid flight recording "}
+          .append(path.string())};
+    };
+
+    read(&header_, sizeof(header_));
+    if (std::memcmp(header_.magic, detail::flight_magic, sizeof(header_.magic)) ||
+      header_.version != detail::flight_version ||
+      header_.event_size != sizeof(Flight_event))
+      throw std::runtime_error{std::string{"invalid flight recording "}
+        .append(path.string())};
+
+    threads_.resize(header_.thread_count);
+    for (auto& thread : threads_) {
+      detail::Flight_thread_header thread_header{};
+      read(&thread_header, sizeof(thread_header));
+      if (thread_header.event_count > Flight_recorder::capacity)
+        throw std::runtime_error{std::string{"invalid flight recording "}
+          .append(path.string())};
+      thread.id = thread_header.thread_id;
+      thread.recorded_count = thread_header.recorded_count;
+      thread.events.resize(thread_header.event_count);
+      read(thread.events.data(), thread.events.size() * sizeof(Flight_event));
+    }
+  }
+
+  /// @returns The PID of the recorded process.
+  std::uint64_t pid() const noexcept
+  {
+    return header_.pid;
+  }
+
+  /// @returns The reason of the dump (e.g. the signal number).
+  int reason() const noexcept
+  {
+    return header_.reason;
+  }
+
+  /// @returns The events of threads.
+  const std::vector<Thread>& threads() const noexcept
+  {
+    return threads_;
+  }
+
+  /**
+   * @returns The `CLOCK_MONOTONIC` time of the `event`. (The ticks are
+   * converted by the calibration points taken at the first record and at the
+   * dump.)
+   */
+  std::chrono::nanoseconds to_nanoseconds(const Flight_event& event) const noexcept
+  {
+    const auto ticks = static_cast<double>(header_.dump_ticks - header_.start_ticks);
+    const auto ns = static_cast<double>(header_.dump_ns - header_.start_ns);
+    const auto rate = ticks > 0 ? ns / ticks : 1.0;
+    return std::chrono::nanoseconds{static_cast<std::int64_t>(header_.dump_ns) -
+      static_cast<std::int64_t>(static_cast<double>(header_.dump_ticks - event.ticks)
+        * rate)};
+  }
+
+private:
+  detail::Flight_header header_{};
+  std::vector<Thread> threads_;
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_RECORDER_HPP
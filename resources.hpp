@@ -0,0 +1,319 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_RESOURCES_HPP
+#define DMITIGR_PRG_RESOURCES_HPP
+
+#include "command.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+namespace dmitigr::prg {
+
+namespace detail {
+
+/**
+ * @returns The size in bytes parsed from `str`.
+ *
+ * @details The `str` is a non-negative integer with an optional suffix
+ * `K`, `M`, `G` or `T` (powers of 1024).
+ */
+inline std::uint64_t to_size(const std::string_view str)
+{
+  std::uint64_t result{};
+  const auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(),
+    result);
+  const std::string_view suffix{ptr, static_cast<std::size_t>(
+      str.data() + str.size() - ptr)};
+  const auto throw_invalid = [str]
+  {
+    throw std::invalid_argument{std::string{"invalid size \""}
+      .append(str).append("\"")};
+  };
+  if (ec != std::errc{} || suffix.size() > 1)
+    throw_invalid();
+
+  int shift{};
+  if (!suffix.empty()) {
+    switch (suffix[0]) {
+    case 'K': case 'k': shift = 10; break;
+    case 'M': case 'm': shift = 20; break;
+    case 'G': case 'g': shift = 30; break;
+    case 'T': case 't': shift = 40; break;
+    default: throw_invalid();
+    }
+  }
+  if (result > (std::numeric_limits<std::uint64_t>::max() >> shift))
+    throw_invalid();
+  return result << shift;
+}
+
+/**
+ * @returns The system-wide mode of transparent huge pages (`always`,
+ * `madvise` or `never`), or empty string if unknown.
+ */
+inline std::string thp_mode()
+{
+  std::string result;
+#ifdef __linux__
+  std::ifstream file{"/sys/kernel/mm/transparent_hugepage/enabled"};
+  std::string line;
+  std::getline(file, line);
+  if (const auto open = line.find('['); open != std::string::npos) {
+    if (const auto close = line.find(']', open); close != std::string::npos)
+      result = line.substr(open + 1, close - open - 1);
+  }
+#endif
+  return result;
+}
+
+} // namespace detail
+
+/// A result of applying a resource setting.
+struct Resource_status final {
+  /// The name of the standard option the setting corresponds to.
+  std::string name;
+
+  /// The error message, or empty string on success.
+  std::string error;
+
+  /// The remark on the effect of the applied setting, if any.
+  std::string remark;
+
+  /// @returns `true` if the setting is applied successfully.
+  bool is_ok() const noexcept
+  {
+    return error.empty();
+  }
+};
+
+/**
+ * @brief The process resource settings.
+ *
+ * @details Corresponds to the following standard options:
+ *   - `--nofile=n|max` - the soft limit of open files (`max` means the
+ *   hard limit);
+ *   - `--mlock[=current|future|all]` - lock the process memory to avoid
+ *   page faults (`all` by default);
+ *   - `--thp=allow|disable` - allow or disable transparent huge pages for
+ *   the process. (`allow` only clears the disabling of the process, which
+ *   may be inherited from the parent, so the system-wide mode applies, and
+ *   in the `madvise` mode only the regions advised by advise_huge_pages()
+ *   are backed by huge pages. The system-wide mode is reported in the
+ *   remark of the status.)
+ *   - `--core=off|max|size` - the limit of core dump size.
+ */
+class Resources final {
+public:
+  /// A memory locking mode.
+  enum class Mlock {
+    /// Lock the currently mapped pages.
+    current = 1,
+    /// Lock the pages mapped in the future.
+    future = 2,
+    /// Lock both currently mapped pages and pages mapped in the future.
+    all = current | future
+  };
+
+  /// A limit value meaning "as much as the hard limit allows".
+  static constexpr std::uint64_t max_limit{
+    std::numeric_limits<std::uint64_t>::max()};
+
+  /// The names of the standard options.
+  static constexpr std::string_view option_names[]{"nofile", "mlock", "thp",
+    "core"};
+
+  /// @returns The instance from the standard options of `command`.
+  static Resources make(const Command& command)
+  {
+    static const auto to_limit = [](const Command::Optref& opt)
+    {
+      const auto& value = opt.value_not_empty();
+      return value == "max" ? max_limit : detail::to_size(value);
+    };
+
+    Resources result;
+    const auto [nofile, mlock, thp, core] = command.options("nofile", "mlock",
+      "thp", "core");
+    if (nofile.is_valid_throw_if_no_value())
+      result.nofile_ = to_limit(nofile);
+    if (mlock) {
+      const auto& value = mlock.value();
+      if (!value || *value == "all")
+        result.mlock_ = Mlock::all;
+      else if (*value == "current")
+        result.mlock_ = Mlock::current;
+      else if (*value == "future")
+        result.mlock_ = Mlock::future;
+      else
+        throw std::invalid_argument{"invalid value of option --mlock"};
+    }
+    if (thp.is_valid_throw_if_no_value()) {
+      const auto& value = thp.value_not_empty();
+      if (value == "allow" || value == "disable")
+        result.is_thp_allowed_ = value == "allow";
+      else
+        throw std::invalid_argument{"invalid value of option --thp"};
+    }
+    if (core.is_valid_throw_if_no_value())
+      result.core_ = core.value_not_empty() == "off" ? 0 : to_limit(core);
+    return result;
+  }
+
+  /// @returns The soft limit of open files.
+  std::optional<std::uint64_t> nofile() const noexcept
+  {
+    return nofile_;
+  }
+
+  /// @returns The memory locking mode.
+  std::optional<Mlock> mlock() const noexcept
+  {
+    return mlock_;
+  }
+
+  /// @returns `true` if transparent huge pages must be allowed.
+  std::optional<bool> is_thp_allowed() const noexcept
+  {
+    return is_thp_allowed_;
+  }
+
+  /// @returns The limit of core dump size.
+  std::optional<std::uint64_t> core() const noexcept
+  {
+    return core_;
+  }
+
+  /**
+   * @brief Applies the settings to the process.
+   *
+   * @returns The status of each specified setting.
+   *
+   * @remarks Failures are not considered as errors since the most of the
+   * settings depend on privileges of the process. So the caller decides.
+   */
+  std::vector<Resource_status> apply() const
+  {
+    std::vector<Resource_status> result;
+    const auto status = [&result](std::string name, const char* const error)
+    {
+      result.push_back({std::move(name), error ? error : "", {}});
+    };
+    const auto error = [](const int err) -> const char*
+    {
+      return err ? std::strerror(err) : nullptr;
+    };
+#ifndef _WIN32
+    if (nofile_)
+      status("nofile", error(set_limit(RLIMIT_NOFILE, *nofile_)));
+    if (core_)
+      status("core", error(set_limit(RLIMIT_CORE, *core_)));
+    if (mlock_) {
+      const int flags = (static_cast<int>(*mlock_) & 1 ? MCL_CURRENT : 0) |
+        (static_cast<int>(*mlock_) & 2 ? MCL_FUTURE : 0);
+      status("mlock", error(mlockall(flags) ? errno : 0));
+    }
+#else
+    static const char* const unsupported{"not supported on this platform"};
+    if (nofile_)
+      status("nofile", unsupported);
+    if (core_)
+      status("core", unsupported);
+    if (mlock_)
+      status("mlock", unsupported);
+#endif
+#ifdef __linux__
+    if (is_thp_allowed_) {
+      status("thp", error(prctl(PR_SET_THP_DISABLE,
+        static_cast<unsigned long>(!*is_thp_allowed_), 0, 0, 0) ? errno : 0));
+      if (*is_thp_allowed_) {
+        if (const auto mode = detail::thp_mode(); !mode.empty())
+          result.back().remark = "allowed, system-wide mode is " + mode;
+      }
+    }
+#else
+    if (is_thp_allowed_)
+      status("thp", "not supported on this platform");
+#endif
+    return result;
+  }
+
+private:
+  std::optional<std::uint64_t> nofile_;
+  std::optional<Mlock> mlock_;
+  std::optional<bool> is_thp_allowed_;
+  std::optional<std::uint64_t> core_;
+
+#ifndef _WIN32
+  /// @returns `0` on success, or `errno` otherwise.
+  static int set_limit(const int resource, const std::uint64_t value) noexcept
+  {
+    rlimit limit{};
+    if (getrlimit(resource, &limit))
+      return errno;
+    if (value == max_limit)
+      limit.rlim_cur = limit.rlim_max;
+    else if (limit.rlim_max != RLIM_INFINITY && value > limit.rlim_max)
+      return EPERM;
+    else
+      limit.rlim_cur = static_cast<rlim_t>(value);
+    return setrlimit(resource, &limit) ? errno : 0;
+  }
+#endif
+};
+
+/**
+ * @brief Advises the system to back the memory region by transparent huge
+ * pages.
+ *
+ * @returns `true` on success.
+ *
+ * @remarks Useful for large heaps and arenas allocated by `mmap()`. The
+ * region should be aligned to the huge page size to get the most benefit.
+ */
+inline bool advise_huge_pages(void* const addr, const std::size_t size) noexcept
+{
+#ifdef MADV_HUGEPAGE
+  return !madvise(addr, size, MADV_HUGEPAGE);
+#else
+  (void)addr;
+  (void)size;
+  return false;
+#endif
+}
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_RESOURCES_HPP
@@ -0,0 +1,283 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_STARTUP_HPP
+#define DMITIGR_PRG_STARTUP_HPP
+
+#include "../base/fsx.hpp"
+#include "../base/noncopymove.hpp"
+#include "identity.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+namespace dmitigr::prg {
+
+/// A phase of the program startup.
+struct Startup_phase final {
+  /// The name of the phase.
+  std::string name;
+
+  /// The time elapsed since the origin till the end of the phase.
+  std::chrono::nanoseconds offset{};
+
+  /// The duration of the phase.
+  std::chrono::nanoseconds duration{};
+};
+
+/**
+ * @brief The profiler of the program startup.
+ *
+ * @details The startup is split into the phases by marks. The mark ends the
+ * phase started by the previous mark (or at the origin), so the phases are
+ * named after the work they cover. The origin is the process start (`exec`)
+ * if known (Linux), or the first mark otherwise. The following marks are
+ * made automatically:
+ *   - `load` - during the static initialization, so the phase covers the
+ *   dynamic loading and the static initialization done before;
+ *   - `static-init` - by `Info::initialize()` on entry, so the phase covers
+ *   the rest of the static initialization and the code of `main()` before;
+ *   - `standard-options` - by `Info::initialize()` after applying the
+ *   standard options (see Affinity and Resources);
+ *   - `init` - by `Info::initialize()` after calling `Info::init()`;
+ *   - `identity` - by `Info::initialize()` after computing the Identity.
+ *
+ * The application marks its own phases (e.g. config parsing or cache warm-up)
+ * and calls finish() when it's ready. If the output is specified (e.g. by the
+ * standard option `--startup-profile=PATH`), finish() writes the report
+ * there.
+ *
+ * @par Thread safety
+ * All the members are thread-safe.
+ */
+class Startup_profiler final : Noncopymove {
+public:
+  /// @returns The process-wide instance.
+  static Startup_profiler& instance()
+  {
+    static Startup_profiler result;
+    return result;
+  }
+
+  /**
+   * @brief Ends the phase `name`.
+   *
+   * @remarks Has no effect after finish().
+   */
+  void mark(const std::string_view name)
+  {
+    const auto now = clock();
+    const std::lock_guard lock{mutex_};
+    if (is_finished_)
+      return;
+    if (!origin_)
+      origin_ = now;
+    marks_.emplace_back(std::string{name}, now - *origin_);
+  }
+
+  /**
+   * @returns `true` if the origin is the process start rather than the first
+   * mark.
+   */
+  bool is_origin_exec() const noexcept
+  {
+    return is_origin_exec_;
+  }
+
+  /// @returns The phases in order of marks.
+  std::vector<Startup_phase> phases() const
+  {
+    const std::lock_guard lock{mutex_};
+    std::vector<Startup_phase> result;
+    result.reserve(marks_.size());
+    std::chrono::nanoseconds previous{};
+    for (const auto& [name, offset] : marks_) {
+      result.push_back(Startup_phase{name, offset, offset - previous});
+      previous = offset;
+    }
+    return result;
+  }
+
+  /// @returns The human-readable report.
+  std::string to_string() const
+  {
+    static const auto to_ms = [](const std::chrono::nanoseconds value)
+    {
+      return std::chrono::duration<double, std::milli>{value}.count();
+    };
+
+    const auto phs = phases();
+    std::size_t width{5};
+    for (const auto& phase : phs)
+      width = std::max(width, phase.name.size());
+
+    std::ostringstream result;
+    result << std::fixed << std::setprecision(3)
+           << "startup phases since " << (is_origin_exec_ ? "exec" : "first mark")
+           << ":\n" << std::left << std::setw(static_cast<int>(width)) << "phase"
+           << std::right << std::setw(14) << "offset, ms"
+           << std::setw(14) << "duration, ms" << '\n';
+    for (const auto& phase : phs)
+      result << std::left << std::setw(static_cast<int>(width)) << phase.name
+             << std::right << std::setw(14) << to_ms(phase.offset)
+             << std::setw(14) << to_ms(phase.duration) << '\n';
+    return result.str();
+  }
+
+  /// @returns The report in JSON.
+  std::string to_json() const
+  {
+    std::string result{R"({"origin":")"};
+    result.append(is_origin_exec_ ? "exec" : "first_mark")
+      .append(R"(","phases":[)");
+    bool is_first{true};
+    for (const auto& phase : phases()) {
+      if (!is_first)
+        result += ',';
+      is_first = false;
+      result.append(R"({"name":")");
+      for (const char c : phase.name) {
+        if (c == '"' || c == '\\') {
+          result += '\\';
+          result += c;
+        } else if (static_cast<unsigned char>(c) < ' ') {
+          char buf[7];
+          std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+          result += buf;
+        } else
+          result += c;
+      }
+      result.append(R"(","offset_ns":)").append(std::to_string(phase.offset.count()))
+        .append(R"(,"duration_ns":)").append(std::to_string(phase.duration.count()))
+        .append("}");
+    }
+    result.append("]}");
+    return result;
+  }
+
+  /**
+   * @brief Sets the output of the report written by finish().
+   *
+   * @param path The path to the file to write the report to, or `-` to write
+   * it to the standard error. The report is written in JSON if the extension
+   * of `path` is `.json`.
+   */
+  void set_output(std::filesystem::path path)
+  {
+    const std::lock_guard lock{mutex_};
+    output_ = std::move(path);
+  }
+
+  /// @returns The output of the report.
+  std::filesystem::path output() const
+  {
+    const std::lock_guard lock{mutex_};
+    return output_;
+  }
+
+  /**
+   * @brief Ends the phase `name` and stops the profiling. Writes the report
+   * to the output if specified.
+   *
+   * @remarks Has no effect if already finished.
+   *
+   * @throws `std::runtime_error` if the report cannot be written.
+   */
+  void finish(const std::string_view name = "ready")
+  {
+    mark(name);
+    std::filesystem::path output;
+    {
+      const std::lock_guard lock{mutex_};
+      if (is_finished_)
+        return;
+      is_finished_ = true;
+      output = output_;
+    }
+    if (output.empty())
+      return;
+
+    const auto report = output.extension() == ".json" ?
+      to_json().append("\n") : to_string();
+    if (output == "-") {
+      std::fwrite(report.data(), 1, report.size(), stderr);
+      return;
+    }
+    std::ofstream file{output, std::ios::binary | std::ios::trunc};
+    if (!(file << report << std::flush))
+      throw std::runtime_error{std::string{"cannot write startup profile to "}
+        .append(output.string())};
+  }
+
+  /// @returns `true` if finish() was called.
+  bool is_finished() const
+  {
+    const std::lock_guard lock{mutex_};
+    return is_finished_;
+  }
+
+private:
+  mutable std::mutex mutex_;
+  bool is_origin_exec_{};
+  bool is_finished_{};
+  std::optional<std::chrono::nanoseconds> origin_;
+  std::vector<std::pair<std::string, std::chrono::nanoseconds>> marks_;
+  std::filesystem::path output_;
+
+  Startup_profiler()
+    : origin_{detail::process_start_since_boot()}
+  {
+    is_origin_exec_ = static_cast<bool>(origin_);
+    marks_.reserve(32);
+  }
+
+  /// @returns The time comparable with `detail::process_start_since_boot()`.
+  static std::chrono::nanoseconds clock() noexcept
+  {
+#ifdef __linux__
+    timespec ts{};
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return std::chrono::seconds{ts.tv_sec} + std::chrono::nanoseconds{ts.tv_nsec};
+#else
+    return std::chrono::steady_clock::now().time_since_epoch();
+#endif
+  }
+};
+
+namespace detail {
+/// Marks the end of the dynamic loading during the static initialization.
+inline const bool is_startup_load_marked{
+  (Startup_profiler::instance().mark("load"), true)};
+} // namespace detail
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_STARTUP_HPP
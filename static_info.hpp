@@ -0,0 +1,110 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_STATIC_INFO_HPP
+#define DMITIGR_PRG_STATIC_INFO_HPP
+
+#include "../base/assert.hpp"
+#include "info.hpp"
+
+#include <atomic>
+
+namespace dmitigr::prg {
+
+namespace detail {
+/// The stop signal referenced before the instance is constructed.
+inline constinit std::atomic_int unset_stop_signal{0};
+} // namespace detail
+
+/**
+ * @brief The program info with static access for hot paths.
+ *
+ * @details The process-wide instance of `Derived` is registered in the
+ * `constinit` slots by `Info::initialize()`, so:
+ *   - `Derived::instance()` is just a load of pointer without assertion;
+ *   - `Derived::stop_signal_ref()` returns the reference to the stop signal
+ *   of the instance which can be cached, and `is_stop_requested()` compiles
+ *   to a relaxed load without calls or branches. Before the instance is
+ *   initialized, the reference to the unset stop signal is returned.
+ *
+ * If `Derived` is declared `final`, the calls of virtual functions via the
+ * result of `Derived::instance()` are devirtualized.
+ *
+ * @par Example
+ * @code
+ * class My_info final : public prg::Static_info<My_info> { ... };
+ *
+ * const auto& stop = My_info::stop_signal_ref(); // after initialize()
+ * while (!stop.load(std::memory_order_relaxed)) { ... }
+ * @endcode
+ *
+ * @remarks The instances of `Derived` which are not process-wide (such as
+ * the ones created by `Info::create()`) are never registered.
+ */
+template<class Derived>
+class Static_info : public Info {
+public:
+  /// The destructor.
+  ~Static_info() override
+  {
+    if (instance_ == this) {
+      stop_signal_ = &detail::unset_stop_signal;
+      instance_ = nullptr;
+    }
+  }
+
+  /**
+   * @returns The registered instance.
+   *
+   * @par Requires
+   * The instance is initialized by `Info::initialize()`.
+   */
+  static Derived& instance() noexcept
+  {
+    return *static_cast<Derived*>(instance_);
+  }
+
+  /// @returns The reference to the stop signal of the registered instance.
+  static std::atomic_int& stop_signal_ref() noexcept
+  {
+    return *stop_signal_;
+  }
+
+  /// @returns `true` if the stop signal of the registered instance is set.
+  static bool is_stop_requested() noexcept
+  {
+    return stop_signal_->load(std::memory_order_relaxed);
+  }
+
+protected:
+  /// The constructor.
+  Static_info() noexcept = default;
+
+private:
+  inline static constinit Static_info* instance_{};
+  inline static constinit std::atomic_int* stop_signal_{
+    &detail::unset_stop_signal};
+
+  void register_process_instance() noexcept override
+  {
+    instance_ = this;
+    stop_signal_ = &stop_signal;
+  }
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_STATIC_INFO_HPP
@@ -0,0 +1,413 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_SUPERVISOR_HPP
+#define DMITIGR_PRG_SUPERVISOR_HPP
+
+#ifdef _WIN32
+#error dmitigr/prg/supervisor.hpp is not usable on Windows!
+#endif
+
+#include "../base/assert.hpp"
+#include "../base/noncopymove.hpp"
+#include "info.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+namespace dmitigr::prg {
+
+/// The options of Supervisor.
+struct Supervisor_options final {
+  /// The number of worker processes.
+  std::size_t worker_count{1};
+
+  /// The delay before restarting a worker which exited after a stable run.
+  std::chrono::milliseconds min_restart_delay{100};
+
+  /// The maximum delay before restarting a worker.
+  std::chrono::milliseconds max_restart_delay{std::chrono::seconds{30}};
+
+  /**
+   * The minimum uptime of a worker considered as a stable run. The restart
+   * delay is doubled for each worker which exits earlier.
+   */
+  std::chrono::milliseconds stable_uptime{std::chrono::seconds{10}};
+
+  /// The time to wait for the workers to stop before sending `SIGKILL`.
+  std::chrono::milliseconds kill_timeout{std::chrono::seconds{10}};
+};
+
+/// The statistics of a worker process.
+struct Worker_stats final {
+  /// The PID of the running worker, or `0` if not running.
+  pid_t pid{};
+
+  /// The number of starts.
+  std::size_t start_count{};
+
+  /// The number of exits with `EXIT_SUCCESS`.
+  std::size_t success_count{};
+
+  /// The number of exits with other codes.
+  std::size_t failure_count{};
+
+  /// The number of terminations by signals.
+  std::size_t signal_count{};
+
+  /// The exit code of the last exit, if any.
+  std::optional<int> last_exit_code;
+
+  /// The number of the signal of the last termination, if any.
+  std::optional<int> last_signal;
+
+  /// The current restart delay.
+  std::chrono::milliseconds restart_delay{};
+};
+
+/**
+ * @brief A supervisor of worker processes (prefork model).
+ *
+ * @details The master (the process which calls run()) forks the workers,
+ * restarts the exited ones with exponential backoff and forwards the
+ * signals to them. The state prepared by the master before run() (e.g.
+ * bound listening sockets, loaded read-only data) is shared with the
+ * workers via copy-on-write.
+ *
+ * The signals `SIGTERM`, `SIGINT` and `SIGQUIT` initiate the shutdown: the
+ * master sets `Info::instance().stop_signal`, forwards the signal to the
+ * workers and waits for them to exit. The signals `SIGHUP`, `SIGUSR1` and
+ * `SIGUSR2` are just forwarded. The shutdown is initiated as well if
+ * `Info::instance().stop_signal` is set by other means, in which case the
+ * workers get `SIGTERM` (unless the stop signal is one of the above).
+ *
+ * Only the workers are reaped by the master, so the other children (e.g.
+ * the ones created by `popen()`) are left to their owners.
+ */
+class Supervisor final : Noncopymove {
+public:
+  /**
+   * @brief The constructor.
+   *
+   * @par Requires
+   * `options.worker_count > 0`.
+   */
+  explicit Supervisor(Supervisor_options options = {})
+    : options_{std::move(options)}
+    , stats_(options_.worker_count)
+  {
+    if (!options_.worker_count)
+      throw std::invalid_argument{"invalid worker count of supervisor"};
+    if (options_.min_restart_delay > options_.max_restart_delay)
+      throw std::invalid_argument{"invalid restart delays of supervisor"};
+  }
+
+  /// @returns The options.
+  const Supervisor_options& options() const noexcept
+  {
+    return options_;
+  }
+
+  /// @returns The statistics of each worker.
+  const std::vector<Worker_stats>& stats() const noexcept
+  {
+    return stats_;
+  }
+
+  /**
+   * @brief Runs the workers until shutdown.
+   *
+   * @param worker The function to call in each worker process with the index
+   * of the worker. The function may return an integer exit code.
+   *
+   * @par Requires
+   * `Info::is_initialized()`. No threads must be created yet, since the
+   * handled signals are blocked only in the calling thread, so the other
+   * threads would take them (e.g. terminate by `SIGTERM`). (This is checked
+   * on Linux.) The exception is the thread of the memory guard of the
+   * process-wide Info instance, which is suspended in the master for the
+   * time of this call and resumed in the workers.
+   *
+   * @remarks The exception thrown by `worker` is printed to the standard
+   * error and results in exit with `EXIT_FAILURE`.
+   *
+   * @remarks The workers are reaped on each wakeup (at least once a second)
+   * regardless of `SIGCHLD`, so a coalesced or missed `SIGCHLD` doesn't
+   * leave an exited worker unnoticed.
+   */
+  template<typename F>
+  void run(F&& worker)
+  {
+    using std::chrono::steady_clock;
+
+    struct Guard final {
+      Memory_guard* const memory_guard{Info::is_process_initialized() ?
+        Info::process_instance().memory_guard() : nullptr};
+      Guard()
+      {
+        if (memory_guard)
+          memory_guard->suspend();
+      }
+      ~Guard()
+      {
+        if (memory_guard) {
+          try {
+            memory_guard->resume();
+          } catch (...) {}
+        }
+      }
+    } const guard;
+
+    if (!is_single_threaded())
+      throw std::logic_error{"supervisor must run before creating threads"};
+
+    auto& info = Info::instance();
+    sigset_t set;
+    sigemptyset(&set);
+    for (const int sig : signals_)
+      sigaddset(&set, sig);
+    sigset_t old_set;
+    if (const int err = pthread_sigmask(SIG_BLOCK, &set, &old_set))
+      throw std::system_error{err, std::system_category(),
+        "cannot block signals in supervisor"};
+    struct Mask_guard final {
+      const sigset_t& set;
+      ~Mask_guard() { pthread_sigmask(SIG_SETMASK, &set, nullptr); }
+    } const mask_guard{old_set};
+
+    std::vector<steady_clock::time_point> started(stats_.size());
+    std::vector<std::optional<steady_clock::time_point>>
+      restart_at(stats_.size(), steady_clock::now());
+    std::optional<steady_clock::time_point> kill_at;
+    bool is_killed{};
+
+    const auto live_count = [this]
+    {
+      return std::count_if(cbegin(stats_), cend(stats_),
+        [](const auto& s){return s.pid;});
+    };
+    const auto forward = [this](const int sig)
+    {
+      for (const auto& s : stats_)
+        if (s.pid)
+          kill(s.pid, sig);
+    };
+    const auto stop = [&](const int sig)
+    {
+      if (!kill_at) {
+        info.stop_signal = sig;
+        kill_at = steady_clock::now() + options_.kill_timeout;
+        std::fill(begin(restart_at), end(restart_at), std::nullopt);
+      }
+      // The stop signal may be set to a value which is not a signal number.
+      forward(sig == SIGTERM || sig == SIGINT || sig == SIGQUIT ? sig :
+        SIGTERM);
+    };
+
+    while (true) {
+      // Start the workers due.
+      const auto now = steady_clock::now();
+      for (std::size_t i{}; i < stats_.size(); ++i) {
+        if (restart_at[i] && *restart_at[i] <= now) {
+          restart_at[i].reset();
+          started[i] = now;
+          start(i, old_set, worker);
+        }
+      }
+
+      // Handle the shutdown.
+      if (const int sig = info.stop_signal; sig && !kill_at)
+        stop(sig);
+      if (kill_at) {
+        if (!live_count())
+          break;
+        else if (!is_killed && *kill_at <= now) {
+          forward(SIGKILL);
+          is_killed = true;
+        }
+      }
+
+      // Wait for a signal or the next deadline.
+      std::optional<steady_clock::time_point> deadline;
+      for (const auto& r : restart_at)
+        if (r && (!deadline || *r < *deadline))
+          deadline = r;
+      if (kill_at && !is_killed && (!deadline || *kill_at < *deadline))
+        deadline = kill_at;
+      std::chrono::nanoseconds timeout{std::chrono::seconds{1}};
+      if (deadline)
+        timeout = std::clamp(std::chrono::nanoseconds{*deadline - now},
+          std::chrono::nanoseconds{}, timeout);
+      const auto sec = std::chrono::duration_cast<std::chrono::seconds>(timeout);
+      const timespec ts{static_cast<time_t>(sec.count()),
+        static_cast<long>((timeout - sec).count())};
+      siginfo_t si;
+      const int sig{sigtimedwait(&set, &si, &ts)};
+      if (sig < 0) {
+        if (errno != EAGAIN && errno != EINTR)
+          throw std::system_error{errno, std::system_category(),
+            "cannot wait for signals in supervisor"};
+      } else if (sig == SIGTERM || sig == SIGINT || sig == SIGQUIT)
+        stop(sig);
+      else if (sig != SIGCHLD)
+        forward(sig);
+      reap(started, restart_at, !kill_at);
+    }
+  }
+
+private:
+  static constexpr int signals_[]{SIGCHLD, SIGTERM, SIGINT, SIGQUIT, SIGHUP,
+    SIGUSR1, SIGUSR2};
+  Supervisor_options options_;
+  std::vector<Worker_stats> stats_;
+
+  /// @returns `false` if the process is known to have several threads.
+  static bool is_single_threaded()
+  {
+#ifdef __linux__
+    std::ifstream stat{"/proc/self/stat"};
+    std::string line;
+    if (!std::getline(stat, line))
+      return true;
+
+    // The command name (field 2) may contain spaces and parentheses.
+    const auto pos = line.rfind(')');
+    if (pos == std::string::npos)
+      return true;
+    std::istringstream fields{line.substr(pos + 1)};
+    std::string field;
+    for (int i{3}; i < 20 && fields >> field; ++i);
+    long count{};
+    return !(fields >> count) || count == 1;
+#else
+    return true;
+#endif
+  }
+
+  template<typename F>
+  void start(const std::size_t index, const sigset_t& old_set, F& worker)
+  {
+    auto& s = stats_[index];
+    const pid_t master_pid{getpid()};
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+    const pid_t pid{Info::fork_process()};
+    if (pid < 0)
+      throw std::system_error{errno, std::system_category(),
+        "cannot fork worker"};
+    else if (pid > 0) {
+      s.pid = pid;
+      ++s.start_count;
+      return;
+    }
+
+    // The worker process.
+#ifdef __linux__
+    // The master may have died before the call.
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != master_pid)
+      _exit(EXIT_FAILURE);
+#endif
+    pthread_sigmask(SIG_SETMASK, &old_set, nullptr);
+    if (Info::is_process_initialized()) {
+      if (auto* const memory_guard = Info::process_instance().memory_guard()) {
+        try {
+          memory_guard->resume(); // suspended by run()
+        } catch (...) {}
+      }
+    }
+    int code{EXIT_SUCCESS};
+    try {
+      if constexpr (std::is_void_v<decltype(worker(index))>)
+        worker(index);
+      else
+        code = worker(index);
+    } catch (const std::exception& e) {
+      std::cerr << "worker " << index << ": " << e.what() << std::endl;
+      code = EXIT_FAILURE;
+    } catch (...) {
+      std::cerr << "worker " << index << ": unknown error" << std::endl;
+      code = EXIT_FAILURE;
+    }
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+    _exit(code);
+  }
+
+  void reap(const std::vector<std::chrono::steady_clock::time_point>& started,
+    std::vector<std::optional<std::chrono::steady_clock::time_point>>& restart_at,
+    const bool is_restart)
+  {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto i = begin(stats_); i != end(stats_); ++i) {
+      auto& s = *i;
+      int status{};
+      if (!s.pid || waitpid(s.pid, &status, WNOHANG) <= 0)
+        continue; // not running or not exited
+
+      s.pid = 0;
+      if (WIFEXITED(status)) {
+        s.last_exit_code = WEXITSTATUS(status);
+        s.last_signal.reset();
+        ++(*s.last_exit_code == EXIT_SUCCESS ? s.success_count : s.failure_count);
+      } else if (WIFSIGNALED(status)) {
+        s.last_signal = WTERMSIG(status);
+        s.last_exit_code.reset();
+        ++s.signal_count;
+      }
+
+      if (is_restart) {
+        const auto index = static_cast<std::size_t>(i - begin(stats_));
+        if (now - started[index] >= options_.stable_uptime)
+          s.restart_delay = options_.min_restart_delay;
+        else
+          s.restart_delay = std::clamp(2 * s.restart_delay,
+            options_.min_restart_delay, options_.max_restart_delay);
+        restart_at[index] = now + s.restart_delay;
+      }
+    }
+  }
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_SUPERVISOR_HPP
@@ -0,0 +1,90 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/affinity.hpp"
+
+#include <iostream>
+#include <stdexcept>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+int main()
+try {
+  namespace prg = dmitigr::prg;
+
+  // Cpu_set
+  {
+    const auto set = prg::Cpu_set::from_string("16-19,0-3,2,7");
+    ASSERT(set.size() == 9);
+    ASSERT(set.contains(0) && set.contains(7) && set.contains(19));
+    ASSERT(!set.contains(4) && !set.contains(20));
+    ASSERT(set.to_string() == "0-3,7,16-19");
+    ASSERT(prg::Cpu_set{}.to_string().empty());
+
+    for (const auto* const invalid : {"", "a", "1-", "3-1", "1,", "-1",
+           "0-2147483647", "0-2000000000", "8192"}) {
+      try {
+        prg::Cpu_set::from_string(invalid);
+        ASSERT(false);
+      } catch (const std::invalid_argument&) {}
+    }
+
+    const auto current = prg::Cpu_set::current();
+    ASSERT(!current.is_empty());
+    current.bind_current_thread();
+  }
+
+  // Numa_policy
+  {
+    const auto bind = prg::Numa_policy::from_string("bind:0-1");
+    ASSERT(bind.mode() == prg::Numa_mode::bind);
+    ASSERT((bind.nodes() == std::vector<int>{0, 1}));
+    const auto local = prg::Numa_policy::from_string("local");
+    ASSERT(local.mode() == prg::Numa_mode::local);
+    ASSERT(local.nodes().empty());
+
+    for (const auto* const invalid : {"bind", "local:0", "preferred:0-1", "x",
+           "bind:0-1024"}) {
+      try {
+        prg::Numa_policy::from_string(invalid);
+        ASSERT(false);
+      } catch (const std::invalid_argument&) {}
+    }
+  }
+
+  // Affinity
+  {
+    const char* const argv[] = {"prog", "--cpus=4-5,8", "--pin-threads"};
+    int argc{3};
+    const char* const* argv_p{argv};
+    const auto affinity = prg::Affinity::make(
+      prg::make_command(&argc, &argv_p, false));
+    ASSERT(affinity.cpus());
+    ASSERT(affinity.cpus()->to_string() == "4-5,8");
+    ASSERT(!affinity.numa());
+    ASSERT(affinity.is_thread_pinning());
+    ASSERT(affinity.worker_cpus(0).to_string() == "4");
+    ASSERT(affinity.worker_cpus(2).to_string() == "8");
+    ASSERT(affinity.worker_cpus(3).to_string() == "4");
+  }
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
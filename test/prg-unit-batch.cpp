@@ -0,0 +1,173 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/batch.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace prg = dmitigr::prg;
+
+namespace {
+
+/// @returns The read end of the pipe with `data` written to it.
+int make_input(const std::string& data)
+{
+  int fds[2];
+  ASSERT(!pipe(fds));
+  std::thread{[fd = fds[1], data]
+  {
+    for (std::size_t offset{}; offset < data.size();) {
+      const auto count = write(fd, data.data() + offset, data.size() - offset);
+      if (count <= 0)
+        break;
+      offset += static_cast<std::size_t>(count);
+    }
+    close(fd);
+  }}.detach();
+  return fds[0];
+}
+
+/// @returns The content of the temporary file `file`.
+std::string read_file(std::FILE* const file)
+{
+  std::rewind(file);
+  std::string result;
+  char buf[4096];
+  while (const auto size = std::fread(buf, 1, sizeof(buf), file))
+    result.append(buf, size);
+  return result;
+}
+
+} // namespace
+
+int main()
+try {
+  // Record_reader: delimiters, the unterminated last record, empty records.
+  {
+    const int fd{make_input("one\ntwo\n\nthree")};
+    prg::Record_reader reader{fd};
+    ASSERT(reader.next() == "one");
+    ASSERT(reader.next() == "two");
+    ASSERT(reader.next() == "");
+    ASSERT(reader.next() == "three");
+    ASSERT(!reader.next());
+    ASSERT(!reader.next());
+    close(fd);
+  }
+  {
+    const int fd{make_input(std::string{"a\0b\0", 4})};
+    prg::Record_reader reader{fd, '\0'};
+    ASSERT(reader.next() == "a");
+    ASSERT(reader.next() == "b");
+    ASSERT(!reader.next());
+    close(fd);
+  }
+
+  // Record_reader: the records larger than the initial buffer.
+  {
+    const std::string big(200000, 'x');
+    const int fd{make_input(big + "\nsmall\n" + big)};
+    prg::Record_reader reader{fd};
+    ASSERT(reader.next() == big);
+    ASSERT(reader.next() == "small");
+    ASSERT(reader.next() == big);
+    ASSERT(!reader.next());
+    close(fd);
+  }
+
+  // Record_reader: the too large record.
+  {
+    const int fd{make_input(std::string(100000, 'x') + "\n")};
+    prg::Record_reader reader{fd, '\n', 70000};
+    bool is_thrown{};
+    try {
+      reader.next();
+    } catch (const std::runtime_error&) {
+      is_thrown = true;
+    }
+    ASSERT(is_thrown);
+    close(fd);
+  }
+  {
+    bool is_thrown{};
+    try {
+      prg::Record_reader{-1};
+    } catch (const std::invalid_argument&) {
+      is_thrown = true;
+    }
+    ASSERT(is_thrown);
+  }
+
+  // run_batch: the outputs are written in order of command lines.
+  const auto handler = [](const prg::Command& command, std::string& output)
+  {
+    if (command.name() == "echo") {
+      // The later commands complete earlier.
+      const auto n = std::stoi(command[0]);
+      std::this_thread::sleep_for(std::chrono::microseconds{(100 - n % 100)
+          * 10});
+      output.append(command[0]).push_back('\n');
+      return 0;
+    } else if (command.name() == "fail")
+      return 1;
+    throw std::runtime_error{"unknown command " + command.name()};
+  };
+
+  std::string input;
+  std::string expected_output;
+  for (int i{}; i < 1000; ++i) {
+    input.append("echo ").append(std::to_string(i)).append("\n");
+    expected_output.append(std::to_string(i)).append("\n");
+    if (i == 500)
+      input.append("\n  \nfail\nunknown\n");
+  }
+  const std::string expected_error{"line 505: unknown command unknown\n"};
+
+  for (const std::size_t thread_count : {0, 1, 4}) {
+    std::FILE* const output{std::tmpfile()};
+    std::FILE* const error{std::tmpfile()};
+    ASSERT(output && error);
+    prg::Batch_options options;
+    options.thread_count = thread_count;
+    options.output_fd = fileno(output);
+    options.error_fd = fileno(error);
+    const int fd{make_input(input)};
+    const auto summary = prg::run_batch(fd, handler, options);
+    close(fd);
+    ASSERT(summary.command_count == 1002);
+    ASSERT(summary.failure_count == 2);
+    ASSERT(read_file(output) == expected_output);
+    ASSERT(read_file(error) == expected_error);
+    std::fclose(output);
+    std::fclose(error);
+  }
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
@@ -0,0 +1,94 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/cancellation.hpp"
+
+#include <atomic>
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+int main()
+try {
+  namespace prg = dmitigr::prg;
+
+  std::atomic_int stop_signal{};
+  prg::Cancellation_scope root{stop_signal};
+  prg::Cancellation_scope replication{root};
+  prg::Cancellation_scope stream{replication};
+  prg::Cancellation_scope server{root};
+  ASSERT(!root.is_cancelled());
+  ASSERT(!stream.is_cancelled());
+
+  // Cancellation of a subtree.
+  std::string log;
+  replication.add_callback([&log]{log += "r";});
+  stream.add_callback([&log]{log += "s";});
+  const auto id = server.add_callback([&log]{log += "x";});
+  replication.cancel();
+  ASSERT(replication.is_cancelled() && stream.is_cancelled());
+  ASSERT(!root.is_cancelled() && !server.is_cancelled());
+  ASSERT(log == "rs");
+  replication.cancel();
+  ASSERT(log == "rs");
+
+  // Callback added to the cancelled scope.
+  stream.add_callback([&log]{log += "l";});
+  ASSERT(log == "rsl");
+
+  // Child of the cancelled scope.
+  {
+    prg::Cancellation_scope child{stream};
+    ASSERT(child.is_cancelled());
+  }
+
+  // Restart of the subsystem.
+  prg::Cancellation_scope replication2{root};
+  ASSERT(!replication2.is_cancelled());
+
+  // Parent destroyed before the child.
+  auto parent = std::make_unique<prg::Cancellation_scope>(root);
+  prg::Cancellation_scope orphan{*parent};
+  parent.reset();
+  ASSERT(!orphan.is_cancelled());
+  orphan.cancel();
+  ASSERT(orphan.is_cancelled() && !root.is_cancelled());
+
+  // Stop signal.
+  server.remove_callback(id);
+  server.add_callback([]{throw std::runtime_error{"callback"};});
+  server.add_callback([&log]{log += "y";});
+  ASSERT(!root.cancel_if_stopped());
+  stop_signal = SIGTERM;
+  ASSERT(server.is_cancelled() && replication2.is_cancelled());
+  ASSERT(server.stop_signal() == SIGTERM);
+  try {
+    root.cancel_if_stopped();
+    ASSERT(false);
+  } catch (const std::runtime_error&) {}
+  ASSERT(log == "rsly");
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
@@ -0,0 +1,146 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/checkpoint.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace prg = dmitigr::prg;
+using namespace std::chrono_literals;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+volatile std::uint64_t sink;
+
+/// @returns The duration of `iterations` of the loop with the `checkpoint`.
+template<class F>
+Clock::duration run_loop(const std::uint64_t iterations, F&& checkpoint)
+{
+  std::uint64_t value{};
+  const auto start = Clock::now();
+  for (std::uint64_t i{}; i < iterations; ++i) {
+    value = value * 6364136223846793005 + i;
+    if (checkpoint())
+      break;
+  }
+  sink = value;
+  return Clock::now() - start;
+}
+
+/**
+ * @returns The latency of noticing the stop signal set by another thread
+ * while running the loop with the `checkpoint`.
+ */
+Clock::duration stop_latency(std::atomic_int& stop_signal,
+  prg::Checkpoint checkpoint)
+{
+  stop_signal = 0;
+  std::atomic<Clock::time_point> stop_time{};
+  std::thread stopper{[&]
+  {
+    std::this_thread::sleep_for(50ms);
+    stop_time = Clock::now();
+    stop_signal = SIGTERM;
+  }};
+  std::uint64_t value{};
+  for (std::uint64_t i{}; !checkpoint.is_stopped(); ++i)
+    value = value * 6364136223846793005 + i;
+  const auto result = Clock::now() - stop_time.load();
+  sink = value;
+  stopper.join();
+  return result;
+}
+
+double ns(const Clock::duration d, const std::uint64_t n = 1)
+{
+  return std::chrono::duration<double, std::nano>(d).count() / n;
+}
+
+} // namespace
+
+int main()
+try {
+  std::atomic_int stop_signal{};
+
+  // Fixed period.
+  {
+    prg::Checkpoint checkpoint{4, stop_signal};
+    ASSERT(!checkpoint.is_stopped());
+    stop_signal = SIGINT;
+    ASSERT(!checkpoint.is_stopped() && !checkpoint.is_stopped());
+    ASSERT(checkpoint.is_stopped());
+    ASSERT(checkpoint.is_stopped());
+    ASSERT(checkpoint.stop_signal() == SIGINT);
+    stop_signal = 0;
+  }
+  try {
+    prg::Checkpoint checkpoint{0, stop_signal};
+    ASSERT(false);
+  } catch (const std::invalid_argument&) {}
+
+  // Adaptive period.
+  {
+    prg::Checkpoint checkpoint{1ms, stop_signal};
+    ASSERT(checkpoint.period() == 1);
+    for (int i{}; i < 100'000; ++i)
+      ASSERT(!checkpoint.is_stopped());
+    ASSERT(checkpoint.period() > 1);
+  }
+
+  // Overhead versus shutdown latency.
+  constexpr std::uint64_t iterations{50'000'000};
+  const auto plain = run_loop(iterations, []{return false;});
+  const auto every = run_loop(iterations, [&stop_signal]
+  {
+    return stop_signal.load(std::memory_order_acquire) != 0;
+  });
+  prg::Checkpoint fixed{1024, stop_signal};
+  const auto amortized = run_loop(iterations, [&fixed]
+  {
+    return fixed.is_stopped();
+  });
+  prg::Checkpoint adaptive{1ms, stop_signal};
+  const auto adapted = run_loop(iterations, [&adaptive]
+  {
+    return adaptive.is_stopped();
+  });
+  const auto fixed_latency = stop_latency(stop_signal, {1024, stop_signal});
+  const auto adaptive_latency = stop_latency(stop_signal, {1ms, stop_signal});
+  std::cout << "ns/iteration: plain " << ns(plain, iterations)
+            << ", every " << ns(every, iterations)
+            << ", fixed " << ns(amortized, iterations)
+            << ", adaptive " << ns(adapted, iterations) << std::endl;
+  std::cout << "stop latency (ns): fixed " << ns(fixed_latency)
+            << ", adaptive " << ns(adaptive_latency) << std::endl;
+  ASSERT(fixed_latency < 100ms);
+  ASSERT(adaptive_latency < 100ms);
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
@@ -0,0 +1,162 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/info.hpp"
+#include "../../prg/util.hpp"
+
+#include <atomic>
+#include <csignal>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace prg = dmitigr::prg;
+
+class My_info final : public prg::Info {
+public:
+  std::filesystem::path executable_path() const override
+  {
+    return {};
+  }
+
+  std::string synopsis() const override
+  {
+    return {};
+  }
+
+private:
+  void init(int, const char* const*) override
+  {}
+};
+
+std::unique_ptr<prg::Info> prg::Info::make()
+{
+  return std::make_unique<My_info>();
+}
+
+prg::Task<int> answer()
+{
+  co_return 42;
+}
+
+prg::Task<> fail()
+{
+  co_await answer();
+  throw std::runtime_error{"coroutine"};
+}
+
+prg::Task<> wait_stop(int& signal)
+{
+  signal = co_await prg::on_stop_signal();
+}
+
+int main(int argc, char* argv[])
+try {
+  auto& info = prg::Info::initialize(argc, argv);
+  auto& waiters = prg::Stop_waiters::instance();
+
+  // Awaiting task.
+  {
+    auto task = []() -> prg::Task<int>
+    {
+      co_return co_await answer() + 1;
+    }();
+    ASSERT(!task.is_done());
+    task.start();
+    ASSERT(task.is_done());
+    ASSERT(task.result() == 43);
+  }
+
+  // Awaiting stop signal.
+  std::vector<int> signals(1000);
+  std::vector<prg::Task<>> tasks;
+  for (auto& signal : signals) {
+    tasks.push_back(wait_stop(signal));
+    tasks.back().start();
+  }
+  {
+    // Destroyed while suspended.
+    int signal{};
+    auto task = wait_stop(signal);
+    task.start();
+    ASSERT(waiters.size() == signals.size() + 1);
+  }
+  ASSERT(waiters.size() == signals.size());
+  ASSERT(!waiters.resume_if_stopped());
+
+  // Awaiting stop signal concurrently with its setting and resumption.
+  std::vector<int> late_signals(1000);
+  std::vector<prg::Task<>> late_tasks;
+  for (auto& signal : late_signals)
+    late_tasks.push_back(wait_stop(signal));
+  std::atomic_bool is_started{};
+  std::thread starter{[&late_tasks, &is_started]
+  {
+    for (auto& task : late_tasks)
+      task.start();
+    is_started = true;
+  }};
+
+  // Failing task.
+  auto failing = fail();
+  failing.start();
+  ASSERT(failing.is_done());
+  ASSERT(info.stop_signal == SIGTERM);
+  ASSERT(prg::First_error::is_captured());
+  try {
+    failing.result();
+    ASSERT(false);
+  } catch (const std::runtime_error& e) {
+    ASSERT(std::string_view{e.what()} == "coroutine");
+  }
+
+  std::size_t resumed_count{};
+  while (!is_started)
+    resumed_count += waiters.resume_if_stopped();
+  starter.join();
+  resumed_count += waiters.resume_if_stopped();
+  ASSERT(resumed_count >= signals.size());
+  ASSERT(resumed_count <= signals.size() + late_signals.size());
+  ASSERT(!waiters.size());
+  for (std::size_t i{}; i < signals.size(); ++i) {
+    ASSERT(tasks[i].is_done());
+    ASSERT(signals[i] == SIGTERM);
+  }
+  for (std::size_t i{}; i < late_signals.size(); ++i) {
+    ASSERT(late_tasks[i].is_done());
+    ASSERT(late_signals[i] == SIGTERM);
+  }
+
+  // Awaiting when already stopped.
+  int signal{};
+  auto task = wait_stop(signal);
+  task.start();
+  ASSERT(task.is_done() && signal == SIGTERM);
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
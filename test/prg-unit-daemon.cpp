@@ -0,0 +1,184 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/daemon.hpp"
+
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+int main()
+try {
+  namespace prg = dmitigr::prg;
+  namespace fs = std::filesystem;
+  const auto dir = fs::temp_directory_path();
+
+  // Pidfile
+  {
+    const auto path = dir / ("dmitigr_prg_daemon." +
+      std::to_string(getpid()) + ".pid");
+    {
+      const prg::Pidfile pidfile{path};
+      ASSERT(fs::exists(path));
+      std::string pid;
+      std::ifstream{path} >> pid;
+      ASSERT(pid == std::to_string(getpid()));
+
+      // The lock is per open file description, so the second one must fail.
+      try {
+        const prg::Pidfile locked{path};
+        ASSERT(false);
+      } catch (const std::runtime_error& e) {
+        ASSERT(std::string{e.what()}.find(pid) != std::string::npos);
+      }
+    }
+    ASSERT(!fs::exists(path));
+
+    // The file replaced at the path must not be removed by the former owner.
+    {
+      auto former = std::make_unique<prg::Pidfile>(path);
+      fs::remove(path);
+      const prg::Pidfile current{path};
+      former.reset();
+      ASSERT(fs::exists(path));
+    }
+    ASSERT(!fs::exists(path));
+  }
+
+  // Daemonization
+  {
+    const auto path = dir / ("dmitigr_prg_daemon." +
+      std::to_string(getpid()) + ".daemon.pid");
+    int fds[2];
+    ASSERT(!pipe(fds));
+    const pid_t pid{fork()};
+    ASSERT(pid >= 0);
+    if (!pid) {
+      close(fds[0]);
+      try {
+        prg::Pidfile pidfile{path};
+        prg::Daemonize_options options;
+        options.keep_fds.push_back(fds[1]);
+        prg::Flight_recorder::install_fatal_handlers();
+        std::signal(SIGUSR1, [](int){});
+        std::signal(SIGHUP, SIG_IGN);
+        prg::daemonize(pidfile, options);
+
+        // Report the state of the daemon.
+        struct stat in{};
+        struct stat null{};
+        const bool is_null{!fstat(STDIN_FILENO, &in) &&
+          !stat("/dev/null", &null) && in.st_rdev == null.st_rdev};
+        const mode_t mask{umask(0)};
+        std::string pidfile_pid;
+        std::ifstream{path} >> pidfile_pid;
+        const auto disposition = [](const int sig)
+        {
+          struct sigaction sa{};
+          sigaction(sig, nullptr, &sa);
+          return sa.sa_handler;
+        };
+        const bool is_kept{disposition(SIGSEGV) != SIG_DFL};
+        const bool is_reset{disposition(SIGUSR1) == SIG_DFL &&
+          disposition(SIGHUP) == SIG_DFL};
+        const auto report = std::to_string(getpid()).append(" ")
+          .append(pidfile_pid).append(" ")
+          .append(std::to_string(getppid() != pid)).append(" ")
+          .append(std::to_string(is_null)).append(" ")
+          .append(std::to_string(mask)).append(" ")
+          .append(std::to_string(is_kept)).append(" ")
+          .append(std::to_string(is_reset)).append(" ")
+          .append(fs::current_path().string());
+        (void)write(fds[1], report.data(), report.size());
+      } catch (...) {}
+      _exit(EXIT_SUCCESS);
+    }
+    close(fds[1]);
+    int status{};
+    ASSERT(waitpid(pid, &status, 0) == pid);
+    ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS);
+
+    std::string report;
+    char buf[256];
+    for (ssize_t n; (n = read(fds[0], buf, sizeof(buf))) > 0;)
+      report.append(buf, static_cast<std::size_t>(n));
+    close(fds[0]);
+    std::istringstream stream{report};
+    std::string daemon_pid, pidfile_pid, cwd;
+    bool is_reparented{}, is_null{}, is_kept{}, is_reset{};
+    mode_t mask{};
+    stream >> daemon_pid >> pidfile_pid >> is_reparented >> is_null >> mask
+      >> is_kept >> is_reset >> cwd;
+    ASSERT(!daemon_pid.empty() && daemon_pid != std::to_string(pid));
+    ASSERT(pidfile_pid == daemon_pid);
+    ASSERT(is_reparented);
+    ASSERT(is_null);
+    ASSERT(mask == 027);
+    ASSERT(is_kept);
+    ASSERT(is_reset);
+    ASSERT(cwd == "/");
+
+    // The PID file is removed by the daemon (the owner) on exit.
+    for (int i{}; i < 100 && fs::exists(path); ++i)
+      usleep(10000);
+    ASSERT(!fs::exists(path));
+  }
+
+  // Notification
+  {
+    unsetenv("NOTIFY_SOCKET");
+    ASSERT(!prg::notify_ready());
+
+    const auto path = dir / ("dmitigr_prg_daemon." +
+      std::to_string(getpid()) + ".sock");
+    const int fd{socket(AF_UNIX, SOCK_DGRAM, 0)};
+    ASSERT(fd >= 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    ASSERT(path.string().size() < sizeof(addr.sun_path));
+    std::strcpy(addr.sun_path, path.c_str());
+    ASSERT(!bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)));
+    ASSERT(!setenv("NOTIFY_SOCKET", path.c_str(), 1));
+
+    ASSERT(prg::notify_ready());
+    ASSERT(prg::notify_status("warming up"));
+    char buf[64];
+    auto size = recv(fd, buf, sizeof(buf), 0);
+    ASSERT(std::string(buf, size) == "READY=1");
+    size = recv(fd, buf, sizeof(buf), 0);
+    ASSERT(std::string(buf, size) == "STATUS=warming up");
+    close(fd);
+    fs::remove(path);
+  }
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
@@ -0,0 +1,151 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/deadline.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace {
+std::atomic_int alarm_count;
+std::atomic_int other_alarm_count;
+} // namespace
+
+int main()
+try {
+  namespace prg = dmitigr::prg;
+  using namespace std::chrono_literals;
+
+  // Durations.
+  ASSERT(prg::detail::to_duration("30") == 30s);
+  ASSERT(prg::detail::to_duration("30s") == 30s);
+  ASSERT(prg::detail::to_duration("250ms") == 250ms);
+  ASSERT(prg::detail::to_duration("2m") == 2min);
+  ASSERT(prg::detail::to_duration("1h") == 1h);
+  for (const auto* const invalid : {"", "s", "-1", "1d", "1.5s"}) {
+    try {
+      prg::detail::to_duration(invalid);
+      ASSERT(false);
+    } catch (const std::invalid_argument&) {}
+  }
+
+  // Soft deadline.
+  std::atomic_int stop_signal{};
+  {
+    prg::Deadline deadline{{.soft = 50ms, .hard = 10s}, stop_signal};
+    ASSERT(!deadline.is_expired());
+    ASSERT(deadline.remaining() > 0ms && deadline.remaining() <= 50ms);
+    try {
+      prg::Deadline another{{.soft = 1s, .hard = {}}, stop_signal};
+      ASSERT(false);
+    } catch (const std::logic_error&) {}
+    const auto start = std::chrono::steady_clock::now();
+    while (!stop_signal && std::chrono::steady_clock::now() - start < 5s)
+      std::this_thread::sleep_for(1ms);
+    ASSERT(deadline.is_expired());
+    ASSERT(stop_signal == SIGALRM);
+    ASSERT(deadline.remaining() == 0ms);
+  }
+
+  // The other SIGALRMs are passed to the previous handler.
+  {
+    ASSERT(std::signal(SIGALRM, [](int){++alarm_count;}) != SIG_ERR);
+    stop_signal = 0;
+    {
+      prg::Deadline deadline{{.soft = 10s, .hard = {}}, stop_signal};
+      ASSERT(!raise(SIGALRM));
+      ASSERT(alarm_count == 1);
+      alarm(1);
+      const auto start = std::chrono::steady_clock::now();
+      while (alarm_count < 2 && std::chrono::steady_clock::now() - start < 5s)
+        std::this_thread::sleep_for(1ms);
+      ASSERT(alarm_count == 2);
+      ASSERT(!stop_signal && !deadline.is_expired());
+
+      // The handler set before rearm() is not recorded as the previous one.
+      ASSERT(std::signal(SIGALRM, [](int){++other_alarm_count;}) != SIG_ERR);
+      deadline.rearm();
+      ASSERT(!raise(SIGALRM));
+      ASSERT(alarm_count == 3 && !other_alarm_count);
+    }
+    ASSERT(!raise(SIGALRM));
+    ASSERT(alarm_count == 4);
+    ASSERT(std::signal(SIGALRM, SIG_DFL) != SIG_ERR);
+  }
+
+  // The default action is performed if there was no previous handler.
+  {
+    const auto pid = fork();
+    ASSERT(pid >= 0);
+    if (!pid) {
+      std::atomic_int child_stop_signal{};
+      prg::Deadline deadline{{.soft = 10s, .hard = {}}, child_stop_signal};
+      raise(SIGALRM);
+      _exit(0);
+    }
+    int status{};
+    ASSERT(waitpid(pid, &status, 0) == pid);
+    ASSERT(WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM);
+  }
+
+  // Rearming in the child.
+  {
+    stop_signal = 0;
+    prg::Deadline deadline{{.soft = 100ms, .hard = {}}, stop_signal};
+    const auto pid = fork();
+    ASSERT(pid >= 0);
+    if (!pid) {
+      deadline.rearm();
+      const auto start = std::chrono::steady_clock::now();
+      while (!stop_signal && std::chrono::steady_clock::now() - start < 5s)
+        std::this_thread::sleep_for(1ms);
+      _exit(stop_signal == SIGALRM && deadline.is_expired() ? 0 : 1);
+    }
+    int status{};
+    ASSERT(waitpid(pid, &status, 0) == pid);
+    ASSERT(WIFEXITED(status) && !WEXITSTATUS(status));
+  }
+
+  // Hard deadline.
+  const auto pid = fork();
+  ASSERT(pid >= 0);
+  if (!pid) {
+    std::atomic_int child_stop_signal{};
+    prg::Deadline deadline{{.soft = {}, .hard = 50ms}, child_stop_signal};
+    std::this_thread::sleep_for(5s);
+    _exit(0);
+  }
+  int status{};
+  ASSERT(waitpid(pid, &status, 0) == pid);
+  ASSERT(WIFEXITED(status));
+  ASSERT(WEXITSTATUS(status) == prg::Deadline::hard_exit_code);
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
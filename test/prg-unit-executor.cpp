@@ -0,0 +1,187 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/executor.hpp"
+#include "../../prg/info.hpp"
+#include "../../prg/util.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace prg = dmitigr::prg;
+
+class My_info final : public prg::Info {
+public:
+  std::filesystem::path executable_path() const override
+  {
+    return {};
+  }
+
+  std::string synopsis() const override
+  {
+    return {};
+  }
+
+private:
+  void init(int, const char* const*) override
+  {}
+};
+
+std::unique_ptr<prg::Info> prg::Info::make()
+{
+  return std::make_unique<My_info>();
+}
+
+int main(int argc, char* argv[])
+try {
+  using namespace std::chrono_literals;
+
+  // Default thread count.
+  {
+    prg::Executor executor;
+    ASSERT(executor.thread_count() >= 1);
+  }
+
+  // Draining with nested submits.
+  {
+    std::atomic_int count{};
+    prg::Executor executor{{.thread_count = 4}};
+    ASSERT(executor.thread_count() == 4);
+    for (int i{}; i < 1000; ++i) {
+      ASSERT(executor.submit([&executor, &count]
+      {
+        ++count;
+        executor.submit([&count]{++count;});
+      }));
+    }
+    std::this_thread::sleep_for(50ms);
+    executor.stop();
+    ASSERT(executor.is_stopping());
+    ASSERT(!executor.submit([]{}));
+    executor.join();
+    ASSERT(count >= 1000 && count <= 2000);
+    ASSERT(!executor.error());
+  }
+
+  // Discarding.
+  {
+    std::atomic_int count{};
+    prg::Executor executor{{.thread_count = 1,
+      .stop_policy = prg::Stop_policy::discard}};
+    ASSERT(executor.submit([]{std::this_thread::sleep_for(100ms);}));
+    for (int i{}; i < 100; ++i)
+      ASSERT(executor.submit([&count]{++count;}));
+    std::this_thread::sleep_for(20ms);
+    executor.stop();
+    executor.join();
+    ASSERT(count == 0);
+  }
+
+  // Discarding concurrently with submits: no task is executed after stop.
+  for (int n{}; n < 10; ++n) {
+    std::atomic_bool is_released{};
+    std::atomic_int count{};
+    prg::Executor executor{{.thread_count = 1,
+      .stop_policy = prg::Stop_policy::discard}};
+    ASSERT(executor.submit([&is_released]
+    {
+      while (!is_released)
+        std::this_thread::sleep_for(1ms);
+    }));
+    std::vector<std::thread> submitters;
+    for (int i{}; i < 4; ++i) {
+      submitters.emplace_back([&executor, &count]
+      {
+        while (executor.submit([&count]{++count;}));
+      });
+    }
+    std::this_thread::sleep_for(5ms);
+    executor.stop();
+    for (auto& submitter : submitters)
+      submitter.join();
+    is_released = true;
+    executor.join();
+    ASSERT(count == 0);
+  }
+
+  // Stopping on error.
+  {
+    prg::Executor executor{{.thread_count = 2}};
+    ASSERT(executor.submit([]{throw std::runtime_error{"task"};}));
+    const auto start = std::chrono::steady_clock::now();
+    while (!executor.is_stopping() &&
+      std::chrono::steady_clock::now() - start < 5s)
+      std::this_thread::sleep_for(1ms);
+    ASSERT(executor.is_stopping());
+    executor.join();
+    ASSERT(executor.error());
+    try {
+      std::rethrow_exception(executor.error());
+    } catch (const std::runtime_error& e) {
+      ASSERT(std::string_view{e.what()} == "task");
+    }
+  }
+
+  const char* const args[]{argc ? argv[0] : "prog"};
+  auto& info = prg::Info::initialize(1, args);
+
+  // Stopping by handle_signal() wakes up the watcher of the stop signal.
+  {
+    auto& waiters = prg::Stop_waiters::instance();
+    waiters.set_watch_interval(1h);
+    prg::set_signals();
+    prg::Executor executor{{.thread_count = 2}};
+    std::this_thread::sleep_for(50ms);
+    ASSERT(!executor.is_stopping());
+    ASSERT(!raise(SIGTERM));
+    const auto start = std::chrono::steady_clock::now();
+    executor.join();
+    ASSERT(std::chrono::steady_clock::now() - start < 1s);
+    ASSERT(executor.is_stopping());
+    waiters.set_watch_interval(20ms);
+    info.stop_signal = 0;
+  }
+
+  // Stopping by the stop signal wakes up the idle workers.
+  {
+    prg::Executor executor{{.thread_count = 2}};
+    std::this_thread::sleep_for(50ms);
+    ASSERT(!executor.is_stopping());
+    info.stop_signal = SIGTERM;
+    const auto start = std::chrono::steady_clock::now();
+    executor.join();
+    ASSERT(std::chrono::steady_clock::now() - start < 1s);
+    ASSERT(executor.is_stopping());
+    ASSERT(!executor.submit([]{}));
+  }
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
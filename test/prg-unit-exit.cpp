@@ -0,0 +1,106 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/exit.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+int main()
+try {
+  namespace prg = dmitigr::prg;
+  using namespace std::chrono_literals;
+
+  auto& sinks = prg::Exit_sinks::instance();
+  ASSERT(!sinks.is_fast_exit_enabled());
+  ASSERT(sinks.flush(1s).empty());
+
+  // Parallel flush.
+  std::atomic_int flushed{};
+  const auto slow = [&flushed]
+  {
+    std::this_thread::sleep_for(100ms);
+    ++flushed;
+  };
+  const auto id1 = sinks.add("slow1", slow);
+  const auto id2 = sinks.add("slow2", slow);
+  const auto id3 = sinks.add("throwing", []{throw 1;});
+  auto start = std::chrono::steady_clock::now();
+  ASSERT(sinks.flush(5s).empty());
+  ASSERT(flushed == 2);
+  ASSERT(std::chrono::steady_clock::now() - start < 190ms);
+
+  // Timeout.
+  sinks.remove(id1);
+  sinks.remove(id3);
+  sinks.remove(id3);
+  const auto names = sinks.flush(10ms);
+  ASSERT(names.size() == 1 && names.front() == "slow2");
+  std::this_thread::sleep_for(200ms);
+  ASSERT(flushed == 3);
+  sinks.remove(id2);
+
+  // Invalid sink.
+  try {
+    sinks.add("invalid", {});
+    ASSERT(false);
+  } catch (const std::invalid_argument&) {}
+
+  // Removing of the signal sink awaits its flushing in progress.
+  {
+    struct Sink final {
+      std::atomic_bool is_flushing{};
+      std::atomic_bool is_flushed{};
+    } sink;
+    ASSERT(!prg::Signal_sinks::add(nullptr, &sink));
+    ASSERT(prg::Signal_sinks::add([](void* const data) noexcept
+    {
+      auto& sink = *static_cast<Sink*>(data);
+      sink.is_flushing = true;
+      std::this_thread::sleep_for(100ms);
+      sink.is_flushed = true;
+    }, &sink));
+    std::thread flusher{[]{prg::Signal_sinks::flush();}};
+    while (!sink.is_flushing)
+      std::this_thread::yield();
+    prg::Signal_sinks::remove(&sink);
+    ASSERT(sink.is_flushed);
+    flusher.join();
+    sink.is_flushed = false;
+    prg::Signal_sinks::flush();
+    ASSERT(!sink.is_flushed);
+  }
+
+  // Settings.
+  sinks.set_fast_exit_enabled(true, 250ms);
+  ASSERT(sinks.is_fast_exit_enabled());
+  ASSERT(sinks.fast_exit_timeout() == 250ms);
+
+  // Fast exit.
+  sinks.add("final", []{std::cout << "ok" << std::endl;});
+  prg::exit_program(0);
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
@@ -0,0 +1,113 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/handoff.hpp"
+
+#include <future>
+#include <iostream>
+#include <string>
+
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+int main()
+try {
+  namespace prg = dmitigr::prg;
+  namespace fs = std::filesystem;
+
+  // Create the descriptors to hand off: the pipes to check identity.
+  std::vector<prg::Handoff_descriptor> descriptors;
+  std::vector<int> read_ends;
+  for (int i{}; i < 260; ++i) {
+    int fds[2];
+    ASSERT(!pipe(fds));
+    read_ends.push_back(fds[0]);
+    descriptors.push_back({"pipe" + std::to_string(i), fds[1]});
+  }
+  const std::string state(100000, 's');
+
+  const auto path = fs::temp_directory_path() /
+    ("dmitigr_prg_handoff." + std::to_string(getpid()) + ".sock");
+  prg::Handoff_server server{path};
+  ASSERT(!server.serve(descriptors, state, std::chrono::milliseconds{1}, 0));
+  {
+    struct stat st{};
+    ASSERT(!stat(path.c_str(), &st));
+    ASSERT((st.st_mode & 0777) == 0600);
+  }
+
+  // The connection from other user is rejected.
+  if (!geteuid()) {
+    ASSERT(!chmod(path.c_str(), 0666));
+    const pid_t pid{fork()};
+    ASSERT(pid >= 0);
+    if (!pid) {
+      if (setgid(65534) || setuid(65534))
+        _exit(1);
+      try {
+        prg::receive_handoff(path);
+      } catch (...) {
+        _exit(0);
+      }
+      _exit(2);
+    }
+    ASSERT(!server.serve(descriptors, state, std::chrono::milliseconds{300},
+        0));
+    int status{};
+    ASSERT(waitpid(pid, &status, 0) == pid);
+    ASSERT(WIFEXITED(status) && !WEXITSTATUS(status));
+    ASSERT(!chmod(path.c_str(), 0600));
+  }
+  auto served = std::async(std::launch::async, [&]
+  {
+    return server.serve(descriptors, state, std::nullopt, 0);
+  });
+
+  const std::string option{"--handoff=" + path.string()};
+  const char* const argv[] = {"prog", option.c_str()};
+  int argc{2};
+  const char* const* argv_p{argv};
+  const auto handoff = prg::receive_handoff(
+    prg::make_command(&argc, &argv_p, false));
+  ASSERT(served.get());
+  ASSERT(handoff);
+  ASSERT(handoff->state() == state);
+  ASSERT(handoff->descriptors().size() == descriptors.size());
+  ASSERT(handoff->fd("none") < 0);
+
+  for (std::size_t i{}; i < descriptors.size(); ++i) {
+    const auto& d = handoff->descriptors()[i];
+    ASSERT(d.name == descriptors[i].name);
+    ASSERT(d.fd == handoff->fd(d.name));
+    const char c{static_cast<char>(i)};
+    ASSERT(write(d.fd, &c, 1) == 1);
+    char r{};
+    ASSERT(read(read_ends[i], &r, 1) == 1);
+    ASSERT(r == c);
+    close(d.fd);
+    close(descriptors[i].fd);
+    close(read_ends[i]);
+  }
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
@@ -18,8 +18,18 @@
 #include "../../prg/info.hpp"
 #include "../../prg/util.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
 #include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 namespace prg = dmitigr::prg;
 
@@ -45,6 +55,11 @@ public:
     return "[--detach]";
   }
 
+  std::vector<std::string_view> standard_options() const override
+  {
+    return {"cpus", "timeout", "startup-profile"};
+  }
+
 private:
   std::filesystem::path executable_path_;
   std::string synopsis_{};
@@ -76,6 +91,150 @@ try {
   // Check synopsis.
   const auto [detach_o] = cmd.options("detach");
   detach_o.is_valid_throw_if_value();
+
+  // Check identity.
+  {
+    const auto& identity = info.identity();
+    DMITIGR_ASSERT(&info.program_name() == &identity.program_name);
+    DMITIGR_ASSERT(identity.program_name ==
+      std::filesystem::path{argv[0]}.filename().string());
+    DMITIGR_ASSERT(identity.executable_path == info.executable_path());
+    DMITIGR_ASSERT(identity.pid > 0);
+    DMITIGR_ASSERT(identity.start_time <= std::chrono::system_clock::now());
+
+#ifndef _WIN32
+    // The process ID is refreshed in the child process.
+    const pid_t pid{prg::Info::fork_process()};
+    DMITIGR_ASSERT(pid >= 0);
+    if (!pid)
+      _exit(identity.pid == getpid() ? 0 : 1);
+    int status{};
+    DMITIGR_ASSERT(waitpid(pid, &status, 0) == pid);
+    DMITIGR_ASSERT(WIFEXITED(status) && !WEXITSTATUS(status));
+    DMITIGR_ASSERT(identity.pid == getpid());
+#endif
+  }
+
+  // Check startup profile.
+  {
+    auto& profiler = prg::Startup_profiler::instance();
+    profiler.mark("check");
+    const auto phases = profiler.phases();
+    DMITIGR_ASSERT(phases.size() == 6);
+    DMITIGR_ASSERT(phases.front().name == "load");
+    DMITIGR_ASSERT(phases.back().name == "check");
+    for (std::size_t i{1}; i < phases.size(); ++i)
+      DMITIGR_ASSERT(phases[i].offset == phases[i - 1].offset + phases[i].duration);
+    profiler.finish();
+    DMITIGR_ASSERT(profiler.is_finished());
+    profiler.mark("ignored");
+    DMITIGR_ASSERT(profiler.phases().size() == 7);
+  }
+
+  // Check standard option names.
+  {
+    const auto& names = prg::Info::standard_option_names();
+    for (const auto* const name : {"cpus", "nofile", "startup-profile"})
+      DMITIGR_ASSERT(std::find(names.begin(), names.end(), name) !=
+        names.end());
+  }
+
+  // Check the identity is available in init().
+  {
+    class Fixed_info final : public prg::Info {
+    public:
+      std::string name_in_init;
+
+      std::filesystem::path executable_path() const override
+      {
+        return "/usr/bin/fixed";
+      }
+
+      std::string synopsis() const override
+      {
+        return {};
+      }
+
+    private:
+      void init(int, const char* const*) override
+      {
+        name_in_init = program_name();
+      }
+    };
+    const auto fixed = prg::Info::create(std::make_unique<Fixed_info>(), 1,
+      argv);
+    DMITIGR_ASSERT(static_cast<const Fixed_info&>(*fixed).name_in_init ==
+      "fixed");
+  }
+
+  // Check the standard options are opt-in.
+  {
+    class Plain_info final : public My_info {
+      std::vector<std::string_view> standard_options() const override
+      {
+        return {};
+      }
+    };
+    const char* const plain_argv[] = {argv[0], "--cpus=0", "--timeout=1s"};
+    const auto plain = prg::Info::create(std::make_unique<Plain_info>(), 3,
+      plain_argv);
+    const prg::Info::Scope scope{*plain};
+    const auto& command = My_info::instance().command();
+    DMITIGR_ASSERT(command.options().size() == 2);
+    DMITIGR_ASSERT(command["cpus"].value() == "0");
+    DMITIGR_ASSERT(command["timeout"].value() == "1s");
+  }
+
+  // Check instances which are not process-wide.
+  {
+    const char* const embedded_argv[] = {argv[0], "--cpus=0", "--embedded",
+      "--timeout=1s", "param"};
+    const auto embedded = prg::Info::create(std::make_unique<My_info>(), 5,
+      embedded_argv);
+    DMITIGR_ASSERT(&prg::Info::instance() == &info);
+    {
+      const prg::Info::Scope scope{*embedded};
+      DMITIGR_ASSERT(&prg::Info::instance() == embedded.get());
+      const auto& command = My_info::instance().command();
+      DMITIGR_ASSERT(command.options().size() == 1);
+      DMITIGR_ASSERT(command.parameters().size() == 1);
+      DMITIGR_ASSERT(command["embedded"]);
+      prg::Info::instance().stop_signal = SIGTERM;
+    }
+    DMITIGR_ASSERT(&prg::Info::instance() == &info);
+    DMITIGR_ASSERT(!info.stop_signal);
+    DMITIGR_ASSERT(embedded->stop_signal == SIGTERM);
+  }
+
+  // Check first error.
+  {
+    DMITIGR_ASSERT(!prg::First_error::is_captured());
+    std::thread::id worker_id;
+    std::thread worker{[&worker_id]
+    {
+      worker_id = std::this_thread::get_id();
+      try {
+        prg::with_signal_on_error([]{throw std::runtime_error{"first"};},
+          SIGINT);
+      } catch (...) {}
+    }};
+    worker.join();
+    try {
+      prg::with_signal_on_error([]{throw std::runtime_error{"second"};});
+    } catch (...) {}
+    DMITIGR_ASSERT(info.stop_signal == SIGTERM);
+    DMITIGR_ASSERT(prg::First_error::is_captured());
+    DMITIGR_ASSERT(prg::First_error::thread_id() == worker_id);
+    DMITIGR_ASSERT(prg::First_error::stop_signal() == SIGINT);
+    DMITIGR_ASSERT(prg::First_error::time() <=
+      std::chrono::system_clock::now());
+    try {
+      prg::First_error::rethrow_if_captured();
+      DMITIGR_ASSERT(false);
+    } catch (const std::runtime_error& e) {
+      DMITIGR_ASSERT(std::string_view{e.what()} == "first");
+    }
+  }
 } catch (const std::exception& e) {
   std::cerr << e.what() << std::endl;
   return 1;
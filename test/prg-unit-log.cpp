@@ -0,0 +1,188 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/log.hpp"
+#include "../../prg/util.hpp"
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace prg = dmitigr::prg;
+
+class My_info final : public prg::Info {
+public:
+  std::filesystem::path executable_path() const override
+  {
+    return "/bin/logtest";
+  }
+
+  std::string synopsis() const override
+  {
+    return {};
+  }
+
+private:
+  void init(int, const char* const*) override
+  {}
+};
+
+std::unique_ptr<prg::Info> prg::Info::make()
+{
+  return std::make_unique<My_info>();
+}
+
+namespace {
+
+/// @returns The content of the temporary file `file`.
+std::string read_file(std::FILE* const file)
+{
+  std::fflush(file);
+  std::string result;
+  char buf[4096];
+  for (off_t offset{};;) {
+    const auto count = pread(fileno(file), buf, sizeof(buf), offset);
+    if (count <= 0)
+      break;
+    result.append(buf, static_cast<std::size_t>(count));
+    offset += count;
+  }
+  return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+try {
+  std::FILE* const file{std::tmpfile()};
+  ASSERT(file);
+  const int fd{fileno(file)};
+
+  // The threads are started in two waves, so the second one reuses the rings
+  // of the first one. The lines are flushed concurrently as by the signal
+  // handlers.
+  constexpr int thread_count{4};
+  constexpr int line_count{20000};
+  {
+    prg::Logger logger{{fd, 4096, std::chrono::milliseconds{1}, "test: "}};
+    ASSERT(logger.prefix() == "test: ");
+
+    std::atomic_bool is_done{};
+    std::thread flusher{[&is_done]
+    {
+      while (!is_done)
+        prg::Signal_sinks::flush();
+    }};
+    for (int wave{}; wave < 2; ++wave) {
+      std::vector<std::thread> threads;
+      for (int i{wave * thread_count}; i < (wave + 1) * thread_count; ++i) {
+        threads.emplace_back([&logger, i]
+        {
+          for (int j{}; j < line_count; ++j)
+            logger.log(std::to_string(i).append(" ")
+              .append(std::to_string(j)));
+        });
+      }
+      for (auto& thread : threads)
+        thread.join();
+    }
+    is_done = true;
+    flusher.join();
+
+    // Larger than the buffer.
+    logger.log(std::string(5000, 'x'));
+  }
+
+  // Check that all the lines are written in order of each thread.
+  std::rewind(file);
+  std::map<int, int> next;
+  int large_count{};
+  char buf[8192];
+  while (std::fgets(buf, sizeof(buf), file)) {
+    const std::string line{buf};
+    ASSERT(line.substr(0, 6) == "test: " && line.back() == '\n');
+    if (line.size() == 5000 + 7) {
+      ++large_count;
+      continue;
+    }
+    int thread{}, number{};
+    ASSERT(std::sscanf(line.c_str() + 6, "%d %d", &thread, &number) == 2);
+    ASSERT(next[thread] == number);
+    ++next[thread];
+  }
+  ASSERT(large_count == 1);
+  ASSERT(next.size() == thread_count * 2);
+  for (const auto& [thread, count] : next)
+    ASSERT(count == line_count);
+  std::fclose(file);
+
+  // The default prefix and the flushing by the signal handler.
+  auto& info = prg::Info::initialize(argc, argv);
+  prg::set_signals();
+  {
+    std::FILE* const file{std::tmpfile()};
+    ASSERT(file);
+    const auto prefix = [](const pid_t pid)
+    {
+      return "logtest[" + std::to_string(pid) + "]: ";
+    };
+    prg::Logger_options options;
+    options.fd = fileno(file);
+    options.interval = std::chrono::hours{1};
+    prg::Logger logger{options};
+    ASSERT(logger.prefix() == prefix(getpid()));
+    logger.log("before signal");
+    ASSERT(read_file(file).empty());
+    ASSERT(!raise(SIGTERM));
+    ASSERT(info.stop_signal == SIGTERM);
+    ASSERT(read_file(file) == prefix(getpid()) + "before signal\n");
+
+    // The prefix is of the process at the time of logging.
+    const pid_t pid{prg::Info::fork_process()};
+    ASSERT(pid >= 0);
+    if (!pid) {
+      logger.log("child");
+      logger.flush();
+      _exit(0);
+    }
+    int status{};
+    ASSERT(waitpid(pid, &status, 0) == pid);
+    ASSERT(WIFEXITED(status) && !WEXITSTATUS(status));
+    ASSERT(read_file(file) == prefix(getpid()) + "before signal\n" +
+      prefix(pid) + "child\n");
+    std::fclose(file);
+  }
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
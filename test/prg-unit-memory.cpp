@@ -0,0 +1,254 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/info.hpp"
+#include "../../prg/memory.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace prg = dmitigr::prg;
+
+class My_info final : public prg::Info {
+public:
+  std::filesystem::path executable_path() const override
+  {
+    return {};
+  }
+
+  std::string synopsis() const override
+  {
+    return {};
+  }
+
+  std::vector<std::string_view> standard_options() const override
+  {
+    return standard_option_names();
+  }
+
+private:
+  void init(int, const char* const*) override
+  {}
+};
+
+std::unique_ptr<prg::Info> prg::Info::make()
+{
+  return std::make_unique<My_info>();
+}
+
+namespace {
+
+std::atomic_int fork_thread_count{-1};
+
+/// @returns The number of threads of the process.
+int thread_count()
+{
+  int result{};
+  for ([[maybe_unused]] const auto& e :
+         std::filesystem::directory_iterator{"/proc/self/task"})
+    ++result;
+  return result;
+}
+
+/// @returns `true` if `pred` becomes `true` within 5 seconds.
+template<typename F>
+bool wait_for(F&& pred)
+{
+  const auto end = std::chrono::steady_clock::now() + std::chrono::seconds{5};
+  while (!pred()) {
+    if (std::chrono::steady_clock::now() > end)
+      return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+  return true;
+}
+
+prg::Memory_guard::Options make_options(std::vector<const char*> args)
+{
+  args.insert(args.begin(), "prog");
+  int argc{static_cast<int>(args.size())};
+  const char* const* argv{args.data()};
+  return prg::Memory_guard::Options::make(prg::make_command(&argc, &argv,
+    false));
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+try {
+  using namespace std::chrono_literals;
+  using Options = prg::Memory_guard::Options;
+
+  // The usage compared with the limits.
+  {
+    prg::Memory_usage usage;
+    ASSERT(!usage.used());
+    usage.rss = 10;
+    ASSERT(usage.used() == 10u);
+    usage.cgroup_current = 20;
+    ASSERT(usage.used() == 10u); // the cgroup is not limited
+    usage.cgroup_max = 100;
+    ASSERT(usage.used() == 20u);
+    usage.rss.reset();
+    ASSERT(usage.used() == 20u);
+    usage.rss = 30;
+    ASSERT(usage.used() == 30u);
+  }
+
+  // The sample.
+  {
+    const auto usage = prg::Memory_sampler{}.sample();
+    ASSERT(usage.rss && *usage.rss > 0);
+    ASSERT(usage.used());
+  }
+
+  // The options.
+  {
+    ASSERT(!make_options({}).is_enabled());
+    const auto options = make_options({"--memory-soft-limit=1M",
+        "--memory-hard-limit=50%", "--memory-pressure-limit=10.5",
+        "--memory-check-interval=10"});
+    ASSERT(options.is_enabled());
+    ASSERT(options.soft_limit == 1024u*1024);
+    ASSERT(options.hard_limit ==
+      prg::Memory_guard::physical_limit() / 100 * 50);
+    ASSERT(options.pressure_limit == 10.5);
+    ASSERT(options.interval == 10ms);
+    for (const char* const arg : {"--memory-soft-limit=abc",
+           "--memory-hard-limit=101%", "--memory-hard-limit=0%",
+           "--memory-pressure-limit=0", "--memory-pressure-limit=101",
+           "--memory-pressure-limit=1x", "--memory-check-interval=0"}) {
+      bool is_thrown{};
+      try {
+        make_options({arg});
+      } catch (const std::invalid_argument&) {
+        is_thrown = true;
+      }
+      ASSERT(is_thrown);
+    }
+  }
+
+  // The soft and hard limits.
+  {
+    std::atomic_int stop_signal{};
+    Options options;
+    options.soft_limit = 1;
+    options.interval = 10ms;
+    prg::Memory_guard guard{options, stop_signal};
+    std::atomic_int notified{-1};
+    guard.add_callback([&](const bool is_exceeded, const prg::Memory_usage&)
+    {
+      notified = is_exceeded;
+    });
+    ASSERT(wait_for([&]{return notified == 1;}));
+    ASSERT(guard.is_soft_limit_exceeded());
+    ASSERT(!guard.is_hard_limit_exceeded());
+    ASSERT(!stop_signal);
+
+    // The nested suspension.
+    guard.suspend();
+    guard.suspend();
+    guard.resume();
+    guard.resume();
+    guard.resume(); // no effect
+    notified = -1;
+    guard.add_callback([&](const bool is_exceeded, const prg::Memory_usage&)
+    {
+      notified = is_exceeded;
+    });
+    ASSERT(wait_for([&]{return notified == 1;}));
+  }
+  {
+    std::atomic_int stop_signal{};
+    Options options;
+    options.hard_limit = 1;
+    options.interval = 10ms;
+    const prg::Memory_guard guard{options, stop_signal, SIGUSR1};
+    ASSERT(wait_for([&]{return stop_signal == SIGUSR1;}));
+    ASSERT(guard.is_hard_limit_exceeded());
+    ASSERT(!guard.is_soft_limit_exceeded());
+  }
+  {
+    std::atomic_int stop_signal{};
+    Options options;
+    options.hard_limit = std::uint64_t{1} << 62;
+    options.interval = 10ms;
+    const prg::Memory_guard guard{options, stop_signal};
+    ASSERT(wait_for([&]{return guard.usage().rss.has_value();}));
+    ASSERT(!stop_signal);
+  }
+
+  // The guard of the process-wide instance is stopped for the time of
+  // Info::fork_process() and restarted in both processes.
+  ASSERT(!pthread_atfork([]{fork_thread_count = thread_count();}, nullptr,
+      nullptr));
+  const char* const args[]{argc ? argv[0] : "prog",
+    "--memory-soft-limit=1", "--memory-check-interval=10"};
+  auto& info = prg::Info::initialize(3, args);
+  auto* const guard = info.memory_guard();
+  ASSERT(guard);
+  ASSERT(thread_count() == 2);
+
+  const pid_t pid{prg::Info::fork_process()};
+  ASSERT(pid >= 0);
+  if (!pid) {
+    // The usage of the child is sampled.
+    constexpr std::size_t size{256*1024*1024};
+    const std::unique_ptr<char[]> data{new char[size]};
+    std::memset(data.get(), 1, size);
+    _exit(wait_for([&]
+    {
+      const auto usage = info.memory_guard()->usage();
+      return usage.rss && *usage.rss >= size;
+    }) && thread_count() == 2 ? 0 : 1);
+  }
+  ASSERT(fork_thread_count == 1);
+  int status{};
+  ASSERT(waitpid(pid, &status, 0) == pid);
+  ASSERT(WIFEXITED(status) && !WEXITSTATUS(status));
+
+  ASSERT(thread_count() == 2);
+  std::atomic_bool is_notified{};
+  guard->add_callback([&](bool, const prg::Memory_usage&)
+  {
+    is_notified = true;
+  });
+  ASSERT(wait_for([&]{return is_notified.load();}));
+  ASSERT(guard->usage().rss < 256u*1024*1024);
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
@@ -0,0 +1,109 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/metrics.hpp"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+int main()
+try {
+  namespace prg = dmitigr::prg;
+  using prg::metrics_layout::Kind;
+
+  const auto path = prg::Metrics_registry::default_path("prg-unit-metrics");
+  {
+    prg::Metrics_registry registry{path, {16, 64, 4}};
+    ASSERT(registry.path() == path);
+    ASSERT(std::filesystem::exists(path));
+
+    const auto requests = registry.counter("requests");
+    const auto connections = registry.gauge("connections");
+    const auto latency = registry.histogram("latency_us", {10, 100, 1000});
+    ASSERT(requests.is_valid() && connections.is_valid() && latency.is_valid());
+    ASSERT(!prg::Counter{}.is_valid());
+
+    // Registration is idempotent.
+    registry.counter("requests").add(0);
+    try {
+      registry.gauge("requests");
+      ASSERT(false);
+    } catch (const std::runtime_error&) {}
+    try {
+      registry.histogram("latency_us", {10, 100});
+      ASSERT(false);
+    } catch (const std::runtime_error&) {}
+    try {
+      registry.histogram("invalid", {10, 10});
+      ASSERT(false);
+    } catch (const std::invalid_argument&) {}
+    try {
+      registry.counter(std::string(100, 'a'));
+      ASSERT(false);
+    } catch (const std::invalid_argument&) {}
+
+    // Updates.
+    std::vector<std::thread> threads;
+    for (int i{}; i < 8; ++i) {
+      threads.emplace_back([&]
+      {
+        for (int j{}; j < 10000; ++j) {
+          requests.add();
+          latency.observe(j % 2000);
+        }
+        connections.add(1);
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+    connections.add(-10);
+    ASSERT(connections.value() == -2);
+
+    // Reading.
+    const prg::Metrics_reader reader{path};
+    ASSERT(reader.pid() == static_cast<std::uint64_t>(getpid()));
+    const auto values = reader.read();
+    ASSERT(values.size() == 3);
+    ASSERT(values[0].name == "requests" && values[0].kind == Kind::counter);
+    ASSERT(values[0].value == 80000);
+    ASSERT(values[1].name == "connections" && values[1].kind == Kind::gauge);
+    ASSERT(static_cast<std::int64_t>(values[1].value) == -2);
+    ASSERT(values[2].name == "latency_us" && values[2].kind == Kind::histogram);
+    ASSERT(values[2].value == 80000);
+    ASSERT((values[2].bounds == std::vector<std::uint64_t>{10, 100, 1000}));
+    ASSERT((values[2].buckets == std::vector<std::uint64_t>{
+          8*5*11, 8*5*90, 8*5*900, 8*5*999}));
+    ASSERT(values[2].sum == 8*5*(1999ull*2000/2));
+
+    // Capacity.
+    try {
+      for (int i{}; i < 64; ++i)
+        registry.counter(std::to_string(i));
+      ASSERT(false);
+    } catch (const std::runtime_error&) {}
+  }
+  ASSERT(!std::filesystem::exists(path));
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
@@ -0,0 +1,139 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/multicall.hpp"
+
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace prg = dmitigr::prg;
+
+class My_info final : public prg::Info {
+public:
+  std::filesystem::path executable_path() const override
+  {
+    return {};
+  }
+
+  std::string synopsis() const override
+  {
+    return {};
+  }
+
+private:
+  void init(int, const char* const*) override
+  {}
+};
+
+std::unique_ptr<prg::Info> prg::Info::make()
+{
+  return std::make_unique<My_info>();
+}
+
+int main()
+try {
+  std::vector<std::string> args;
+  const auto record = [&args](const int argc, const char* const* argv)
+  {
+    args.assign(argv, argv + argc);
+    return argc;
+  };
+
+  prg::Multicall multicall;
+  multicall.add("ls", record).add("cat", record)
+    .add("init", record, []{return std::make_unique<My_info>();});
+  ASSERT((multicall.names() == std::vector<std::string>{"cat", "init", "ls"}));
+  ASSERT(multicall.contains("ls"));
+  ASSERT(!multicall.contains("rm"));
+
+  // Invalid registrations.
+  const auto is_invalid = [&multicall](auto&& f)
+  {
+    try {
+      f(multicall);
+    } catch (const std::invalid_argument&) {
+      return true;
+    }
+    return false;
+  };
+  ASSERT(is_invalid([&](auto& m){m.add("", record);}));
+  ASSERT(is_invalid([](auto& m){m.add("rm", {});}));
+  ASSERT(is_invalid([&](auto& m){m.add("ls", record);}));
+
+  // Selection by the file name of argv[0].
+  {
+    const char* const argv[]{"/usr/local/bin/ls", "-l", "dir"};
+    ASSERT(multicall.run(3, argv) == 3);
+    ASSERT((args == std::vector<std::string>{"/usr/local/bin/ls", "-l",
+          "dir"}));
+  }
+
+  // Selection by argv[1], with the arguments shifted.
+  {
+    const char* const argv[]{"/usr/local/bin/tools", "cat", "file"};
+    ASSERT(multicall.run(3, argv) == 2);
+    ASSERT((args == std::vector<std::string>{"cat", "file"}));
+  }
+
+  // The file name of argv[0] takes precedence over argv[1].
+  {
+    const char* const argv[]{"ls", "cat"};
+    ASSERT(multicall.run(2, argv) == 2);
+    ASSERT((args == std::vector<std::string>{"ls", "cat"}));
+  }
+
+  // Unknown program.
+  for (const auto& argv : std::vector<std::vector<const char*>>{
+      {"tools"}, {"tools", "rm", "file"}, {"/bin/rm", "-l"}}) {
+    args.clear();
+    std::string message;
+    try {
+      multicall.run(static_cast<int>(argv.size()), argv.data());
+    } catch (const std::runtime_error& e) {
+      message = e.what();
+    }
+    ASSERT(message == "no program selected; available programs are:"
+      " cat init ls");
+    ASSERT(args.empty());
+  }
+  {
+    const char* const argv[]{nullptr};
+    ASSERT(is_invalid([&](auto& m){m.run(0, argv);}));
+    ASSERT(is_invalid([&](auto& m){m.run(1, argv);}));
+  }
+
+  // The info is initialized before running the program.
+  {
+    ASSERT(!prg::Info::is_initialized());
+    const char* const argv[]{"tools", "init"};
+    ASSERT(multicall.run(2, argv) == 1);
+    ASSERT(prg::Info::is_initialized());
+    ASSERT(dynamic_cast<My_info*>(&prg::Info::instance()));
+  }
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
@@ -0,0 +1,244 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/info.hpp"
+#include "../../prg/profiler.hpp"
+#include "../../prg/util.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace prg = dmitigr::prg;
+
+class My_info final : public prg::Info {
+public:
+  std::filesystem::path executable_path() const override
+  {
+    return "/bin/prg-unit-profiler";
+  }
+
+  std::string synopsis() const override
+  {
+    return {};
+  }
+
+private:
+  void init(int, const char* const*) override
+  {}
+};
+
+std::unique_ptr<prg::Info> prg::Info::make()
+{
+  return std::make_unique<My_info>();
+}
+
+namespace {
+
+volatile unsigned long sink;
+
+/// Consumes the CPU for `duration`.
+void burn(const std::chrono::milliseconds duration)
+{
+  const auto end = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < end) {
+    for (int i{}; i < 10000; ++i)
+      sink = sink + static_cast<unsigned long>(i);
+  }
+}
+
+/// Throws and catches the exceptions for `duration`.
+void throw_repeatedly(const std::chrono::milliseconds duration)
+{
+  const auto end = std::chrono::steady_clock::now() + duration;
+  while (std::chrono::steady_clock::now() < end) {
+    try {
+      throw std::runtime_error{"unwinding"};
+    } catch (const std::runtime_error&) {}
+  }
+}
+
+/// @returns `true` if `folded` is the non-empty folded stacks.
+bool is_folded(const std::string& folded)
+{
+  std::istringstream in{folded};
+  std::string line;
+  std::size_t count{};
+  while (std::getline(in, line)) {
+    const auto pos = line.rfind(' ');
+    if (!pos || pos == std::string::npos ||
+      std::stoul(line.substr(pos + 1)) == 0)
+      return false;
+    ++count;
+  }
+  return count > 0;
+}
+
+/// @returns The content of the file at `path`.
+std::string read_file(const std::filesystem::path& path)
+{
+  std::ifstream file{path};
+  std::ostringstream result;
+  result << file.rdbuf();
+  return result.str();
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+try {
+  using namespace std::chrono_literals;
+  namespace fs = std::filesystem;
+  prg::Info::initialize(argc, argv);
+  fs::current_path(fs::temp_directory_path());
+
+  auto& profiler = prg::Sampling_profiler::instance();
+  ASSERT(!profiler.is_running());
+  ASSERT(profiler.output().empty());
+
+  // Invalid options.
+  const auto is_thrown = [&profiler](const prg::Sampling_options& options)
+  {
+    try {
+      profiler.start(options);
+    } catch (const std::invalid_argument&) {
+      return true;
+    }
+    return false;
+  };
+  ASSERT(is_thrown({0, 1024}));
+  ASSERT(is_thrown({99, 0}));
+  ASSERT(!profiler.is_running());
+
+  // Sampling.
+  profiler.start({1000, 64*1024});
+  ASSERT(profiler.is_running());
+  {
+    bool is_logic_error{};
+    try {
+      profiler.start();
+    } catch (const std::logic_error&) {
+      is_logic_error = true;
+    }
+    ASSERT(is_logic_error);
+  }
+  burn(300ms);
+  profiler.stop();
+  ASSERT(!profiler.is_running());
+  ASSERT(profiler.sample_count() > 10);
+  ASSERT(!profiler.dropped_count());
+  {
+    std::ostringstream out;
+    profiler.write_folded(out);
+    ASSERT(is_folded(out.str()));
+  }
+
+  // Sampling while unwinding the stacks of the exceptions.
+  profiler.start({1000, 64*1024});
+  std::thread thrower{[]{throw_repeatedly(300ms);}};
+  throw_repeatedly(300ms);
+  thrower.join();
+  profiler.stop();
+  ASSERT(profiler.sample_count() > 10);
+
+  // The period of one second.
+  profiler.start({1, 1024});
+  ASSERT(profiler.is_running());
+  profiler.stop();
+
+  // Dropping of samples which don't fit the buffer.
+  profiler.start({1000, 16});
+  burn(100ms);
+  profiler.stop();
+  ASSERT(profiler.sample_count() < 16);
+  ASSERT(profiler.dropped_count() > 0);
+
+  // The default output of set_profiler_signal() is named after the current
+  // process, and the signal toggles the profiling.
+  prg::set_profiler_signal(SIGUSR2);
+  const auto name = [](const pid_t pid)
+  {
+    return fs::path{"prg-unit-profiler." + std::to_string(pid) + ".folded"};
+  };
+  ASSERT(profiler.output() == name(getpid()));
+  const pid_t pid{fork()};
+  ASSERT(pid >= 0);
+  if (!pid)
+    _exit(profiler.output() == name(getpid()) ? 0 : 1);
+  int status{};
+  ASSERT(waitpid(pid, &status, 0) == pid);
+  ASSERT(WIFEXITED(status) && !WEXITSTATUS(status));
+
+  const auto wait_running = [&profiler](const bool value)
+  {
+    const auto end = std::chrono::steady_clock::now() + 5s;
+    while (profiler.is_running() != value) {
+      if (std::chrono::steady_clock::now() > end)
+        return false;
+      std::this_thread::sleep_for(1ms);
+    }
+    return true;
+  };
+  fs::remove(name(getpid()));
+  ASSERT(!raise(SIGUSR2));
+  ASSERT(wait_running(true));
+  burn(100ms);
+  ASSERT(!raise(SIGUSR2));
+  ASSERT(wait_running(false));
+  // The output is written by the service thread after is_running() is false.
+  for (const auto end = std::chrono::steady_clock::now() + 5s;
+       !is_folded(read_file(name(getpid())));) {
+    ASSERT(std::chrono::steady_clock::now() < end);
+    std::this_thread::sleep_for(1ms);
+  }
+  fs::remove(name(getpid()));
+
+  // The output computed on each stop().
+  const auto path = fs::temp_directory_path() / "dmitigr_prg_profiler.folded";
+  int stop_count{};
+  profiler.set_output([&]
+  {
+    ++stop_count;
+    return path;
+  });
+  ASSERT(profiler.output() == path);
+  profiler.start({1000, 64*1024});
+  burn(100ms);
+  profiler.stop();
+  ASSERT(stop_count == 2);
+  ASSERT(is_folded(read_file(path)));
+  fs::remove(path);
+  profiler.set_output(fs::path{});
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
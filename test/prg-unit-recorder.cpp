@@ -0,0 +1,102 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/recorder.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <thread>
+
+#include <sys/wait.h>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+int main()
+try {
+  namespace prg = dmitigr::prg;
+  using prg::Flight_recorder;
+
+  const auto path = std::filesystem::temp_directory_path() /
+    std::string{"prg-unit-recorder."}.append(std::to_string(getpid()));
+  ASSERT(!Flight_recorder::dump());
+  Flight_recorder::set_output(path);
+  ASSERT(Flight_recorder::output() == path);
+
+  // Record in the exited thread and in the current one (with wrap around).
+  std::thread{[]
+  {
+    for (int i{}; i < 10; ++i)
+      Flight_recorder::record(1, i, -i);
+  }}.join();
+  const auto start = std::chrono::steady_clock::now();
+  constexpr int count{1000000};
+  for (int i{}; i < count; ++i)
+    Flight_recorder::record(2, i);
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << "record: " << std::chrono::nanoseconds{elapsed}.count() / count
+            << " ns" << std::endl;
+
+  ASSERT(Flight_recorder::dump(42));
+  {
+    const prg::Flight_recording recording{path};
+    ASSERT(recording.pid() == static_cast<std::uint64_t>(getpid()));
+    ASSERT(recording.reason() == 42);
+    const auto& threads = recording.threads();
+    ASSERT(threads.size() == 2);
+    const auto& exited = threads[0].recorded_count == 10 ? threads[0] : threads[1];
+    const auto& current = &exited == &threads[0] ? threads[1] : threads[0];
+    ASSERT(exited.events.size() == 10);
+    ASSERT(exited.events[9].id == 1 && exited.events[9].a == 9 &&
+      exited.events[9].b == -9);
+    ASSERT(current.recorded_count == count);
+    ASSERT(current.events.size() == Flight_recorder::capacity);
+    ASSERT(current.events.back().id == 2 && current.events.back().a == count - 1);
+    ASSERT(current.events.front().a == count - Flight_recorder::capacity);
+    const auto t1 = recording.to_nanoseconds(current.events.front());
+    const auto t2 = recording.to_nanoseconds(current.events.back());
+    ASSERT(t1 <= t2);
+  }
+
+  // Dump on fatal signal.
+  if (const auto pid = fork(); !pid) {
+    Flight_recorder::install_fatal_handlers();
+    Flight_recorder::record(3, 7);
+    std::raise(SIGSEGV);
+    _exit(0);
+  } else {
+    int status{};
+    ASSERT(waitpid(pid, &status, 0) == pid);
+    ASSERT(WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV);
+    const prg::Flight_recording recording{path};
+    ASSERT(recording.pid() == static_cast<std::uint64_t>(pid));
+    ASSERT(recording.reason() == SIGSEGV);
+    bool is_found{};
+    for (const auto& thread : recording.threads()) {
+      if (!thread.events.empty() && thread.events.back().id == 3)
+        is_found = thread.events.back().a == 7;
+    }
+    ASSERT(is_found);
+  }
+  std::filesystem::remove(path);
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
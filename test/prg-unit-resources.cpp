@@ -0,0 +1,108 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/command.hpp"
+#include "../../prg/resources.hpp"
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+int main()
+try {
+  namespace prg = dmitigr::prg;
+
+  // Sizes.
+  ASSERT(prg::detail::to_size("0") == 0);
+  ASSERT(prg::detail::to_size("4096") == 4096);
+  ASSERT(prg::detail::to_size("1K") == 1024);
+  ASSERT(prg::detail::to_size("2k") == 2048);
+  ASSERT(prg::detail::to_size("3M") == 3ull << 20);
+  ASSERT(prg::detail::to_size("4G") == 4ull << 30);
+  ASSERT(prg::detail::to_size("5T") == 5ull << 40);
+  ASSERT(prg::detail::to_size("16777215T") == 16777215ull << 40);
+  ASSERT(prg::detail::to_size("18446744073709551615") == UINT64_MAX);
+  for (const auto* const invalid : {"", "K", "-1", "1.5G", "1KB", "1P", " 1",
+      "16777216T", "18446744073709551616"}) {
+    try {
+      prg::detail::to_size(invalid);
+      ASSERT(false);
+    } catch (const std::invalid_argument&) {}
+  }
+
+  // Options.
+  {
+    const char* const argv[] = {"prog", "--nofile=max", "--mlock",
+      "--thp=disable", "--core=off"};
+    int argc{5};
+    const char* const* args{argv};
+    const auto resources = prg::Resources::make(prg::make_command(&argc,
+      &args, false));
+    ASSERT(resources.nofile() == prg::Resources::max_limit);
+    ASSERT(resources.mlock() == prg::Resources::Mlock::all);
+    ASSERT(resources.is_thp_allowed() == false);
+    ASSERT(resources.core() == 0);
+  }
+  for (const auto* const invalid : {"--nofile=1X", "--mlock=none", "--thp=on",
+      "--thp=enable", "--core", "--nofile="}) {
+    const char* const argv[] = {"prog", invalid};
+    int argc{2};
+    const char* const* args{argv};
+    try {
+      prg::Resources::make(prg::make_command(&argc, &args, false));
+      ASSERT(false);
+    } catch (const std::exception&) {}
+  }
+
+  // Application.
+  {
+    const char* const argv[] = {"prog", "--core=0"};
+    int argc{2};
+    const char* const* args{argv};
+    const auto statuses = prg::Resources::make(prg::make_command(&argc,
+      &args, false)).apply();
+    ASSERT(statuses.size() == 1);
+    ASSERT(statuses.front().name == "core");
+#ifndef _WIN32
+    ASSERT(statuses.front().is_ok());
+#endif
+  }
+#ifdef __linux__
+  {
+    const char* const argv[] = {"prog", "--thp=allow"};
+    int argc{2};
+    const char* const* args{argv};
+    const auto statuses = prg::Resources::make(prg::make_command(&argc,
+      &args, false)).apply();
+    ASSERT(statuses.size() == 1);
+    ASSERT(statuses.front().name == "thp");
+    const auto mode = prg::detail::thp_mode();
+    ASSERT(mode.empty() || mode == "always" || mode == "madvise" ||
+      mode == "never");
+    ASSERT(mode.empty() ||
+      statuses.front().remark == "allowed, system-wide mode is " + mode);
+  }
+#endif
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
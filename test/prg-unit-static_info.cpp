@@ -0,0 +1,90 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/static_info.hpp"
+
+#include <csignal>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace prg = dmitigr::prg;
+
+class My_info final : public prg::Static_info<My_info> {
+public:
+  std::filesystem::path executable_path() const override
+  {
+    return {};
+  }
+
+  std::string synopsis() const override
+  {
+    return {};
+  }
+
+  bool is_inited{};
+
+private:
+  void init(int, const char* const*) override
+  {
+    // The instance is registered before init().
+    is_inited = &My_info::instance() == this;
+  }
+};
+
+std::unique_ptr<prg::Info> prg::Info::make()
+{
+  return std::make_unique<My_info>();
+}
+
+int main(int argc, char* argv[])
+try {
+  // Not registered until initialize().
+  auto& unset = My_info::stop_signal_ref();
+  ASSERT(!My_info::is_stop_requested());
+
+  // The instance which is not process-wide is never registered.
+  auto embedded = prg::Info::create(std::make_unique<My_info>(), argc, argv);
+  ASSERT(&My_info::stop_signal_ref() == &unset);
+  embedded->stop_signal = SIGTERM;
+  ASSERT(!My_info::is_stop_requested());
+
+  // The process-wide instance is registered.
+  auto& info = prg::Info::initialize(argc, argv);
+  ASSERT(&My_info::instance() == &info);
+  ASSERT(My_info::instance().is_inited);
+  ASSERT(!static_cast<My_info&>(*embedded).is_inited);
+  ASSERT(&My_info::stop_signal_ref() == &info.stop_signal);
+  ASSERT(!My_info::is_stop_requested());
+  info.stop_signal = SIGINT;
+  ASSERT(My_info::is_stop_requested());
+  ASSERT(My_info::stop_signal_ref() == SIGINT);
+
+  // Destruction of the instance which is not process-wide has no effect.
+  embedded.reset();
+  ASSERT(&My_info::instance() == &info);
+  ASSERT(My_info::is_stop_requested());
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
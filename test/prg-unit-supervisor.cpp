@@ -0,0 +1,145 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/info.hpp"
+#include "../../prg/supervisor.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace prg = dmitigr::prg;
+
+class My_info final : public prg::Info {
+public:
+  std::filesystem::path executable_path() const override
+  {
+    return {};
+  }
+
+  std::string synopsis() const override
+  {
+    return {};
+  }
+
+private:
+  void init(int, const char* const*) override
+  {}
+};
+
+std::unique_ptr<prg::Info> prg::Info::make()
+{
+  return std::make_unique<My_info>();
+}
+
+int main(int argc, char* argv[])
+try {
+  using namespace std::chrono_literals;
+  auto& info = prg::Info::initialize(argc, argv);
+
+  prg::Supervisor_options options;
+  options.worker_count = 2;
+  options.min_restart_delay = 10ms;
+  options.max_restart_delay = 40ms;
+  options.stable_uptime = 10s;
+  options.kill_timeout = 10s;
+
+  // A child which is not a worker. It requests the shutdown of the master.
+  const pid_t helper{fork()};
+  ASSERT(helper >= 0);
+  if (!helper) {
+    usleep(300000);
+    kill(getppid(), SIGTERM);
+    _exit(7);
+  }
+
+  // Worker 0 fails repeatedly, worker 1 runs until terminated.
+  {
+    prg::Supervisor supervisor{options};
+    const auto start = std::chrono::steady_clock::now();
+    supervisor.run([](const std::size_t index)
+    {
+      if (!index)
+        return 3;
+      while (true)
+        pause();
+    });
+    ASSERT(std::chrono::steady_clock::now() - start < 5s);
+    ASSERT(info.stop_signal == SIGTERM);
+
+    const auto& stats = supervisor.stats();
+    ASSERT(stats.size() == 2);
+    ASSERT(!stats[0].pid && !stats[1].pid);
+    ASSERT(stats[0].start_count >= 2);
+    ASSERT(stats[0].failure_count >= 1);
+    ASSERT(stats[0].restart_delay == options.max_restart_delay);
+    ASSERT(stats[1].start_count == 1);
+    ASSERT(stats[1].signal_count == 1);
+    ASSERT(stats[1].last_signal == SIGTERM);
+  }
+
+  // The exit status of the helper is not stolen by the supervisor.
+  int status{};
+  ASSERT(waitpid(helper, &status, 0) == helper);
+  ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 7);
+
+  // The stop signal which is not a signal number results in SIGTERM.
+  {
+    info.stop_signal = 1000;
+    options.worker_count = 1;
+    prg::Supervisor supervisor{options};
+    const auto start = std::chrono::steady_clock::now();
+    supervisor.run([](std::size_t)
+    {
+      while (true)
+        pause();
+    });
+    ASSERT(std::chrono::steady_clock::now() - start < 5s);
+    ASSERT(supervisor.stats()[0].last_signal == SIGTERM);
+  }
+
+#ifdef __linux__
+  // Running with other threads is rejected.
+  {
+    std::thread thread{[]{std::this_thread::sleep_for(100ms);}};
+    prg::Supervisor supervisor{options};
+    try {
+      supervisor.run([](std::size_t){});
+      ASSERT(false);
+    } catch (const std::logic_error&) {}
+    thread.join();
+    ASSERT(!supervisor.stats()[0].start_count);
+  }
+#endif
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
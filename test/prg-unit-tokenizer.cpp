@@ -0,0 +1,186 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/command.hpp"
+#include "../../prg/tokenizer.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace prg = dmitigr::prg;
+
+namespace {
+
+std::vector<std::string> tokenize(const std::string_view input)
+{
+  std::vector<char> buffer(input.size() + 1);
+  std::vector<const char*> tokens;
+  prg::tokenize(input, buffer.data(), tokens);
+  return {tokens.begin(), tokens.end()};
+}
+
+// The straightforward implementation to compare with.
+std::vector<std::string> tokenize_reference(const std::string_view input)
+{
+  std::vector<std::string> result;
+  std::string token;
+  bool is_token{};
+  for (std::size_t i{}; i < input.size(); ++i) {
+    const char c{input[i]};
+    if (c == '\\') {
+      if (input[++i] != '\n') {
+        token += input[i];
+        is_token = true;
+      }
+    } else if (c == '\'') {
+      is_token = true;
+      while (input[++i] != '\'')
+        token += input[i];
+    } else if (c == '"') {
+      is_token = true;
+      while (input[++i] != '"') {
+        if (input[i] == '\\') {
+          const char n{input[i + 1]};
+          if (n == '\n')
+            ++i;
+          else if (n == '$' || n == '`' || n == '"' || n == '\\')
+            token += input[++i];
+          else
+            token += '\\';
+        } else
+          token += input[i];
+      }
+    } else if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+      c == '\f') {
+      if (is_token) {
+        result.push_back(std::move(token));
+        token.clear();
+        is_token = false;
+      }
+    } else {
+      token += c;
+      is_token = true;
+    }
+  }
+  if (is_token)
+    result.push_back(std::move(token));
+  return result;
+}
+
+} // namespace
+
+int main()
+try {
+  using V = std::vector<std::string>;
+
+  // Basics.
+  ASSERT(tokenize("").empty());
+  ASSERT(tokenize(" \t\n ").empty());
+  ASSERT((tokenize("a") == V{"a"}));
+  ASSERT((tokenize("  cmd --opt=1   param  ") == V{"cmd", "--opt=1", "param"}));
+  ASSERT((tokenize("a\\ b c\\\nd") == V{"a b", "cd"}));
+  ASSERT((tokenize("'' \"\"") == V{"", ""}));
+  ASSERT((tokenize("'a \"b\\'c' d'") == V{"a \"b\\c d"}));
+  ASSERT((tokenize("\"a \\\"b\\\" \\$ \\x 'c'\"") == V{"a \"b\" $ \\x 'c'"}));
+  ASSERT((tokenize("--name=\"John Doe\" x") == V{"--name=John Doe", "x"}));
+  ASSERT((tokenize("a\x01" "b") == V{"a\x01" "b"}));
+  for (const auto* const invalid : {"'a", "\"a", "a\\", "\"a\\"}) {
+    try {
+      tokenize(invalid);
+      ASSERT(false);
+    } catch (const std::runtime_error&) {}
+  }
+
+  // In-place unescaping and parsing.
+  {
+    std::string line{"prog --opt='a b' -- \"p 1\" p\\ 2"};
+    line.push_back('\0');
+    std::vector<const char*> argv;
+    const auto count = prg::tokenize({line.data(), line.size() - 1},
+      line.data(), argv);
+    ASSERT(count == 5);
+    int argc{static_cast<int>(count)};
+    const char* const* argv_p{argv.data()};
+    const auto cmd = prg::make_command(&argc, &argv_p, true);
+    ASSERT(cmd.name() == "prog");
+    ASSERT(cmd["opt"].value_not_null() == "a b");
+    ASSERT((cmd.parameters() == V{"p 1", "p 2"}));
+
+    prg::Argv args;
+    args.assign("x 'y z'");
+    ASSERT(args.argc() == 2);
+    ASSERT(std::string{args.argv()[1]} == "y z" && !args.argv()[2]);
+  }
+
+  // Multi-megabyte inputs.
+  {
+    std::mt19937 gen{42};
+    const std::string_view alphabet{"abcdefghijklmnopqrstuvwxyz0123456789-=./"};
+    const auto random_word = [&](const std::size_t size)
+    {
+      std::string result;
+      for (std::size_t i{}; i < size; ++i)
+        result += alphabet[gen() % alphabet.size()];
+      return result;
+    };
+    const auto make_input = [&](const bool is_quoted)
+    {
+      std::string result;
+      while (result.size() < 8*1024*1024) {
+        const auto word = random_word(1 + gen() % 64);
+        switch (is_quoted ? gen() % 5 : 0) {
+        case 0: result.append(word); break;
+        case 1: result.append("'").append(word).append(" x'"); break;
+        case 2: result.append("\"").append(word).append("\\\" y\""); break;
+        case 3: result.append(word).append("\\ ").append(word); break;
+        case 4: result.append("\"\\n").append(word).append("\""); break;
+        }
+        result += " \t\n"[gen() % 3];
+      }
+      return result;
+    };
+
+    for (const bool is_quoted : {false, true}) {
+      const auto input = make_input(is_quoted);
+      const auto expected = tokenize_reference(input);
+
+      std::vector<char> buffer(input.size() + 1);
+      std::vector<const char*> tokens;
+      tokens.reserve(expected.size());
+      const auto start = std::chrono::steady_clock::now();
+      prg::tokenize(input, buffer.data(), tokens);
+      const std::chrono::duration<double> elapsed{
+        std::chrono::steady_clock::now() - start};
+      ASSERT((V{tokens.begin(), tokens.end()} == expected));
+      std::cout << (is_quoted ? "quoted" : "plain") << " input of "
+                << input.size() / (1024*1024) << " MiB tokenized at "
+                << input.size() / elapsed.count() / (1024*1024) << " MiB/s"
+                << std::endl;
+    }
+  }
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
@@ -0,0 +1,249 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "../../base/assert.hpp"
+#include "../../prg/info.hpp"
+#include "../../prg/util.hpp"
+#include "../../prg/zygote.hpp"
+
+#include <csignal>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define ASSERT(a) DMITIGR_ASSERT(a)
+
+namespace prg = dmitigr::prg;
+
+class My_info final : public prg::Info {
+public:
+  std::filesystem::path executable_path() const override
+  {
+    return {};
+  }
+
+  std::string synopsis() const override
+  {
+    return {};
+  }
+
+private:
+  void init(int, const char* const*) override
+  {}
+};
+
+std::unique_ptr<prg::Info> prg::Info::make()
+{
+  return std::make_unique<My_info>();
+}
+
+namespace {
+
+/// Serves the invocations. @returns The exit code of the zygote process.
+int serve(const std::filesystem::path& path, const int ready)
+{
+  prg::set_signals();
+
+  // A child which is not forked by the zygote.
+  const pid_t helper{fork()};
+  if (helper < 0)
+    return 1;
+  else if (!helper) {
+    usleep(100000);
+    _exit(7);
+  }
+
+  prg::Zygote zygote{path};
+  if (write(ready, "r", 1) != 1)
+    return 1;
+  close(ready);
+  zygote.serve([](const int argc, const char* const* const argv)
+  {
+    const std::string_view cmd{argc > 1 ? argv[1] : ""};
+    if (cmd == "exit" && argc == 3) {
+      return std::atoi(argv[2]);
+    } else if (cmd == "kill") {
+      raise(SIGKILL);
+    } else if (cmd == "echo" && argc == 3) {
+      const char* const env{std::getenv("DMITIGR_PRG_ZYGOTE")};
+      std::cout << argv[2] << ' ' << (env ? env : "") << ' '
+                << std::filesystem::current_path().string() << std::endl;
+      return 0;
+    } else if (cmd == "sleep") {
+      usleep(500000);
+      return 0;
+    } else if (cmd == "sockets") {
+      // The number of inherited sockets except the standard descriptors.
+      int count{};
+      for (const auto& entry :
+             std::filesystem::directory_iterator{"/proc/self/fd"}) {
+        struct stat st{};
+        if (std::stoi(entry.path().filename().string()) > 2 &&
+          !stat(entry.path().c_str(), &st) && S_ISSOCK(st.st_mode))
+          ++count;
+      }
+      return count;
+    }
+    throw std::runtime_error{"invalid command"};
+  });
+
+  // The exit status of the helper is not stolen by the zygote.
+  int status{};
+  if (waitpid(helper, &status, 0) != helper || !WIFEXITED(status) ||
+    WEXITSTATUS(status) != 7)
+    return 3;
+  return 0;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+try {
+  namespace fs = std::filesystem;
+  prg::Info::initialize(argc, argv);
+
+  const auto dir = fs::temp_directory_path();
+  const auto path = dir /
+    ("dmitigr_prg_zygote." + std::to_string(getpid()) + ".sock");
+
+  int ready[2];
+  ASSERT(!pipe(ready));
+  const pid_t zygote{fork()};
+  ASSERT(zygote >= 0);
+  if (!zygote) {
+    close(ready[0]);
+    try {
+      _exit(serve(path, ready[1]));
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+    }
+    _exit(2);
+  }
+  close(ready[1]);
+  char r{};
+  ASSERT(read(ready[0], &r, 1) == 1);
+  close(ready[0]);
+  usleep(200000); // the helper of the zygote exits meanwhile
+
+  // The socket is accessible by the owner only.
+  {
+    struct stat st{};
+    ASSERT(!stat(path.c_str(), &st));
+    ASSERT((st.st_mode & 0777) == 0600);
+  }
+
+  // The connection from other user is rejected.
+  if (!geteuid()) {
+    ASSERT(!chmod(path.c_str(), 0666));
+    const pid_t pid{fork()};
+    ASSERT(pid >= 0);
+    if (!pid) {
+      if (setgid(65534) || setuid(65534))
+        _exit(1);
+      try {
+        const char* const args[]{"prog", "exit", "0"};
+        prg::run_zygote_client(path, 3, args);
+      } catch (...) {
+        _exit(0);
+      }
+      _exit(2);
+    }
+    int status{};
+    ASSERT(waitpid(pid, &status, 0) == pid);
+    ASSERT(WIFEXITED(status) && !WEXITSTATUS(status));
+    ASSERT(!chmod(path.c_str(), 0600));
+  }
+
+#ifdef __linux__
+  // The connections of other clients are not inherited by the child.
+  {
+    int sleep_code{-1};
+    std::thread sleeper{[&path, &sleep_code]
+    {
+      const char* const args[]{"prog", "sleep"};
+      sleep_code = prg::run_zygote_client(path, 2, args);
+    }};
+    usleep(100000);
+    const char* const args[]{"prog", "sockets"};
+    const int socket_count{prg::run_zygote_client(path, 2, args)};
+    sleeper.join();
+    ASSERT(!sleep_code);
+    ASSERT(!socket_count);
+  }
+#endif
+
+  // The exit code and the signal.
+  {
+    const char* const args[]{"prog", "exit", "5"};
+    ASSERT(prg::run_zygote_client(path, 3, args) == 5);
+  }
+  {
+    const char* const args[]{"prog", "kill"};
+    ASSERT(prg::run_zygote_client(path, 2, args) == 128 + SIGKILL);
+  }
+  {
+    const char* const args[]{"prog"};
+    ASSERT(prg::run_zygote_client(path, 1, args) == EXIT_FAILURE);
+  }
+
+  // The standard descriptors, the environment and the working directory.
+  {
+    const auto out = dir /
+      ("dmitigr_prg_zygote." + std::to_string(getpid()) + ".out");
+    const int fd{open(out.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600)};
+    ASSERT(fd >= 0);
+    const int saved{dup(STDOUT_FILENO)};
+    ASSERT(saved >= 0);
+    ASSERT(dup2(fd, STDOUT_FILENO) == STDOUT_FILENO);
+    close(fd);
+    ASSERT(!setenv("DMITIGR_PRG_ZYGOTE", "value", 1));
+    const auto cwd = fs::current_path();
+    fs::current_path(dir);
+    const char* const args[]{"prog", "echo", "hello"};
+    const int code{prg::run_zygote_client(path, 3, args)};
+    fs::current_path(cwd);
+    ASSERT(dup2(saved, STDOUT_FILENO) == STDOUT_FILENO);
+    close(saved);
+    ASSERT(!code);
+
+    std::ifstream in{out};
+    std::string line;
+    ASSERT(std::getline(in, line));
+    ASSERT(line == "hello value " + fs::canonical(dir).string());
+    fs::remove(out);
+  }
+
+  ASSERT(!kill(zygote, SIGTERM));
+  int status{};
+  ASSERT(waitpid(zygote, &status, 0) == zygote);
+  ASSERT(WIFEXITED(status) && !WEXITSTATUS(status));
+  ASSERT(!fs::exists(path));
+} catch (const std::exception& e) {
+  std::cerr << e.what() << std::endl;
+  return 1;
+} catch (...) {
+  std::cerr << "unknown error" << std::endl;
+  return 2;
+}
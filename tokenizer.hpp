@@ -0,0 +1,290 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_TOKENIZER_HPP
+#define DMITIGR_PRG_TOKENIZER_HPP
+
+#include "../base/assert.hpp"
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#define DMITIGR_PRG_TOKENIZER_SSE2
+#endif
+
+namespace dmitigr::prg {
+
+namespace detail {
+
+/// A context of the tokenizer.
+enum class Token_context {
+  /// Outside quotes.
+  unquoted,
+  /// Inside single quotes.
+  single_quoted,
+  /// Inside double quotes.
+  double_quoted
+};
+
+/// @returns `true` if `c` is a whitespace separating the tokens.
+constexpr bool is_token_space(const char c) noexcept
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' ||
+    c == '\f';
+}
+
+/// @returns `true` if `c` is special in the context `Ctx`.
+template<Token_context Ctx>
+constexpr bool is_token_special(const char c) noexcept
+{
+  if constexpr (Ctx == Token_context::unquoted)
+    return static_cast<unsigned char>(c) <= ' ' || c == '\'' || c == '"' ||
+      c == '\\';
+  else if constexpr (Ctx == Token_context::single_quoted)
+    return c == '\'';
+  else
+    return c == '"' || c == '\\';
+}
+
+/**
+ * @returns The pointer to the first character in range `[first, last)`
+ * which is special in the context `Ctx`, or `last` if no such one.
+ *
+ * @remarks The control characters are considered as special outside quotes
+ * which makes the check cheaper. They are handled as ordinary characters by
+ * the caller.
+ */
+template<Token_context Ctx>
+inline const char* find_token_special(const char* first,
+  const char* const last) noexcept
+{
+#ifdef DMITIGR_PRG_TOKENIZER_SSE2
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i squote = _mm_set1_epi8('\'');
+  const __m128i dquote = _mm_set1_epi8('"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  for (; last - first >= 16; first += 16) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+    __m128i special;
+    if constexpr (Ctx == Token_context::unquoted) {
+      // v <= ' ' (unsigned) is equivalent to min(v, ' ') == v.
+      special = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(_mm_min_epu8(v, space), v),
+          _mm_cmpeq_epi8(v, squote)),
+        _mm_or_si128(_mm_cmpeq_epi8(v, dquote), _mm_cmpeq_epi8(v, backslash)));
+    } else if constexpr (Ctx == Token_context::single_quoted) {
+      (void)space;
+      (void)dquote;
+      (void)backslash;
+      special = _mm_cmpeq_epi8(v, squote);
+    } else {
+      (void)space;
+      (void)squote;
+      special = _mm_or_si128(_mm_cmpeq_epi8(v, dquote),
+        _mm_cmpeq_epi8(v, backslash));
+    }
+    if (const int mask = _mm_movemask_epi8(special))
+      return first + __builtin_ctz(static_cast<unsigned>(mask));
+  }
+#endif
+  for (; first != last && !is_token_special<Ctx>(*first); ++first);
+  return first;
+}
+
+} // namespace detail
+
+/**
+ * @brief Splits the `input` into tokens by the quoting rules of the POSIX
+ * shell.
+ *
+ * @details The rules are as follows:
+ *   - the unquoted whitespaces separate the tokens;
+ *   - the unquoted backslash preserves the literal value of the following
+ *   character, except newline which is removed (line continuation);
+ *   - the characters enclosed in single quotes are preserved literally;
+ *   - the characters enclosed in double quotes are preserved literally,
+ *   except the backslash which escapes `$`, `` ` ``, `"`, `\` and newline.
+ *
+ * No expansions are performed.
+ *
+ * The unescaped null-terminated tokens are written consecutively into the
+ * `output`, and the pointers to them are appended to `tokens`. So the
+ * `tokens` can be passed to make_command() as `argv`.
+ *
+ * @param output The buffer of at least `input.size() + 1` bytes. May be equal
+ * to `input.data()` (in-place unescaping).
+ *
+ * @returns The number of tokens appended.
+ *
+ * @throws `std::runtime_error` on unterminated quote or escape.
+ */
+inline std::size_t tokenize(const std::string_view input, char* const output,
+  std::vector<const char*>& tokens)
+{
+  using detail::Token_context;
+  using detail::find_token_special;
+
+  if (!output)
+    throw std::invalid_argument{"invalid output of tokenizer"};
+
+  const auto old_size = tokens.size();
+  const char* i{input.data()};
+  const char* const end{input.data() + input.size()};
+  char* out{output};
+  bool is_token{};
+
+  const auto copy = [&out](const char* const first, const char* const last)
+  {
+    const auto size = static_cast<std::size_t>(last - first);
+    if (out != first)
+      std::memmove(out, first, size);
+    out += size;
+  };
+  const auto start_token = [&]
+  {
+    if (!is_token) {
+      tokens.push_back(out);
+      is_token = true;
+    }
+  };
+
+  while (i != end) {
+    // Copy the ordinary characters.
+    if (const auto special = find_token_special<Token_context::unquoted>(i, end);
+      special != i) {
+      start_token();
+      copy(i, special);
+      i = special;
+      continue;
+    }
+
+    switch (const char c{*i++}) {
+    case '\\':
+      if (i == end)
+        throw std::runtime_error{"unterminated escape"};
+      else if (*i == '\n') {
+        ++i;
+        continue;
+      }
+      start_token();
+      *out++ = *i++;
+      break;
+    case '\'': {
+      start_token();
+      const auto quote = find_token_special<Token_context::single_quoted>(i, end);
+      if (quote == end)
+        throw std::runtime_error{"unterminated single quote"};
+      copy(i, quote);
+      i = quote + 1;
+      break;
+    }
+    case '"':
+      start_token();
+      while (true) {
+        const auto special =
+          find_token_special<Token_context::double_quoted>(i, end);
+        if (special == end)
+          throw std::runtime_error{"unterminated double quote"};
+        copy(i, special);
+        i = special + 1;
+        if (*special == '"')
+          break;
+
+        // Backslash.
+        if (i == end)
+          throw std::runtime_error{"unterminated double quote"};
+        else if (*i == '\n')
+          ++i;
+        else if (*i == '$' || *i == '`' || *i == '"' || *i == '\\')
+          *out++ = *i++;
+        else
+          *out++ = '\\';
+      }
+      break;
+    default:
+      if (detail::is_token_space(c)) {
+        if (is_token) {
+          *out++ = '\0';
+          is_token = false;
+        }
+      } else {
+        // Control character.
+        start_token();
+        *out++ = c;
+      }
+    }
+  }
+  if (is_token)
+    *out = '\0';
+
+  return tokens.size() - old_size;
+}
+
+// =============================================================================
+
+/**
+ * @brief The arguments built from a command line by tokenize().
+ *
+ * @details The storage is reused across the assignments.
+ */
+class Argv final {
+public:
+  /// The default constructor.
+  Argv()
+  {
+    pointers_.push_back(nullptr);
+  }
+
+  /// Assigns the arguments from the `line`.
+  void assign(const std::string_view line)
+  {
+    storage_.resize(line.size() + 1);
+    pointers_.clear();
+    try {
+      tokenize(line, storage_.data(), pointers_);
+    } catch (...) {
+      pointers_.clear();
+      pointers_.push_back(nullptr);
+      throw;
+    }
+    pointers_.push_back(nullptr);
+  }
+
+  /// @returns The number of arguments.
+  int argc() const noexcept
+  {
+    return static_cast<int>(pointers_.size() - 1);
+  }
+
+  /// @returns The null-terminated array of arguments.
+  const char* const* argv() const noexcept
+  {
+    return pointers_.data();
+  }
+
+private:
+  std::vector<char> storage_;
+  std::vector<const char*> pointers_;
+};
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_TOKENIZER_HPP
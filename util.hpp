@@ -17,18 +17,46 @@
 #ifndef DMITIGR_PRG_UTIL_HPP
 #define DMITIGR_PRG_UTIL_HPP
 
+#include "../base/assert.hpp"
+#include "../base/noncopymove.hpp"
+#include "exit.hpp"
 #include "info.hpp"
+#ifndef _WIN32
+#include "profiler.hpp"
+#include "recorder.hpp"
 
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
 #include <csignal>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace dmitigr::prg {
 
 /**
  * @brief Prints the usage info on the standard error and terminates the
- * program with unsuccessful exit code.
+ * program with unsuccessful exit code by exit_program().
  *
  * @par Requires
  * `Info::is_initialized()`.
@@ -42,35 +70,302 @@ namespace dmitigr::prg {
   if (!synop.empty())
     out << " " << synop;
   out << std::endl;
-  std::exit(code);
+  exit_program(code);
+}
+
+/**
+ * @brief Terminates the program by exit_program() if the stop signal of the
+ * process-wide instance is set.
+ *
+ * @param code The exit code, or `-1` to use `128 + stop_signal` (the way
+ * the shells report the termination by signal).
+ *
+ * @par Requires
+ * `Info::is_process_initialized()`.
+ */
+inline void exit_on_stop_signal(const int code = -1)
+{
+  if (const int sig = Info::process_instance().stop_signal)
+    exit_program(code < 0 ? 128 + sig : code);
 }
 
 // =============================================================================
 
-/// A typical signal handler.
+#ifndef _WIN32
+namespace detail {
+
+/**
+ * @brief The wakeup of the watcher thread of Stop_waiters on the stop path.
+ *
+ * @details The pipe is opened by the watcher thread for the time of its run.
+ * Since notify() is async-signal-safe, the watcher is woken up by the signal
+ * handlers (see handle_signal()) as soon as the stop signal is set.
+ */
+class Stop_wakeup final {
+public:
+  /**
+   * @brief Opens the pipe.
+   *
+   * @returns The read end of the pipe.
+   *
+   * @par Requires
+   * The pipe is not opened.
+   */
+  static int open()
+  {
+    int fds[2];
+    if (pipe(fds))
+      throw std::system_error{errno, std::system_category(),
+        "cannot create pipe of stop waiters"};
+    for (const int fd : fds) {
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+      fcntl(fd, F_SETFL, O_NONBLOCK);
+    }
+    write_fd_.store(fds[1]);
+    return fds[0];
+  }
+
+  /**
+   * @brief Closes the pipe opened by open().
+   *
+   * @details Spins until the notify() which is in progress concurrently (if
+   * any) is finished, so the descriptor is never written after closing.
+   */
+  static void close(const int read_fd) noexcept
+  {
+    const int write_fd{write_fd_.exchange(-1)};
+    while (notify_count_.load())
+      std::this_thread::yield();
+    if (write_fd >= 0)
+      ::close(write_fd);
+    ::close(read_fd);
+  }
+
+  /// Wakes up the wait() if the pipe is opened. (Async-signal-safe.)
+  static void notify() noexcept
+  {
+    ++notify_count_;
+    if (const int fd{write_fd_.load()}; fd >= 0) {
+      const int err{errno};
+      const char byte{};
+      [[maybe_unused]] const auto r = write(fd, &byte, 1);
+      errno = err;
+    }
+    --notify_count_;
+  }
+
+  /// Waits for notify() not longer than `timeout`.
+  static void wait(const int read_fd,
+    const std::chrono::milliseconds timeout) noexcept
+  {
+    pollfd pfd{read_fd, POLLIN, 0};
+    if (poll(&pfd, 1, static_cast<int>(timeout.count())) > 0) {
+      char buf[64];
+      while (read(read_fd, buf, sizeof(buf)) > 0);
+    }
+  }
+
+private:
+  inline static std::atomic_int write_fd_{-1};
+  inline static std::atomic_int notify_count_; // the number of notify() in progress
+};
+
+} // namespace detail
+#endif
+
+/**
+ * @brief A typical signal handler.
+ *
+ * @details Sets the stop signal of the process-wide instance, since signals
+ * are delivered to the process rather than to an instance bound to a thread.
+ * Flushes the sinks registered in Signal_sinks. On the fatal signals dumps
+ * the flight recorder (see Flight_recorder).
+ */
 inline void handle_signal(const int sig) noexcept
 {
-  Info::instance().stop_signal = sig;
+  Signal_sinks::flush();
+#ifndef _WIN32
+  if (sig == SIGABRT || sig == SIGFPE || sig == SIGILL || sig == SIGSEGV)
+    Flight_recorder::dump(sig);
+#endif
+  Info::process_instance().stop_signal = sig;
+#ifndef _WIN32
+  detail::Stop_wakeup::notify();
+#endif
 }
 
 /// Assigns the `signals` as a signal handler of some signals.
 inline void set_signals(void(*signals)(int) = &handle_signal) noexcept
 {
-  std::signal(SIGABRT, signals);
-  std::signal(SIGFPE, signals);
-  std::signal(SIGILL, signals);
-  std::signal(SIGINT, signals);
-  std::signal(SIGSEGV, signals);
-  std::signal(SIGTERM, signals);
+  for (const int sig : {SIGABRT, SIGFPE, SIGILL, SIGINT, SIGSEGV, SIGTERM}) {
+    std::signal(sig, signals);
+    Signal_handlers::add(sig);
+  }
+}
+
+#ifndef _WIN32
+/**
+ * @brief Makes the signal `sig` to start and stop the sampling profiler.
+ *
+ * @details If the output of the profiler is not set, it's set to
+ * `<program name>.<pid>.folded` in the current working directory, where
+ * `<pid>` is the ID of the process at the time of writing.
+ *
+ * @par Requires
+ * `Info::is_process_initialized()`.
+ *
+ * @see Sampling_profiler.
+ */
+inline void set_profiler_signal(const int sig = SIGUSR2)
+{
+  auto& profiler = Sampling_profiler::instance();
+  if (profiler.output().empty()) {
+    profiler.set_output([]
+    {
+      const auto& identity = Info::process_instance().identity();
+      return std::filesystem::path{std::string{identity.program_name}
+        .append(".").append(std::to_string(getpid())).append(".folded")};
+    });
+  }
+  profiler.set_toggle_signal(sig);
 }
+#endif
 
 // =============================================================================
 
+/**
+ * @brief The process-wide slot of the first error.
+ *
+ * @details Keeps the first exception captured by any thread (normally by
+ * with_signal_on_error()) along with the id of the thread and the time, so
+ * `main()` can report the actual cause of the shutdown initiated by a worker
+ * thread. The slot is claimed by a single compare-and-swap, so capturing
+ * never blocks and the subsequent errors are ignored.
+ *
+ * @par Thread safety
+ * All the members are thread-safe.
+ */
+class First_error final {
+public:
+  /**
+   * @brief Captures the `exception` if the slot is empty.
+   *
+   * @returns `true` if the `exception` is captured.
+   */
+  static bool capture(std::exception_ptr exception,
+    const int stop_signal = 0) noexcept
+  {
+    if (!exception)
+      return false;
+    int expected{empty};
+    if (!state_.compare_exchange_strong(expected, claimed,
+        std::memory_order_acquire, std::memory_order_relaxed))
+      return false;
+    exception_ = std::move(exception);
+    thread_id_ = std::this_thread::get_id();
+    time_ = std::chrono::system_clock::now();
+    stop_signal_ = stop_signal;
+    state_.store(ready, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @returns `true` if the error is captured.
+   *
+   * @remarks The error being captured concurrently is not visible until it's
+   * completely captured.
+   */
+  static bool is_captured() noexcept
+  {
+    return state_.load(std::memory_order_acquire) == ready;
+  }
+
+  /// @returns The captured exception, or `nullptr` if none.
+  static std::exception_ptr exception() noexcept
+  {
+    return is_captured() ? exception_ : nullptr;
+  }
+
+  /**
+   * @returns The id of the thread which captured the exception.
+   *
+   * @par Requires
+   * `is_captured()`.
+   */
+  static std::thread::id thread_id() noexcept
+  {
+    DMITIGR_ASSERT(is_captured());
+    return thread_id_;
+  }
+
+  /**
+   * @returns The time of capturing the exception.
+   *
+   * @par Requires
+   * `is_captured()`.
+   */
+  static std::chrono::system_clock::time_point time() noexcept
+  {
+    DMITIGR_ASSERT(is_captured());
+    return time_;
+  }
+
+  /**
+   * @returns The stop signal set on capturing the exception.
+   *
+   * @par Requires
+   * `is_captured()`.
+   */
+  static int stop_signal() noexcept
+  {
+    DMITIGR_ASSERT(is_captured());
+    return stop_signal_;
+  }
+
+  /// Rethrows the captured exception if any.
+  static void rethrow_if_captured()
+  {
+    if (is_captured())
+      std::rethrow_exception(exception_);
+  }
+
+private:
+  enum { empty, claimed, ready };
+  inline static std::atomic_int state_{empty};
+  inline static std::exception_ptr exception_;
+  inline static std::thread::id thread_id_;
+  inline static std::chrono::system_clock::time_point time_;
+  inline static int stop_signal_{};
+};
+
+namespace detail {
+
+/**
+ * @brief Handles the `error` by capturing it by First_error, dumping the
+ * flight recorder and setting `Info::instance().stop_signal`.
+ */
+inline void signal_error(std::exception_ptr error,
+  const int stop_signal) noexcept
+{
+  First_error::capture(std::move(error), stop_signal);
+#ifndef _WIN32
+  Flight_recorder::dump(stop_signal);
+#endif
+  Info::instance().stop_signal = stop_signal;
+#ifndef _WIN32
+  Stop_wakeup::notify();
+#endif
+}
+
+} // namespace detail
+
 /**
  * @brief Calls the function `f`.
  *
  * @details If the call of `callback` fails with exception then
- * `Info::instance().stop_signal` flag is sets to `stop_signal`.
+ * `Info::instance().stop_signal` flag is sets to `stop_signal`, the
+ * exception is captured by First_error, and the flight recorder is dumped
+ * (see Flight_recorder).
  *
  * @param f A function to call
  */
@@ -80,11 +375,577 @@ auto with_signal_on_error(F&& f, const int stop_signal = SIGTERM)
   try {
     return f();
   } catch (...) {
-    Info::instance().stop_signal = stop_signal;
+    detail::signal_error(std::current_exception(), stop_signal);
     throw;
   }
 }
 
+
+// =============================================================================
+
+/**
+ * @brief The registry of coroutines suspended until the stop signal of the
+ * process-wide instance is set.
+ *
+ * @details Since the stop signal is normally set by a signal handler, which
+ * cannot resume coroutines, the suspended coroutines are resumed by
+ * resume_if_stopped(), which is intended to be called by the event loop (on
+ * each iteration, or on wakeup by a signal). The check is a single atomic
+ * load, so the coroutines are not polled individually.
+ *
+ * The components which need to react to the stop signal without an event
+ * loop (such as Executor) register the callbacks by add_callback(). While
+ * any callback is registered, the single shared watcher thread calls
+ * resume_if_stopped() when the stop signal is set, so such components don't
+ * poll the stop signal individually. The watcher is woken up immediately by
+ * handle_signal() and with_signal_on_error(). The stop signal which is set
+ * otherwise (e.g. by Deadline, Memory_guard or directly) is noticed by the
+ * watcher within watch_interval(). (On Windows the watcher always checks the
+ * stop signal every watch_interval().)
+ *
+ * @par Thread safety
+ * All the members are thread-safe.
+ *
+ * @see on_stop_signal().
+ */
+class Stop_waiters final {
+public:
+  /// The alias of function to schedule the resumption of coroutine.
+  using Scheduler = std::function<void(std::coroutine_handle<>)>;
+
+  /// The alias of the callback.
+  using Callback = std::function<void()>;
+
+  /// The alias of the callback identifier.
+  using Callback_id = std::uint64_t;
+
+  /// The destructor. Stops the watcher thread.
+  ~Stop_waiters()
+  {
+    {
+      const std::lock_guard lock{mutex_};
+      is_destroying_ = true;
+    }
+    wake();
+    if (watcher_.joinable())
+      watcher_.join();
+  }
+
+  /// @returns The instance.
+  static Stop_waiters& instance()
+  {
+    static Stop_waiters result;
+    return result;
+  }
+
+  /**
+   * @brief Sets the `scheduler` of the resumption of coroutines (e.g. to
+   * resume them on an executor). If not set, the coroutines are resumed on
+   * the thread which called resume_if_stopped().
+   */
+  void set_scheduler(Scheduler scheduler)
+  {
+    const std::lock_guard lock{mutex_};
+    scheduler_ = std::move(scheduler);
+  }
+
+  /// @returns `true` if the stop signal of the process-wide instance is set.
+  static bool is_stopped() noexcept
+  {
+    return Info::is_process_initialized() &&
+      Info::process_instance().stop_signal.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Registers the `callback` to call once by resume_if_stopped(), and
+   * starts the watcher thread if it's not running.
+   *
+   * @returns The identifier of the callback to pass to remove_callback().
+   *
+   * @par Requires
+   * `callback`. The `callback` must not call add_callback() and
+   * remove_callback().
+   */
+  Callback_id add_callback(Callback callback)
+  {
+    if (!callback)
+      throw std::invalid_argument{"invalid callback of stop waiters"};
+    const std::lock_guard lock{mutex_};
+    const auto id = ++last_callback_id_;
+    callbacks_.emplace_back(id, std::move(callback));
+    try {
+      if (!is_watcher_running_) {
+        if (watcher_.joinable())
+          watcher_.join(); // it's exited since !is_watcher_running_
+#ifndef _WIN32
+        wakeup_fd_ = detail::Stop_wakeup::open();
+        try {
+          watcher_ = std::thread{[this]{watch();}};
+        } catch (...) {
+          detail::Stop_wakeup::close(wakeup_fd_);
+          throw;
+        }
+#else
+        watcher_ = std::thread{[this]{watch();}};
+#endif
+        is_watcher_running_ = true;
+      }
+    } catch (...) {
+      callbacks_.pop_back();
+      throw;
+    }
+    return id;
+  }
+
+  /**
+   * @brief Unregisters the callback `id`. Has no effect if no such a
+   * callback.
+   *
+   * @details If the callback is being called concurrently, waits for its
+   * completion.
+   */
+  void remove_callback(const Callback_id id)
+  {
+    const std::lock_guard callback_lock{callback_mutex_};
+    const std::lock_guard lock{mutex_};
+    std::erase_if(callbacks_, [id](const auto& c){return c.first == id;});
+    if (callbacks_.empty())
+      wake();
+  }
+
+  /**
+   * @brief Sets the interval of checking the stop signal by the watcher
+   * thread when it isn't woken up. (See the class description.)
+   */
+  void set_watch_interval(const std::chrono::milliseconds interval)
+  {
+    if (interval <= std::chrono::milliseconds::zero())
+      throw std::invalid_argument{"invalid watch interval of stop waiters"};
+    const std::lock_guard lock{mutex_};
+    watch_interval_ = interval;
+  }
+
+  /// @returns The interval of checking the stop signal by the watcher thread.
+  std::chrono::milliseconds watch_interval() const
+  {
+    const std::lock_guard lock{mutex_};
+    return watch_interval_;
+  }
+
+  /**
+   * @brief Resumes (or schedules the resumption of) all the suspended
+   * coroutines, and calls the registered callbacks, if is_stopped().
+   *
+   * @details The called callbacks are unregistered.
+   *
+   * @returns The number of resumed coroutines.
+   */
+  std::size_t resume_if_stopped()
+  {
+    if (!is_stopped())
+      return 0;
+
+    // Call the callbacks.
+    {
+      const std::lock_guard callback_lock{callback_mutex_};
+      std::vector<std::pair<Callback_id, Callback>> callbacks;
+      {
+        const std::lock_guard lock{mutex_};
+        callbacks.swap(callbacks_);
+      }
+      for (const auto& [id, callback] : callbacks) {
+        try {
+          callback();
+        } catch (...) {}
+      }
+    }
+
+    // Coroutines are taken one by one, since a resumed one may destroy others.
+    std::size_t result{};
+    while (true) {
+      std::coroutine_handle<> handle;
+      Scheduler scheduler;
+      {
+        const std::lock_guard lock{mutex_};
+        if (waiters_.empty())
+          break;
+        handle = waiters_.back().second;
+        waiters_.pop_back();
+        scheduler = scheduler_;
+      }
+      if (scheduler)
+        scheduler(handle);
+      else
+        handle.resume();
+      ++result;
+    }
+    return result;
+  }
+
+  /// @returns The number of suspended coroutines.
+  std::size_t size() const
+  {
+    const std::lock_guard lock{mutex_};
+    return waiters_.size();
+  }
+
+private:
+  friend class Stop_awaitable;
+
+  std::mutex callback_mutex_; // held while calling the callbacks
+  mutable std::mutex mutex_;
+  std::vector<std::pair<const void*, std::coroutine_handle<>>> waiters_;
+  Scheduler scheduler_;
+  std::vector<std::pair<Callback_id, Callback>> callbacks_;
+  Callback_id last_callback_id_{};
+  std::chrono::milliseconds watch_interval_{20};
+#ifdef _WIN32
+  std::condition_variable watcher_cond_;
+#else
+  int wakeup_fd_{-1}; // the read end of the pipe of Stop_wakeup
+#endif
+  std::thread watcher_;
+  bool is_watcher_running_{};
+  bool is_destroying_{};
+
+  Stop_waiters() = default;
+
+  /// Calls resume_if_stopped() on wakeup while any callback registered.
+  void watch()
+  {
+    std::unique_lock lock{mutex_};
+    while (!callbacks_.empty() && !is_destroying_) {
+      if (is_stopped()) {
+        lock.unlock();
+        try {
+          resume_if_stopped();
+        } catch (...) {}
+        lock.lock();
+        continue;
+      }
+#ifdef _WIN32
+      watcher_cond_.wait_for(lock, watch_interval_);
+#else
+      const auto interval = watch_interval_;
+      lock.unlock();
+      detail::Stop_wakeup::wait(wakeup_fd_, interval);
+      lock.lock();
+#endif
+    }
+#ifndef _WIN32
+    detail::Stop_wakeup::close(wakeup_fd_);
+    wakeup_fd_ = -1;
+#endif
+    is_watcher_running_ = false;
+  }
+
+  /// Wakes up the watcher thread.
+  void wake() noexcept
+  {
+#ifdef _WIN32
+    watcher_cond_.notify_all();
+#else
+    detail::Stop_wakeup::notify();
+#endif
+  }
+
+  /// @returns `false` if is_stopped(), so the coroutine must not suspend.
+  bool add(const void* const key, const std::coroutine_handle<> handle)
+  {
+    const std::lock_guard lock{mutex_};
+    if (is_stopped())
+      return false;
+    waiters_.emplace_back(key, handle);
+    return true;
+  }
+
+  void remove(const void* const key) noexcept
+  {
+    const std::lock_guard lock{mutex_};
+    std::erase_if(waiters_, [key](const auto& w){return w.first == key;});
+  }
+};
+
+/**
+ * @brief The awaitable which completes when the stop signal of the
+ * process-wide instance is set.
+ *
+ * @details `co_await` returns the stop signal. If the awaiting coroutine is
+ * destroyed while suspended, it's unregistered automatically.
+ *
+ * @see on_stop_signal(), Stop_waiters.
+ */
+class Stop_awaitable final : Noncopymove {
+public:
+  /// The destructor.
+  ~Stop_awaitable()
+  {
+    if (is_suspended_)
+      Stop_waiters::instance().remove(this);
+  }
+
+  /// The default constructor.
+  Stop_awaitable() = default;
+
+  /// @returns `true` if the stop signal is already set.
+  bool await_ready() const noexcept
+  {
+    return Stop_waiters::is_stopped();
+  }
+
+  /// @returns `false` if the stop signal is set, so the coroutine resumes.
+  bool await_suspend(const std::coroutine_handle<> handle)
+  {
+    /*
+     * The flag is set before publishing the handle, since the coroutine can
+     * be resumed (and this object destroyed) by another thread right after
+     * that, so this object must not be touched after the successful add().
+     */
+    is_suspended_ = true;
+    try {
+      if (!Stop_waiters::instance().add(this, handle)) {
+        is_suspended_ = false;
+        return false;
+      }
+    } catch (...) {
+      is_suspended_ = false;
+      throw;
+    }
+    return true;
+  }
+
+  /// @returns The stop signal.
+  int await_resume() noexcept
+  {
+    is_suspended_ = false;
+    return Info::process_instance().stop_signal;
+  }
+
+private:
+  bool is_suspended_{};
+};
+
+/**
+ * @returns The awaitable which completes when the stop signal of the
+ * process-wide instance is set.
+ *
+ * @par Requires
+ * `Info::is_process_initialized()`.
+ *
+ * @see Stop_waiters::resume_if_stopped().
+ */
+inline Stop_awaitable on_stop_signal() noexcept
+{
+  return {};
+}
+
+namespace detail {
+
+template<typename T>
+class Task_result {
+public:
+  template<typename U>
+  void return_value(U&& value)
+  {
+    value_.emplace(std::forward<U>(value));
+  }
+
+protected:
+  std::optional<T> value_;
+
+  T take_value()
+  {
+    return std::move(*value_);
+  }
+};
+
+template<>
+class Task_result<void> {
+public:
+  void return_void() noexcept
+  {}
+
+protected:
+  void take_value() noexcept
+  {}
+};
+
+} // namespace detail
+
+/**
+ * @brief The lazily started coroutine with the semantics of
+ * with_signal_on_error().
+ *
+ * @details If the body of the coroutine fails with exception, then the
+ * exception is handled as by with_signal_on_error() (i.e. the stop signal
+ * is set to `StopSignal`) and rethrown to the awaiter (or by result()).
+ *
+ * The coroutine is started either by `co_await` (the awaiter is resumed upon
+ * completion), or by start().
+ *
+ * @par Requires
+ * `Info::is_initialized()` when the body fails.
+ */
+template<typename T = void, int StopSignal = SIGTERM>
+class Task final {
+public:
+  /// The promise type.
+  class promise_type final : public detail::Task_result<T> {
+  public:
+    /// @returns The task.
+    Task get_return_object() noexcept
+    {
+      return Task{Handle::from_promise(*this)};
+    }
+
+    /// @returns The awaitable to suspend the coroutine initially.
+    std::suspend_always initial_suspend() const noexcept
+    {
+      return {};
+    }
+
+    /// @returns The awaitable to resume the awaiter (if any).
+    auto final_suspend() const noexcept
+    {
+      struct Final_awaitable final {
+        bool await_ready() const noexcept
+        {
+          return false;
+        }
+
+        std::coroutine_handle<> await_suspend(const Handle handle) noexcept
+        {
+          const auto awaiter = handle.promise().awaiter_;
+          return awaiter ? awaiter : std::noop_coroutine();
+        }
+
+        void await_resume() const noexcept
+        {}
+      };
+      return Final_awaitable{};
+    }
+
+    /// Handles the exception thrown by the body of the coroutine.
+    void unhandled_exception() noexcept
+    {
+      error_ = std::current_exception();
+      detail::signal_error(error_, StopSignal);
+    }
+
+  private:
+    friend Task;
+    std::coroutine_handle<> awaiter_;
+    std::exception_ptr error_;
+
+    T result()
+    {
+      if (error_)
+        std::rethrow_exception(error_);
+      return this->take_value();
+    }
+  };
+
+  /// The destructor. Destroys the coroutine.
+  ~Task()
+  {
+    if (handle_)
+      handle_.destroy();
+  }
+
+  /// Non copy-constructible.
+  Task(const Task&) = delete;
+
+  /// Non copy-assignable.
+  Task& operator=(const Task&) = delete;
+
+  /// The move constructor.
+  Task(Task&& rhs) noexcept
+    : handle_{std::exchange(rhs.handle_, {})}
+  {}
+
+  /// The move assignment operator.
+  Task& operator=(Task&& rhs) noexcept
+  {
+    Task tmp{std::move(rhs)};
+    swap(tmp);
+    return *this;
+  }
+
+  /// Swaps this instance with `other`.
+  void swap(Task& other) noexcept
+  {
+    using std::swap;
+    swap(handle_, other.handle_);
+  }
+
+  /// @returns `true` if the coroutine is completed.
+  bool is_done() const noexcept
+  {
+    return !handle_ || handle_.done();
+  }
+
+  /**
+   * @brief Starts the coroutine.
+   *
+   * @par Requires
+   * The coroutine is not started.
+   */
+  void start()
+  {
+    DMITIGR_ASSERT(handle_ && !handle_.done() && !handle_.promise().awaiter_);
+    handle_.resume();
+  }
+
+  /**
+   * @returns The result of the coroutine.
+   *
+   * @throws The exception thrown by the body of the coroutine.
+   *
+   * @par Requires
+   * `is_done()`.
+   */
+  T result()
+  {
+    DMITIGR_ASSERT(handle_ && handle_.done());
+    return handle_.promise().result();
+  }
+
+  /// @returns The awaitable which starts the coroutine.
+  auto operator co_await() && noexcept
+  {
+    struct Awaitable final {
+      Handle handle;
+
+      bool await_ready() const noexcept
+      {
+        return handle.done();
+      }
+
+      std::coroutine_handle<> await_suspend(
+        const std::coroutine_handle<> awaiter) noexcept
+      {
+        handle.promise().awaiter_ = awaiter;
+        return handle;
+      }
+
+      T await_resume()
+      {
+        return handle.promise().result();
+      }
+    };
+    DMITIGR_ASSERT(handle_);
+    return Awaitable{handle_};
+  }
+
+private:
+  using Handle = std::coroutine_handle<promise_type>;
+  Handle handle_;
+
+  explicit Task(const Handle handle) noexcept
+    : handle_{handle}
+  {}
+};
+
 } // namespace dmitigr::prg
 
 #endif  // DMITIGR_PRG_UTIL_HPP
@@ -0,0 +1,396 @@
+// -*- C++ -*-
+//
+// Copyright 2024 Dmitry Igrishin
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DMITIGR_PRG_ZYGOTE_HPP
+#define DMITIGR_PRG_ZYGOTE_HPP
+
+#ifdef _WIN32
+#error dmitigr/prg/zygote.hpp is not usable on Windows!
+#endif
+
+#include "../base/assert.hpp"
+#include "../base/fsx.hpp"
+#include "../base/noncopymove.hpp"
+#include "handoff.hpp"
+#include "info.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+
+namespace dmitigr::prg {
+
+namespace detail {
+
+/// The header of the zygote request.
+struct Zygote_request_header final {
+  std::uint32_t magic{0x7a79676f}; // "zygo"
+  std::uint32_t argc{};
+  std::uint32_t envc{};
+  std::uint32_t data_size{};
+};
+
+/// The zygote response.
+struct Zygote_response final {
+  std::int32_t is_signaled{};
+  std::int32_t value{};
+};
+
+/// The maximum size of argv and environment data of the zygote request.
+constexpr std::uint32_t zygote_max_data_size{64*1024*1024};
+
+} // namespace detail
+
+/**
+ * @brief A fork server (zygote).
+ *
+ * @details The zygote is a long-lived process which is already initialized
+ * (linked, `Info::initialize()`-ed, configured, warmed up). For each
+ * invocation made by run_zygote_client() it forks a child which receives
+ * the arguments, the environment, the working directory and the standard
+ * descriptors of the client, and calls the handler with the received
+ * arguments. The exit status of the child is returned to the client. So
+ * the cost of startup of each invocation is reduced to `fork()`.
+ *
+ * The zygote executes commands on behalf of anyone who can connect to its
+ * socket, so the socket is created with mode `0600`, and the connections
+ * from the processes with the effective user ID other than `geteuid()` are
+ * rejected.
+ */
+class Zygote final : Noncopymove {
+public:
+  /// The destructor.
+  ~Zygote()
+  {
+    for (const auto& [pid, conn] : children_)
+      close(conn);
+    if (fd_ >= 0) {
+      close(fd_);
+      unlink(path_.c_str());
+    }
+  }
+
+  /**
+   * @brief The constructor. Starts listening on the Unix domain socket at
+   * `path` with mode `0600`.
+   */
+  explicit Zygote(std::filesystem::path path)
+    : path_{std::move(path)}
+  {
+    const auto addr = detail::unix_address(path_);
+    detail::Fd_guard fd{detail::unix_socket()};
+    unlink(path_.c_str());
+    // On Linux the mode of the socket inode is inherited by the bound file,
+    // so there is no window when the file is accessible by others.
+    fchmod(fd.get(), S_IRUSR | S_IWUSR);
+    if (bind(fd.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)))
+      throw std::system_error{errno, std::system_category(),
+        std::string{"cannot bind zygote socket to "}.append(path_.string())};
+    if (chmod(path_.c_str(), S_IRUSR | S_IWUSR)) {
+      const int err{errno};
+      unlink(path_.c_str());
+      throw std::system_error{err, std::system_category(),
+        std::string{"cannot change mode of zygote socket "}
+          .append(path_.string())};
+    }
+    if (listen(fd.get(), SOMAXCONN))
+      throw std::system_error{errno, std::system_category(),
+        "cannot listen on zygote socket"};
+    fd_ = fd.release();
+  }
+
+  /// @returns The path to the socket.
+  const std::filesystem::path& path() const noexcept
+  {
+    return path_;
+  }
+
+  /**
+   * @brief Serves the invocations until `Info::instance().stop_signal` is
+   * set.
+   *
+   * @param handler The function with signature `int(int argc, const char*
+   * const* argv)` to call in the child process, where the arguments are the
+   * ones received from the client. The handler may use make_command() to
+   * parse them. The returned value is used as the exit code of the child.
+   *
+   * @par Requires
+   * `Info::is_initialized()`. No threads must be created yet.
+   *
+   * @remarks The signals `SIGTERM` and `SIGINT` are expected to be handled
+   * by setting `Info::instance().stop_signal` (see set_signals()).
+   */
+  template<typename F>
+  void serve(F&& handler)
+  {
+    auto& info = Info::instance();
+
+    // Install the handler of SIGCHLD to interrupt ppoll().
+    struct sigaction sa{};
+    sa.sa_handler = [](int){};
+    sigemptyset(&sa.sa_mask);
+    struct sigaction old_sa{};
+    if (sigaction(SIGCHLD, &sa, &old_sa))
+      throw std::system_error{errno, std::system_category(),
+        "cannot set SIGCHLD handler of zygote"};
+
+    // Block the signals outside ppoll() to avoid races.
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGINT);
+    sigset_t old_set;
+    sigprocmask(SIG_BLOCK, &set, &old_set);
+    struct Guard final {
+      const sigset_t& set;
+      const struct sigaction& sa;
+      ~Guard()
+      {
+        sigprocmask(SIG_SETMASK, &set, nullptr);
+        sigaction(SIGCHLD, &sa, nullptr);
+      }
+    } const guard{old_set, old_sa};
+
+    while (!info.stop_signal) {
+      pollfd pfd{fd_, POLLIN, 0};
+      const int ready{ppoll(&pfd, 1, nullptr, &old_set)};
+      if (ready < 0 && errno != EINTR)
+        throw std::system_error{errno, std::system_category(),
+          "cannot poll zygote socket"};
+
+      reap();
+
+      if (ready > 0 && (pfd.revents & POLLIN)) {
+        const int conn{accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC)};
+        if (conn < 0) {
+          if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+          throw std::system_error{errno, std::system_category(),
+            "cannot accept zygote connection"};
+        }
+        if (!is_trusted_peer(conn)) {
+          close(conn);
+          continue;
+        }
+
+        std::cout.flush();
+        std::cerr.flush();
+        std::fflush(nullptr);
+        const pid_t pid{Info::fork_process()};
+        if (pid < 0) {
+          const int err{errno};
+          close(conn);
+          throw std::system_error{err, std::system_category(),
+            "cannot fork zygote child"};
+        } else if (!pid) {
+          // The connections of other clients must not be kept open.
+          for (const auto& [child_pid, child_conn] : children_)
+            close(child_conn);
+          close(fd_);
+          sigaction(SIGCHLD, &old_sa, nullptr);
+          sigprocmask(SIG_SETMASK, &old_set, nullptr);
+          _exit(run_child(conn, handler));
+        }
+        children_.emplace(pid, conn);
+      }
+    }
+  }
+
+private:
+  std::filesystem::path path_;
+  int fd_{-1};
+  std::map<pid_t, int> children_;
+
+  /// @returns `true` if the peer of `conn` has the same effective user ID.
+  static bool is_trusted_peer(const int conn) noexcept
+  {
+    try {
+      return detail::peer_euid(conn) == geteuid();
+    } catch (...) {
+      return false;
+    }
+  }
+
+  /**
+   * @brief Reaps the exited children and sends their statuses to the
+   * clients.
+   *
+   * @remarks Other children of the process (if any) are not reaped.
+   */
+  void reap() noexcept
+  {
+    for (auto i = children_.begin(); i != children_.end();) {
+      int status{};
+      const pid_t pid{waitpid(i->first, &status, WNOHANG)};
+      if (pid > 0 || (pid < 0 && errno == ECHILD)) {
+        if (pid > 0) {
+          detail::Zygote_response response;
+          response.is_signaled = WIFSIGNALED(status);
+          response.value = response.is_signaled ? WTERMSIG(status) :
+            WEXITSTATUS(status);
+          send(i->second, &response, sizeof(response), MSG_NOSIGNAL);
+        }
+        close(i->second);
+        i = children_.erase(i);
+      } else
+        ++i;
+    }
+  }
+
+  /// Runs the child process. @returns The exit code.
+  template<typename F>
+  static int run_child(const int conn, F& handler) noexcept
+  {
+    try {
+      // Receive the request.
+      std::vector<int> fds;
+      detail::Zygote_request_header header;
+      const auto header_data = receive_descriptors(conn, sizeof(header), fds);
+      std::memcpy(&header, header_data.data(), sizeof(header));
+      if (header.magic != detail::Zygote_request_header{}.magic ||
+        header.data_size > detail::zygote_max_data_size || fds.size() != 4)
+        throw std::runtime_error{"invalid zygote request"};
+      auto data = receive_descriptors(conn, header.data_size, fds);
+      close(conn);
+
+      // Set up the standard descriptors and the working directory.
+      for (int i{}; i < 3; ++i) {
+        if (dup2(fds[i], i) < 0)
+          throw std::system_error{errno, std::system_category(),
+            "cannot set standard descriptor of zygote child"};
+        close(fds[i]);
+      }
+      if (fchdir(fds[3]))
+        throw std::system_error{errno, std::system_category(),
+          "cannot change directory of zygote child"};
+      close(fds[3]);
+
+      // Set up the arguments and the environment.
+      std::vector<const char*> argv;
+      std::vector<char*> envp;
+      for (std::size_t i{}, count{}; i < data.size() &&
+             count < header.argc + header.envc; ++count) {
+        if (count < header.argc)
+          argv.push_back(data.data() + i);
+        else
+          envp.push_back(data.data() + i);
+        i += std::strlen(data.data() + i) + 1;
+      }
+      if (argv.size() != header.argc || envp.size() != header.envc ||
+        argv.empty() || (!data.empty() && data.back() != '\0'))
+        throw std::runtime_error{"invalid zygote request data"};
+      envp.push_back(nullptr);
+      environ = envp.data();
+      argv.push_back(nullptr);
+
+      int result{EXIT_SUCCESS};
+      if constexpr (std::is_void_v<decltype(handler(0, argv.data()))>)
+        handler(static_cast<int>(header.argc), argv.data());
+      else
+        result = handler(static_cast<int>(header.argc), argv.data());
+      std::cout.flush();
+      std::cerr.flush();
+      std::fflush(nullptr);
+      return result;
+    } catch (const std::exception& e) {
+      std::cerr << e.what() << std::endl;
+    } catch (...) {
+      std::cerr << "unknown error" << std::endl;
+    }
+    std::fflush(nullptr);
+    return EXIT_FAILURE;
+  }
+};
+
+/**
+ * @brief Runs the program by the zygote listening at `path`, passing it
+ * the arguments, the environment, the working directory and the standard
+ * descriptors of the calling process.
+ *
+ * @returns The exit code of the program, or `128 + n` if the program was
+ * terminated by the signal `n`.
+ *
+ * @throws `std::system_error` if the zygote is not available, so the caller
+ * can fall back to running the program directly.
+ */
+inline int run_zygote_client(const std::filesystem::path& path,
+  const int argc, const char* const* const argv)
+{
+  if (argc <= 0 || !argv)
+    throw std::invalid_argument{"invalid arguments for zygote"};
+
+  detail::Zygote_request_header header;
+  header.argc = static_cast<std::uint32_t>(argc);
+  std::string data;
+  for (int i{}; i < argc; ++i) {
+    if (!argv[i])
+      throw std::invalid_argument{"invalid arguments for zygote"};
+    data.append(argv[i]).push_back('\0');
+  }
+  for (char** e{environ}; e && *e; ++e, ++header.envc)
+    data.append(*e).push_back('\0');
+  if (data.size() > detail::zygote_max_data_size)
+    throw std::invalid_argument{"too large request for zygote"};
+  header.data_size = static_cast<std::uint32_t>(data.size());
+
+  const detail::Fd_guard cwd{open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+  if (cwd.get() < 0)
+    throw std::system_error{errno, std::system_category(),
+      "cannot open working directory"};
+  const auto addr = detail::unix_address(path);
+  const detail::Fd_guard conn{detail::unix_socket()};
+  if (connect(conn.get(), reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)))
+    throw std::system_error{errno, std::system_category(),
+      std::string{"cannot connect to zygote socket "}.append(path.string())};
+
+  send_descriptors(conn.get(), {reinterpret_cast<const char*>(&header),
+    sizeof(header)}, {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO, cwd.get()});
+  if (!data.empty())
+    send_descriptors(conn.get(), data, {});
+
+  std::vector<int> fds;
+  detail::Zygote_response response;
+  const auto response_data = receive_descriptors(conn.get(), sizeof(response),
+    fds);
+  std::memcpy(&response, response_data.data(), sizeof(response));
+  return response.is_signaled ? 128 + response.value : response.value;
+}
+
+} // namespace dmitigr::prg
+
+#endif  // DMITIGR_PRG_ZYGOTE_HPP